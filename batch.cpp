@@ -0,0 +1,147 @@
+#include <glob.h>
+
+#include <algorithm>
+#include <atomic>
+#include <batch.hpp>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <io.hpp>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <thread_pool.hpp>
+
+namespace olavc {
+namespace batch {
+std::vector<ConvertOptions> read_manifest(const std::string &path,
+                                          const ConvertOptions &defaults) {
+  std::ifstream manifest{path};
+  if (!manifest) throw std::runtime_error{"could not open manifest"};
+
+  std::vector<ConvertOptions> jobs;
+  std::string buf;
+  while (std::getline(manifest, buf)) {
+    auto line{io::trim(buf)};
+    if (!line.size() || (line.front() == '#')) continue;
+
+    auto in{io::split_char(line, ' ')};
+    auto out{io::split_char(io::trim(in.second), ' ')};
+
+    auto job{defaults};
+    job.input = io::trim(in.first);
+    job.output = io::trim(out.first);
+    if (!job.output.size())
+      throw std::runtime_error{"manifest entry without output path"};
+
+    auto universes{io::trim(out.second)};
+    if (universes.size()) {
+      auto rslt{std::from_chars(universes.data(),
+                                universes.data() + universes.size(),
+                                job.universes)};
+      if ((rslt.ec != std::errc{}) ||
+          (rslt.ptr != (universes.data() + universes.size())))
+        throw std::runtime_error{"bad universe count in manifest"};
+    }
+
+    jobs.emplace_back(std::move(job));
+  }
+
+  if (!manifest.eof()) throw std::runtime_error{"reading manifest"};
+
+  return jobs;
+}
+
+std::vector<ConvertOptions> glob_jobs(const std::string &pattern,
+                                      const std::string &output_dir,
+                                      const ConvertOptions &defaults) {
+  glob_t g{};
+  auto ret{::glob(pattern.c_str(), 0, nullptr, &g)};
+  if ((ret != 0) && (ret != GLOB_NOMATCH)) {
+    globfree(&g);
+    throw std::runtime_error{"expanding input pattern"};
+  }
+
+  std::vector<ConvertOptions> jobs;
+  for (std::size_t i{}; i < g.gl_pathc; ++i) {
+    std::filesystem::path in{g.gl_pathv[i]};
+    auto out{in};
+    out.replace_extension(output_extension(defaults.format));
+    if (output_dir.size())
+      out = std::filesystem::path{output_dir} / out.filename();
+
+    auto job{defaults};
+    job.input = in.string();
+    job.output = out.string();
+    jobs.emplace_back(std::move(job));
+  }
+  globfree(&g);
+
+  return jobs;
+}
+
+std::vector<Outcome> run(const std::vector<ConvertOptions> &jobs,
+                         unsigned cores, std::ostream &log) {
+  std::vector<Outcome> outcomes(jobs.size());
+  if (jobs.empty()) return outcomes;
+
+  cores = std::max(1u, cores);
+
+  // Longest-first ordering keeps a big file from starting last and
+  // dominating the makespan.
+  std::vector<std::size_t> order(jobs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::vector<std::uintmax_t> sizes(jobs.size());
+  for (std::size_t i{}; i < jobs.size(); ++i) {
+    std::error_code ec;
+    sizes[i] = std::filesystem::file_size(jobs[i].input, ec);
+    if (ec) sizes[i] = 0;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+    return sizes[a] > sizes[b];
+  });
+
+  std::atomic<std::size_t> outstanding{jobs.size()};
+  std::atomic<std::size_t> finished{0};
+  std::mutex log_m;
+  {
+    ThreadPool pool{static_cast<unsigned>(
+        std::min<std::size_t>(cores, jobs.size()))};
+
+    for (auto i : order) {
+      pool.submit([&, i]() {
+        auto &o{outcomes[i]};
+        o.opts = jobs[i];
+        o.opts.progress = 0;
+        o.opts.threads = std::max<int>(
+            1, cores / std::min<std::size_t>(cores, outstanding.load()));
+
+        try {
+          o.result = convert(o.opts, log);
+          o.ok = true;
+        } catch (const std::exception &e) {
+          o.error = e.what();
+        }
+        --outstanding;
+
+        std::lock_guard<std::mutex> lk{log_m};
+        log << '[' << ++finished << '/' << jobs.size() << "] "
+            << (o.ok ? "done " : "FAILED ") << o.opts.input << '\n';
+      });
+    }
+  }
+
+  return outcomes;
+}
+
+void write_report(std::ostream &s, const std::vector<Outcome> &outcomes) {
+  s << "status\tinput\toutput\tframes\tduration_ms\telapsed_s\terror\n";
+  for (const auto &o : outcomes) {
+    s << (o.ok ? "ok" : "failed") << '\t' << o.opts.input << '\t'
+      << o.opts.output << '\t' << o.result.frames << '\t'
+      << o.result.duration_ms << '\t' << o.result.elapsed_s << '\t'
+      << o.error << '\n';
+  }
+}
+}  // namespace batch
+}  // namespace olavc
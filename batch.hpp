@@ -0,0 +1,89 @@
+#ifndef BATCH_HPP_INCLUDED
+#define BATCH_HPP_INCLUDED
+
+#include <convert.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace batch {
+/**
+ * Outcome of a single conversion within a batch.
+ */
+struct Outcome {
+  /**
+   * Options the conversion ran with.
+   */
+  ConvertOptions opts;
+  /**
+   * Whether the conversion completed.
+   */
+  bool ok{false};
+  /**
+   * Error message if the conversion failed.
+   */
+  std::string error;
+  /**
+   * Conversion statistics if the conversion completed.
+   */
+  ConvertResult result;
+};
+
+/**
+ * Reads conversion jobs from a manifest.
+ *
+ * Each non-empty line not starting with \c # holds an input path, an output
+ * path and optionally a universe count, separated by spaces. Missing
+ * universe counts and all other options are taken from \p defaults.
+ *
+ * \param path path of the manifest.
+ * \param defaults options applied to every job.
+ * \return jobs in manifest order.
+ */
+std::vector<ConvertOptions> read_manifest(const std::string &path,
+                                          const ConvertOptions &defaults);
+
+/**
+ * Creates conversion jobs for all showfiles matching a glob pattern.
+ *
+ * Outputs are named after the input with the extension replaced by the one
+ * of the output format.
+ *
+ * \param pattern shell glob pattern.
+ * \param output_dir directory receiving outputs, empty to write them next to
+ *                   the inputs.
+ * \param defaults options applied to every job.
+ * \return jobs in lexicographic input order.
+ */
+std::vector<ConvertOptions> glob_jobs(const std::string &pattern,
+                                      const std::string &output_dir,
+                                      const ConvertOptions &defaults);
+
+/**
+ * Runs conversions on a shared work-stealing pool.
+ *
+ * At most \p cores conversions run at once. Each conversion gets an equal
+ * share of the cores not used by other outstanding conversions as encoder
+ * threads, so the tail of a batch spreads over the whole budget instead of
+ * leaving cores idle. Larger inputs are started first.
+ *
+ * \param jobs conversions to run.
+ * \param cores global core budget.
+ * \param log stream receiving a line per finished conversion.
+ * \return outcomes in the order of \p jobs .
+ */
+std::vector<Outcome> run(const std::vector<ConvertOptions> &jobs,
+                         unsigned cores, std::ostream &log = std::cerr);
+
+/**
+ * Writes a tab-separated summary report.
+ *
+ * \param s stream to write to.
+ * \param outcomes outcomes returned by \c run() .
+ */
+void write_report(std::ostream &s, const std::vector<Outcome> &outcomes);
+}  // namespace batch
+}  // namespace olavc
+
+#endif
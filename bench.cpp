@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <bench.hpp>
+#include <chrono>
+#include <cmath>
+#include <decoder.hpp>
+#include <filesystem>
+#include <media.hpp>
+#include <random>
+#include <stdexcept>
+
+namespace olavc {
+namespace bench {
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>{Clock::now() - start}
+      .count();
+}
+
+double Result::decode_fps() const noexcept {
+  return (decode_s > 0) ? (frames / decode_s) : 0;
+}
+
+void synthesise(const std::string &path, const Synthetic &s) {
+  DMXVideoEncoder::EncoderOptions enc{};
+  enc.threads = s.threads;
+  enc.group_size = s.group_size;
+  DMXVideoEncoder::DMXVideoEncoder encoder{s.universes, path, enc};
+
+  io::UniverseStates sts{};
+  for (int u{}; u < s.universes; ++u) sts[u] = {};
+  std::mt19937 rng{1};
+  std::uniform_int_distribution<int> universe{0, s.universes - 1};
+  std::uniform_int_distribution<std::size_t> channel{
+      0, std::tuple_size_v<io::UniverseData> - 1};
+  std::uniform_int_distribution<int> value{0, 255};
+  const auto touched{std::max(1, s.universes / 4)};
+  for (std::size_t f{}; f < s.frames; ++f) {
+    for (int i{}; i < touched; ++i) {
+      auto &data{sts[universe(rng)]};
+      for (int c{}; c < 8; ++c)
+        data[channel(rng)] = static_cast<std::uint8_t>(value(rng));
+    }
+    encoder.write_universe(sts, s.frame_ms);
+  }
+  encoder.close();
+}
+
+Latency summarise(std::vector<double> &samples) {
+  Latency l{};
+  l.count = samples.size();
+  if (samples.empty()) return l;
+
+  std::sort(samples.begin(), samples.end());
+  auto rank = [&samples](double p) {
+    auto r{static_cast<std::size_t>(std::ceil(p * samples.size()))};
+    return samples[std::max<std::size_t>(r, 1) - 1];
+  };
+  l.p50_ms = rank(0.5);
+  l.p90_ms = rank(0.9);
+  l.p99_ms = rank(0.99);
+  l.max_ms = samples.back();
+  return l;
+}
+
+Result run(const std::string &path, const Options &opts) {
+  Result r{};
+  r.path = path;
+  r.bytes = std::filesystem::file_size(path);
+
+  DMXVideoDecoder::DecoderOptions dopts{};
+  dopts.universes = opts.universes;
+  dopts.threads = opts.threads;
+  DMXVideoDecoder::DMXVideoDecoder decoder{path, dopts};
+  r.universes = decoder.universes().size();
+  r.streams = decoder.total_streams();
+  r.streams_decoded = decoder.active_streams();
+  r.channels = decoder.channel_layout().width() - 2;
+
+  io::UniverseStates sts{};
+  std::int64_t pts, duration;
+  std::vector<std::int64_t> times;
+  auto start{Clock::now()};
+  while (decoder.read(sts, pts, duration)) {
+    times.push_back(pts);
+    r.duration_ms = std::max<std::int64_t>(r.duration_ms, pts + duration);
+  }
+  r.decode_s = ms_since(start) / 1000;
+  r.frames = times.size();
+  if (times.empty()) throw std::runtime_error{"no frame in video"};
+
+  auto show_at = [&](std::int64_t t) {
+    auto begin{Clock::now()};
+    decoder.seek(t);
+    if (!decoder.read(sts, pts, duration))
+      throw std::runtime_error{"no frame at seek target"};
+    return ms_since(begin);
+  };
+
+  std::vector<double> samples;
+  if (r.duration_ms) {
+    std::mt19937_64 rng{opts.seed};
+    std::uniform_int_distribution<std::int64_t> when{
+        0, static_cast<std::int64_t>(r.duration_ms) - 1};
+    for (std::size_t i{}; i < opts.seeks; ++i)
+      samples.push_back(show_at(when(rng)));
+  }
+  r.seek = summarise(samples);
+
+  samples.clear();
+  const auto steps{std::min(opts.steps, times.size())};
+  for (std::size_t i{}; i < steps; ++i)
+    samples.push_back(show_at(times[times.size() - 1 - i]));
+  r.step = summarise(samples);
+
+  return r;
+}
+
+void write_latency(std::ostream &s, const Latency &l) {
+  s << '\t' << l.p50_ms << '\t' << l.p90_ms << '\t' << l.p99_ms << '\t'
+    << l.max_ms;
+}
+
+void write_report(std::ostream &s, const std::vector<Result> &results) {
+  s << "path\tbytes\tuniverses\tstreams\tstreams_decoded\tchannels\tframes"
+       "\tduration_ms\tdecode_s\tdecode_fps\tseek_p50_ms\tseek_p90_ms"
+       "\tseek_p99_ms\tseek_max_ms\tstep_p50_ms\tstep_p90_ms\tstep_p99_ms"
+       "\tstep_max_ms\n";
+  for (const auto &r : results) {
+    s << r.path << '\t' << r.bytes << '\t' << r.universes << '\t' << r.streams
+      << '\t' << r.streams_decoded << '\t' << r.channels << '\t' << r.frames
+      << '\t' << r.duration_ms << '\t' << r.decode_s << '\t'
+      << r.decode_fps();
+    write_latency(s, r.seek);
+    write_latency(s, r.step);
+    s << '\n';
+  }
+}
+}  // namespace bench
+}  // namespace olavc
@@ -0,0 +1,170 @@
+#ifndef BENCH_HPP_INCLUDED
+#define BENCH_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace bench {
+/**
+ * Benchmark settings.
+ */
+struct Options {
+  /**
+   * Number of seeks to random times.
+   */
+  std::size_t seeks{200};
+  /**
+   * Number of steps back by a frame, starting from the last frame.
+   */
+  std::size_t steps{200};
+  /**
+   * Number of decoder threads per stream.
+   */
+  int threads{1};
+  /**
+   * Universes to decode, empty for all.
+   */
+  std::set<std::uint32_t> universes;
+  /**
+   * Seed of the random seek times, so runs can be repeated.
+   */
+  std::uint64_t seed{1};
+};
+
+/**
+ * Latency distribution of a repeated operation.
+ */
+struct Latency {
+  std::size_t count{};
+  double p50_ms{};
+  double p90_ms{};
+  double p99_ms{};
+  double max_ms{};
+};
+
+/**
+ * Measurements of a single video.
+ */
+struct Result {
+  std::string path;
+  /**
+   * Size of the file in bytes.
+   */
+  std::uint64_t bytes{};
+  /**
+   * Number of universes listed by the file, \c 0 if it does not list them.
+   */
+  std::size_t universes{};
+  /**
+   * Number of streams in the file, and of those decoded.
+   */
+  std::size_t streams{};
+  std::size_t streams_decoded{};
+  /**
+   * Number of channels stored in each frame line.
+   */
+  std::size_t channels{};
+  /**
+   * Number of frames and duration of the video in milliseconds.
+   */
+  std::size_t frames{};
+  std::uint64_t duration_ms{};
+  /**
+   * Wall-clock time of decoding the whole video in order, in seconds.
+   */
+  double decode_s{};
+  /**
+   * Time to show a frame at a random time: a seek and a frame read.
+   */
+  Latency seek;
+  /**
+   * Time to show the previous frame when stepping backwards.
+   */
+  Latency step;
+
+  /**
+   * \return frames decoded per second in order.
+   */
+  double decode_fps() const noexcept;
+};
+
+/**
+ * Settings of a synthetic video.
+ */
+struct Synthetic {
+  int universes{1};
+  std::size_t frames{2000};
+  /**
+   * Duration of each frame in milliseconds.
+   */
+  std::uint64_t frame_ms{25};
+  /**
+   * Universes per video stream, \c 0 for a single stream.
+   */
+  int group_size{};
+  /**
+   * Number of encoder threads, which also decides the number of slices
+   * decoders can work on in parallel.
+   */
+  int threads{1};
+};
+
+/**
+ * Encodes a synthetic show, so decoding can be measured across universe
+ * counts and encoder settings without recorded showfiles.
+ *
+ * Each frame changes a few channels of about a quarter of the universes,
+ * picked by a fixed pseudo-random sequence.
+ *
+ * \param path path of the video to write.
+ * \param s settings of the video.
+ */
+void synthesise(const std::string &path, const Synthetic &s);
+
+/**
+ * Summarises latency samples.
+ *
+ * \param samples latencies in milliseconds, reordered.
+ * \return nearest-rank percentiles of \p samples .
+ */
+Latency summarise(std::vector<double> &samples);
+
+/**
+ * Writes the percentiles of a latency distribution as tab-prefixed report
+ * columns.
+ *
+ * \param s stream to write to.
+ * \param l latency distribution.
+ */
+void write_latency(std::ostream &s, const Latency &l);
+
+/**
+ * Measures how fast a video decodes and seeks.
+ *
+ * The video is first decoded in order, recording the time of every frame.
+ * Seeks then jump to random times and step backwards from the last frame,
+ * each followed by reading the frame shown at the target.
+ *
+ * \param path path of the video.
+ * \param opts benchmark settings.
+ * \return measurements.
+ * \throw std::runtime_error if the video cannot be decoded.
+ */
+Result run(const std::string &path, const Options &opts = {});
+
+/**
+ * Writes a tab-separated report with a line per video.
+ *
+ * \param s stream to write to.
+ * \param results measurements to report.
+ */
+void write_report(std::ostream &s, const std::vector<Result> &results);
+}  // namespace bench
+}  // namespace olavc
+
+#endif
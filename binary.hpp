@@ -0,0 +1,129 @@
+#ifndef BINARY_HPP_INCLUDED
+#define BINARY_HPP_INCLUDED
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace binary {
+/**
+ * Appends an unsigned integer in little-endian byte order.
+ *
+ * \param out buffer to append to.
+ * \param v value to append.
+ */
+template <typename T>
+inline static void put_le(std::vector<std::uint8_t> &out, T v) {
+  for (std::size_t i{}; i < sizeof(T); ++i)
+    out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+}
+
+/**
+ * Reads an unsigned integer stored in little-endian byte order.
+ *
+ * \param p bytes to read.
+ * \return value read.
+ */
+template <typename T>
+inline static T get_le(const std::uint8_t *p) noexcept {
+  T v{};
+  for (std::size_t i{}; i < sizeof(T); ++i)
+    v |= static_cast<T>(p[i]) << (8 * i);
+  return v;
+}
+
+/**
+ * Owned file descriptor.
+ */
+class File {
+ private:
+  int fd;
+
+ public:
+  /**
+   * Opens a file.
+   *
+   * \param path path of the file.
+   * \param write whether to create or truncate the file for writing instead
+   *              of opening it for reading.
+   */
+  File(const std::string &path, bool write)
+      : fd{write ? ::open(path.c_str(),
+                          O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+                 : ::open(path.c_str(), O_RDONLY | O_CLOEXEC)} {
+    if (fd < 0)
+      throw std::runtime_error{std::string{"opening "} +
+                               (write ? "output" : "input")};
+  }
+  File(File &f) = delete;
+  File &operator=(File &f) = delete;
+  ~File() {
+    if (fd >= 0) ::close(fd);
+  }
+
+  /**
+   * Closes the file, reporting errors.
+   */
+  void close() {
+    auto ret{::close(fd)};
+    fd = -1;
+    if (ret) throw std::runtime_error{"closing file"};
+  }
+
+  /**
+   * Writes a whole buffer at a given offset.
+   */
+  void write_at(const void *data, std::size_t n, std::uint64_t off) {
+    const auto *p{static_cast<const std::uint8_t *>(data)};
+    while (n) {
+      auto ret{::pwrite(fd, p, n, static_cast<off_t>(off))};
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        throw std::runtime_error{"writing file"};
+      }
+      p += ret;
+      n -= ret;
+      off += ret;
+    }
+  }
+
+  /**
+   * Reads a whole buffer from a given offset.
+   *
+   * \throw std::runtime_error if the file ends before the buffer is full.
+   */
+  void read_at(void *data, std::size_t n, std::uint64_t off) const {
+    auto *p{static_cast<std::uint8_t *>(data)};
+    while (n) {
+      auto ret{::pread(fd, p, n, static_cast<off_t>(off))};
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        throw std::runtime_error{"reading file"};
+      }
+      if (!ret) throw std::runtime_error{"file truncated"};
+      p += ret;
+      n -= ret;
+      off += ret;
+    }
+  }
+
+  /**
+   * \return size of the file in bytes.
+   */
+  std::uint64_t size() const {
+    auto end{::lseek(fd, 0, SEEK_END)};
+    if (end < 0) throw std::runtime_error{"reading file size"};
+    return static_cast<std::uint64_t>(end);
+  }
+};
+}  // namespace binary
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,156 @@
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <budget.hpp>
+#include <fstream>
+#include <realtime.hpp>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace olavc {
+namespace budget {
+namespace {
+/**
+ * Interval between reads of the I/O counters of the process.
+ */
+constexpr const std::chrono::milliseconds poll_interval{5};
+
+/**
+ * Burst admitted by token buckets, in seconds of their rate.
+ */
+constexpr const double burst_s{0.1};
+
+/**
+ * Idle I/O class, from linux/ioprio.h which libc does not provide.
+ */
+constexpr const int ioprio_who_process{1};
+constexpr const int ioprio_class_idle{3};
+constexpr const int ioprio_class_shift{13};
+
+/**
+ * Reads the bytes read and written by the process so far.
+ *
+ * \return \c false if the counters are not available.
+ */
+bool read_counters(std::uint64_t &read, std::uint64_t &written) {
+  std::ifstream io{"/proc/self/io"};
+  bool got_read{false}, got_written{false};
+  for (std::string key; io >> key;) {
+    if (key == "rchar:")
+      got_read = static_cast<bool>(io >> read);
+    else if (key == "wchar:")
+      got_written = static_cast<bool>(io >> written);
+  }
+  return got_read && got_written;
+}
+}  // namespace
+
+void apply(const Options &opts) {
+  if (opts.cores) {
+    auto cpus{realtime::cpus(pthread_self())};
+    if (cpus.size() > opts.cores) {
+      cpus.erase(std::next(cpus.begin(), opts.cores), cpus.end());
+      if (realtime::pin(pthread_self(), cpus))
+        throw std::runtime_error{"restricting cores"};
+    }
+  }
+
+  if (opts.idle) {
+    sched_param sp{};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp))
+      throw std::runtime_error{"setting idle scheduling"};
+    if (syscall(SYS_ioprio_set, ioprio_who_process, 0,
+                ioprio_class_idle << ioprio_class_shift))
+      throw std::runtime_error{"setting idle I/O class"};
+  }
+}
+
+std::size_t queue_depth(const Options &opts) noexcept {
+  if ((opts.read_mb_s > 0) || (opts.write_mb_s > 0)) return 2;
+  if (opts.cores) return std::clamp<std::size_t>(2 * opts.cores, 2, 8);
+  return 8;
+}
+
+int cap_threads(const Options &opts, int threads) noexcept {
+  if (!opts.cores) return threads;
+  return std::min(threads, static_cast<int>(opts.cores));
+}
+
+TokenBucket::TokenBucket(double bytes_s)
+    : rate{bytes_s},
+      capacity{bytes_s * burst_s},
+      tokens{capacity},
+      last{Clock::now()} {
+  if (!(bytes_s > 0)) throw std::runtime_error{"non-positive rate"};
+}
+
+TokenBucket::Clock::time_point TokenBucket::take(std::uint64_t bytes,
+                                                 Clock::time_point now) {
+  auto elapsed{std::chrono::duration<double>{now - last}.count()};
+  last = now;
+  tokens = std::min(capacity, tokens + (rate * elapsed));
+  tokens -= static_cast<double>(bytes);
+  if (tokens >= 0) return now;
+  return now + std::chrono::duration_cast<Clock::duration>(
+                   std::chrono::duration<double>{-tokens / rate});
+}
+
+Limiter::Limiter(const Options &opts) {
+  if (opts.read_mb_s > 0) read.emplace(opts.read_mb_s * 1e6);
+  if (opts.write_mb_s > 0) write.emplace(opts.write_mb_s * 1e6);
+  read_counters(last_read, last_write);
+}
+
+void Limiter::wait(Clock::time_point now, Clock::time_point until) {
+  if (until <= now) return;
+  std::this_thread::sleep_until(until);
+
+  std::lock_guard<std::mutex> lk{m};
+  st.waited_s += std::chrono::duration<double>{until - now}.count();
+}
+
+void Limiter::charge() {
+  auto now{Clock::now()};
+  Clock::time_point until;
+  {
+    std::lock_guard<std::mutex> lk{m};
+    std::uint64_t r, w;
+    if ((now >= next_poll) && read_counters(r, w)) {
+      next_poll = now + poll_interval;
+      auto dr{r - std::min(r, last_read)};
+      auto dw{w - std::min(w, last_write)};
+      last_read = r;
+      last_write = w;
+      st.read_bytes += dr;
+      st.write_bytes += dw;
+      if (read) resume = std::max(resume, read->take(dr, now));
+      if (write) resume = std::max(resume, write->take(dw, now));
+    }
+    until = resume;
+  }
+  wait(now, until);
+}
+
+void Limiter::charge_read(std::uint64_t bytes) {
+  auto now{Clock::now()};
+  Clock::time_point until;
+  {
+    std::lock_guard<std::mutex> lk{m};
+    st.read_bytes += bytes;
+    if (read) resume = std::max(resume, read->take(bytes, now));
+    until = resume;
+  }
+  wait(now, until);
+}
+
+Stats Limiter::stats() {
+  std::lock_guard<std::mutex> lk{m};
+  return st;
+}
+}  // namespace budget
+}  // namespace olavc
@@ -0,0 +1,155 @@
+#ifndef BUDGET_HPP_INCLUDED
+#define BUDGET_HPP_INCLUDED
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+
+namespace olavc {
+namespace budget {
+/**
+ * Resources a conversion may use, so it can share a host with live playback.
+ */
+struct Options {
+  /**
+   * Number of CPUs the process runs on, \c 0 for all.
+   */
+  unsigned cores{0};
+  /**
+   * Rate of reading and of writing in megabytes (10^6 bytes) per second,
+   * \c 0 for no limit.
+   */
+  double read_mb_s{0};
+  double write_mb_s{0};
+  /**
+   * Run only when the CPUs and disks are otherwise idle, with
+   * \c SCHED_IDLE and the idle I/O class.
+   */
+  bool idle{false};
+};
+
+/**
+ * Restricts the calling thread to the CPU and scheduling budget.
+ *
+ * Threads started afterwards inherit the restrictions, so this is called
+ * before any other thread is started.
+ *
+ * \param opts resource budget.
+ * \throw std::runtime_error if the restrictions cannot be applied.
+ */
+void apply(const Options &opts);
+
+/**
+ * \param opts resource budget.
+ * \return number of frames to queue between pipeline stages. Deep queues
+ *         only hold more memory once throughput is capped.
+ */
+std::size_t queue_depth(const Options &opts) noexcept;
+
+/**
+ * \param opts resource budget.
+ * \param threads number of threads wanted by a parallel stage.
+ * \return \p threads limited to the CPU budget.
+ */
+int cap_threads(const Options &opts, int threads) noexcept;
+
+/**
+ * Token bucket admitting a byte rate, with bursts of a tenth of a second.
+ */
+class TokenBucket {
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  double rate;
+  double capacity;
+  double tokens;
+  Clock::time_point last;
+
+ public:
+  /**
+   * \param bytes_s admitted rate in bytes per second, must be positive.
+   */
+  explicit TokenBucket(double bytes_s);
+
+  /**
+   * Takes tokens, going into debt if there are not enough.
+   *
+   * \param bytes number of tokens to take.
+   * \param now current time.
+   * \return time the debt is repaid at, \p now if there is none.
+   */
+  Clock::time_point take(std::uint64_t bytes, Clock::time_point now);
+};
+
+/**
+ * I/O done and time spent waiting for the budget.
+ */
+struct Stats {
+  std::uint64_t read_bytes{};
+  std::uint64_t write_bytes{};
+  /**
+   * Time threads waited for the budget, summed over threads, in seconds.
+   */
+  double waited_s{};
+};
+
+/**
+ * Keeps the I/O of the process within read and write rates.
+ *
+ * Bytes read and written by the whole process, including libav and output
+ * threads, are taken from \c /proc/self/io , polled at most every few
+ * milliseconds. Callers are made to wait while the process is over budget,
+ * and backpressure from the bounded queues slows the rest of the pipeline
+ * down with them. One limiter is shared by all conversions of a process.
+ */
+class Limiter {
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  std::mutex m;
+  std::optional<TokenBucket> read;
+  std::optional<TokenBucket> write;
+  std::uint64_t last_read{0};
+  std::uint64_t last_write{0};
+  Clock::time_point next_poll;
+  Clock::time_point resume;
+  Stats st;
+
+  void wait(Clock::time_point now, Clock::time_point until);
+
+ public:
+  /**
+   * \param opts resource budget, of which the rates are used.
+   */
+  explicit Limiter(const Options &opts);
+  Limiter(Limiter &l) = delete;
+  Limiter(Limiter &&l) = delete;
+  Limiter &operator=(Limiter &l) = delete;
+  Limiter &operator=(Limiter &&l) = delete;
+
+  /**
+   * Charges I/O done since the last call, waiting while over budget.
+   *
+   * Cheap enough to call once per frame.
+   */
+  void charge();
+
+  /**
+   * Charges bytes read without read calls, such as from memory mappings,
+   * waiting while over budget.
+   *
+   * \param bytes number of bytes read.
+   */
+  void charge_read(std::uint64_t bytes);
+
+  /**
+   * \return I/O charged so far.
+   */
+  Stats stats();
+};
+}  // namespace budget
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,250 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <cxxopts.hpp>
+#include <io.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+/**
+ * Initial size of the input buffer, grown to hold several frames.
+ */
+constexpr const std::size_t min_buffer{1 << 20};
+constexpr const std::string_view stream_magic{"YUV4MPEG2"};
+constexpr const std::string_view frame_magic{"FRAME"};
+
+/**
+ * Channel values formatted as text, with their length.
+ */
+struct Digits {
+  std::array<std::array<char, 4>, 256> text;
+  std::array<std::uint8_t, 256> len;
+
+  Digits() {
+    for (unsigned v{}; v < 256; ++v)
+      len[v] = std::to_chars(text[v].data(), text[v].data() + 4, v).ptr -
+               text[v].data();
+  }
+};
+
+/**
+ * Converts a YUV4MPEG2 stream of video lines into OLA universe lines.
+ */
+class Converter {
+ private:
+  int in;
+  int out;
+  bool drop;
+  std::vector<char> buf;
+  std::size_t begin{0};
+  std::size_t end{0};
+  std::size_t segment{0};
+  std::size_t universes{0};
+  std::string line;
+  Digits digits;
+
+ public:
+  std::uint64_t written{0};
+  std::uint64_t dropped{0};
+  std::uint64_t skipped_bytes{0};
+
+  Converter(int in, int out, bool drop)
+      : in{in}, out{out}, drop{drop}, buf(min_buffer) {}
+
+  /**
+   * Parses a stream header, returning whether the line was one.
+   */
+  bool header(std::string_view l) {
+    if (l.substr(0, stream_magic.size()) != stream_magic) return false;
+
+    std::size_t w{0}, h{0};
+    while (l.size()) {
+      auto tok{l.substr(0, l.find(' '))};
+      l.remove_prefix(std::min(l.size(), tok.size() + 1));
+      if (tok.size() < 2) continue;
+      auto *field{(tok[0] == 'W') ? &w : ((tok[0] == 'H') ? &h : nullptr)};
+      if (field)
+        std::from_chars(tok.data() + 1, tok.data() + tok.size(), *field);
+    }
+    if (w < 2) throw std::runtime_error{"bad stream header"};
+
+    segment = w;
+    universes = h;
+    if (buf.size() < (4 * segment * universes))
+      buf.resize(4 * segment * universes);
+    std::cerr << "Got stream header: " << universes << " universe(s) at "
+              << segment << " bytes per universe." << '\n';
+    return true;
+  }
+
+  /**
+   * Writes a frame as one line of space-separated universes.
+   */
+  void emit(const char *frame) {
+    line.clear();
+    char num[16];
+    for (std::size_t u{0}; u < universes; ++u) {
+      const auto *l{reinterpret_cast<const std::uint8_t *>(frame) +
+                    (u * segment)};
+      if (u) line += ' ';
+      line.append(num, std::to_chars(num, num + sizeof(num),
+                                     olavc::io::read_line_universe(l))
+                               .ptr);
+      line += ' ';
+      for (std::size_t c{2}; c < segment; ++c) {
+        if (c > 2) line += ',';
+        line.append(digits.text[l[c]].data(), digits.len[l[c]]);
+      }
+    }
+    line += '\n';
+
+    for (std::size_t off{0}; off < line.size();) {
+      auto ret{::write(out, line.data() + off, line.size() - off)};
+      if ((ret < 0) && (errno == EINTR)) continue;
+      if (ret < 0) throw std::runtime_error{"writing universes"};
+      off += ret;
+    }
+    ++written;
+  }
+
+  /**
+   * Handles all complete headers and frames in the buffer.
+   */
+  void parse() {
+    const char *latest{nullptr};
+    while (begin < end) {
+      auto *p{buf.data() + begin};
+      auto avail{end - begin};
+      auto *nl{static_cast<const char *>(std::memchr(p, '\n', avail))};
+
+      if (!universes || !std::memcmp(p, stream_magic.data(),
+                                     std::min(avail, stream_magic.size()))) {
+        if (!nl) break;
+        // A new header may resize the buffer.
+        if (latest) emit(latest);
+        latest = nullptr;
+        if (!header({p, static_cast<std::size_t>(nl - p)}))
+          skipped_bytes += nl - p + 1;
+        begin += nl - p + 1;
+        continue;
+      }
+
+      if (std::memcmp(p, frame_magic.data(),
+                      std::min(avail, frame_magic.size()))) {
+        // Lost sync: skip to the next frame header.
+        const char *f{p + 1};
+        while ((f = static_cast<const char *>(
+                    std::memchr(f, 'F', buf.data() + end - f)))) {
+          auto left{static_cast<std::size_t>(buf.data() + end - f)};
+          if (!std::memcmp(f, frame_magic.data(),
+                           std::min(left, frame_magic.size())))
+            break;
+          ++f;
+        }
+        auto skip{f ? static_cast<std::size_t>(f - p) : avail};
+        skipped_bytes += skip;
+        begin += skip;
+        continue;
+      }
+
+      auto frame_bytes{segment * universes};
+      if (!nl || (static_cast<std::size_t>(buf.data() + end - (nl + 1)) <
+                  frame_bytes))
+        break;
+
+      if (latest) {
+        if (drop)
+          ++dropped;
+        else
+          emit(latest);
+      }
+      latest = nl + 1;
+      begin = (nl + 1 - buf.data()) + frame_bytes;
+    }
+    if (latest) emit(latest);
+  }
+
+  /**
+   * Converts the stream until its end.
+   */
+  void run() {
+    while (true) {
+      if (begin == end) {
+        begin = end = 0;
+      } else if ((end == buf.size()) && begin) {
+        std::memmove(buf.data(), buf.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+      } else if (end == buf.size()) {
+        buf.resize(buf.size() * 2);
+      }
+
+      auto len{::read(in, buf.data() + end, buf.size() - end)};
+      if ((len < 0) && (errno == EINTR)) continue;
+      if (len < 0) throw std::runtime_error{"reading stream"};
+      if (!len) break;
+      end += len;
+      parse();
+    }
+    skipped_bytes += end - begin;
+  }
+};
+}  // namespace
+
+int prog(int argc, char **argv) {
+  cxxopts::Options options{"yuv_to_ola",
+                           "converts VLC's Y800 YUV4MPEG2 output into OLA "
+                           "universe lines"};
+  // clang-format off
+  options.add_options()
+    ("i,input", "path of input stream (default: stdin)",
+      cxxopts::value<std::string>())
+    ("all-frames", "write every frame of live input, even when behind it")
+    ("h,help", "show help");
+  // clang-format on
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    return 0;
+  }
+
+  auto in{STDIN_FILENO};
+  if (result.count("input")) {
+    in = ::open(result["input"].as<std::string>().c_str(),
+                O_RDONLY | O_CLOEXEC);
+    if (in < 0) throw std::runtime_error{"could not open input"};
+  }
+
+  // Frames are only dropped from live input, files are written whole.
+  struct stat sb;
+  if (fstat(in, &sb)) throw std::runtime_error{"stat input"};
+  auto drop{!result.count("all-frames") && !S_ISREG(sb.st_mode)};
+
+  Converter conv{in, STDOUT_FILENO, drop};
+  conv.run();
+  std::cerr << "Frames written: " << conv.written << '\n'
+            << "Frames dropped: " << conv.dropped << '\n'
+            << "Bytes skipped: " << conv.skipped_bytes << '\n';
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  try {
+    return prog(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "Exiting with error: " << e.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,216 @@
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <control.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace olavc {
+namespace control {
+namespace {
+/**
+ * Longest command line accepted, clients sending longer lines are dropped.
+ */
+constexpr const std::size_t max_line{256};
+
+std::vector<std::string_view> words(std::string_view s) {
+  std::vector<std::string_view> w;
+  while (true) {
+    auto b{s.find_first_not_of(" \t\r")};
+    if (b == std::string_view::npos) break;
+    s.remove_prefix(b);
+    auto e{std::min(s.size(), s.find_first_of(" \t\r"))};
+    w.push_back(s.substr(0, e));
+    s.remove_prefix(e);
+  }
+  return w;
+}
+
+std::int64_t parse_ms(std::string_view s) {
+  std::int64_t v{};
+  auto rslt{std::from_chars(s.data(), s.data() + s.size(), v)};
+  if ((rslt.ec != std::errc{}) || (rslt.ptr != (s.data() + s.size())))
+    throw std::runtime_error{"bad time"};
+  return v;
+}
+
+double parse_rate(std::string_view s) {
+  std::string str{s};
+  char *end{nullptr};
+  auto v{std::strtod(str.c_str(), &end)};
+  if (!str.size() || (end != (str.c_str() + str.size())))
+    throw std::runtime_error{"bad rate"};
+  return v;
+}
+
+/**
+ * Writes a reply, giving up on clients that do not keep up with them.
+ */
+bool send_reply(int fd, const std::string &reply) {
+  auto line{reply + '\n'};
+  auto ret{send(fd, line.data(), line.size(), MSG_NOSIGNAL | MSG_DONTWAIT)};
+  return ret == static_cast<ssize_t>(line.size());
+}
+}  // namespace
+
+std::string execute(player::Player &p, std::string_view line) {
+  auto w{words(line)};
+  if (w.empty()) return "error empty command";
+
+  try {
+    auto args = [&w](std::size_t n) {
+      if (w.size() != (n + 1)) throw std::runtime_error{"wrong arguments"};
+    };
+
+    std::ostringstream reply;
+    reply << "ok";
+    if (w[0] == "play") {
+      args(0);
+      p.play();
+    } else if (w[0] == "pause") {
+      args(0);
+      p.pause();
+    } else if (w[0] == "stop") {
+      args(0);
+      p.stop();
+    } else if (w[0] == "seek") {
+      args(1);
+      p.seek(parse_ms(w[1]));
+    } else if (w[0] == "rate") {
+      args(1);
+      p.set_rate(parse_rate(w[1]));
+    } else if (w[0] == "loop") {
+      if ((w.size() == 2) && (w[1] == "off")) {
+        p.loop(0, -1);
+      } else {
+        args(2);
+        p.loop(parse_ms(w[1]), parse_ms(w[2]));
+      }
+    } else if (w[0] == "position") {
+      args(0);
+      auto s{p.status()};
+      reply << ' ' << s.position_ms << ' ' << (s.paused ? "paused" : "playing")
+            << ' ' << s.rate;
+    } else if (w[0] == "latency") {
+      args(0);
+      auto l{p.command_latency()};
+      reply << ' ' << l.count << ' ' << l.p50_ms << ' ' << l.p90_ms << ' '
+            << l.p99_ms << ' ' << l.max_ms;
+    } else {
+      return "error unknown command";
+    }
+    return reply.str();
+  } catch (const std::exception &e) {
+    return std::string{"error "} + e.what();
+  }
+}
+
+void remove_stale_socket(const std::string &path) {
+  struct stat sb;
+  if (::lstat(path.c_str(), &sb)) {
+    if (errno == ENOENT) return;
+    throw std::runtime_error{"could not stat " + path};
+  }
+  if (!S_ISSOCK(sb.st_mode))
+    throw std::runtime_error{path + " exists and is not a socket"};
+  ::unlink(path.c_str());
+}
+
+Server::Server(const std::string &path, player::Player &p)
+    : p{&p}, path{path}, fd{-1}, wake_fd{-1} {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error{"socket path too long"};
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  remove_stale_socket(path);
+  bool bound{false};
+  try {
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error{"creating socket"};
+    if (bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)))
+      throw std::runtime_error{"binding socket " + path};
+    bound = true;
+    if (listen(fd, 8)) throw std::runtime_error{"listening on " + path};
+
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd < 0) throw std::runtime_error{"creating eventfd"};
+
+    t = std::thread{[this]() { serve(); }};
+  } catch (...) {
+    if (fd >= 0) ::close(fd);
+    if (bound) ::unlink(path.c_str());
+    if (wake_fd >= 0) ::close(wake_fd);
+    throw;
+  }
+}
+
+Server::~Server() {
+  std::uint64_t one{1};
+  // An eventfd counter only fails to increase at its maximum.
+  [[maybe_unused]] auto ret{write(wake_fd, &one, sizeof(one))};
+  t.join();
+  ::close(wake_fd);
+  ::close(fd);
+  ::unlink(path.c_str());
+}
+
+void Server::serve() {
+  std::map<int, std::string> clients;
+  std::vector<pollfd> fds;
+  char buf[max_line];
+
+  while (true) {
+    fds.assign({{wake_fd, POLLIN, 0}, {fd, POLLIN, 0}});
+    for (const auto &c : clients) fds.push_back({c.first, POLLIN, 0});
+
+    auto ret{poll(fds.data(), fds.size(), -1)};
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[0].revents & POLLIN) break;
+
+    if (fds[1].revents & POLLIN) {
+      auto c{accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+      if (c >= 0) clients.emplace(c, std::string{});
+    }
+
+    for (auto it{fds.begin() + 2}; it != fds.end(); ++it) {
+      if (!it->revents) continue;
+
+      auto &pending{clients.at(it->fd)};
+      auto len{read(it->fd, buf, sizeof(buf))};
+      auto keep{(len > 0) || ((len < 0) && (errno == EAGAIN))};
+      if (len > 0) pending.append(buf, len);
+
+      std::size_t nl;
+      while (keep && ((nl = pending.find('\n')) != std::string::npos)) {
+        keep = send_reply(it->fd, execute(*p, {pending.data(), nl}));
+        pending.erase(0, nl + 1);
+      }
+      if (pending.size() > max_line) keep = false;
+
+      if (!keep) {
+        ::close(it->fd);
+        clients.erase(it->fd);
+      }
+    }
+  }
+
+  for (const auto &c : clients) ::close(c.first);
+}
+}  // namespace control
+}  // namespace olavc
@@ -0,0 +1,81 @@
+#ifndef CONTROL_HPP_INCLUDED
+#define CONTROL_HPP_INCLUDED
+
+#include <player.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace olavc {
+namespace control {
+/**
+ * Runs a player command.
+ *
+ * Commands are single lines of space-separated words:
+ *
+ * - \c play , \c pause , \c stop
+ * - \c seek \c MS
+ * - \c rate \c RATE
+ * - \c loop \c FROM_MS \c TO_MS , or \c loop \c off
+ * - \c position , replying \c POSITION_MS \c playing|paused \c RATE
+ * - \c latency , replying \c COUNT \c P50_MS \c P90_MS \c P99_MS \c MAX_MS
+ *   of the command latency of the player
+ *
+ * \param p player to control.
+ * \param line command, without its line terminator.
+ * \return reply line without its terminator, \c ok followed by any values,
+ *         or \c error followed by a message.
+ */
+std::string execute(player::Player &p, std::string_view line);
+
+/**
+ * Removes a socket left behind by an earlier process, so its path can be
+ * bound again.
+ *
+ * \param path path of the socket.
+ * \throw std::runtime_error if something other than a socket is at
+ *        \p path .
+ */
+void remove_stale_socket(const std::string &path);
+
+/**
+ * Serves player commands on a Unix domain socket.
+ *
+ * Clients connect to a stream socket and send command lines as accepted by
+ * \c execute() , each answered by a reply line. Commands are run as soon as
+ * they are received, on a thread of the server.
+ */
+class Server {
+ private:
+  player::Player *p;
+  std::string path;
+  int fd;
+  int wake_fd;
+  std::thread t;
+
+  void serve();
+
+ public:
+  /**
+   * Starts serving on a socket.
+   *
+   * A socket left at \p path by an earlier server is replaced.
+   *
+   * \param path path of the socket.
+   * \param p player to control, must outlive the server.
+   * \throw std::runtime_error if the socket cannot be created.
+   */
+  Server(const std::string &path, player::Player &p);
+  Server(Server &s) = delete;
+  Server(Server &&s) = delete;
+  Server &operator=(Server &s) = delete;
+  Server &operator=(Server &&s) = delete;
+  /**
+   * Stops serving and removes the socket.
+   */
+  ~Server();
+};
+}  // namespace control
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <convert.hpp>
+#include <dedup.hpp>
+#include <eventlog.hpp>
+#include <exception>
+#include <fstream>
+#include <io.hpp>
+#include <media.hpp>
+#include <memory.hpp>
+#include <memory>
+#include <merge.hpp>
+#include <prescan.hpp>
+#include <raw.hpp>
+#include <sink.hpp>
+#include <stdexcept>
+#include <stream.hpp>
+#include <string_view>
+
+namespace olavc {
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  auto elapsed{std::chrono::steady_clock::now() - start};
+  return std::chrono::duration<double, decltype(elapsed)::period>{elapsed}
+             .count() /
+         (decltype(elapsed)::period::den);
+}
+
+OutputFormat parse_output_format(const std::string &name) {
+  if (name == "ffv1") return OutputFormat::ffv1;
+  if (name == "y4m") return OutputFormat::y4m;
+  if (name == "gray8") return OutputFormat::gray8;
+  if (name == "dedup") return OutputFormat::dedup;
+  if (name == "events") return OutputFormat::events;
+  if (name == "arrow") return OutputFormat::arrow;
+  if (name == "parquet") return OutputFormat::parquet;
+  throw std::runtime_error{"unknown output format " + name};
+}
+
+const char *output_extension(OutputFormat format) noexcept {
+  switch (format) {
+    case OutputFormat::y4m:
+      return ".y4m";
+    case OutputFormat::gray8:
+      return ".gray";
+    case OutputFormat::dedup:
+      return ".olavcar";
+    case OutputFormat::events:
+      return ".olavcel";
+    case OutputFormat::arrow:
+      return ".arrow";
+    case OutputFormat::parquet:
+      return ".parquet";
+    case OutputFormat::ffv1:
+    default:
+      return ".mkv";
+  }
+}
+
+template <typename T>
+static T parse_number(std::string_view s, const char *what) {
+  T v{};
+  auto rslt{std::from_chars(s.data(), s.data() + s.size(), v)};
+  if ((rslt.ec != std::errc{}) || (rslt.ptr != (s.data() + s.size())))
+    throw std::runtime_error{std::string{"bad "} + what};
+  return v;
+}
+
+SinkSpec parse_sink_spec(const std::string &spec) {
+  std::string_view rest{spec};
+  SinkSpec sink{};
+  sink.path = rest.substr(0, rest.find(','));
+  rest.remove_prefix(std::min(rest.size(), sink.path.size() + 1));
+  if (!sink.path.size()) throw std::runtime_error{"output without path"};
+
+  while (rest.size()) {
+    auto opt{rest.substr(0, rest.find(','))};
+    rest.remove_prefix(std::min(rest.size(), opt.size() + 1));
+
+    auto eq{opt.find('=')};
+    if (eq == std::string_view::npos)
+      throw std::runtime_error{"output option without value"};
+    auto key{opt.substr(0, eq)};
+    auto value{opt.substr(eq + 1)};
+
+    if (key == "format")
+      sink.format = parse_output_format(std::string{value});
+    else if (key == "codec")
+      sink.codec = value;
+    else if (key == "fps")
+      sink.fps = parse_number<unsigned>(value, "output frame rate");
+    else if (key == "threads")
+      sink.threads = parse_number<int>(value, "output thread count");
+    else if (key == "group")
+      sink.group_size = parse_number<int>(value, "output group size");
+    else if (key == "universes")
+      sink.universes = io::parse_range_list(value);
+    else if (key == "table")
+      sink.table = table::parse_form(std::string{value});
+    else
+      throw std::runtime_error{"unknown output option " + std::string{key}};
+  }
+
+  return sink;
+}
+
+static std::unique_ptr<FrameSink> open_sink(const SinkSpec &spec,
+                                            int universes,
+                                            const io::ChannelLayout &layout) {
+  if (spec.universes.size() > static_cast<std::size_t>(universes))
+    throw std::runtime_error{"more filtered universes than in showfile"};
+  auto height{spec.universes.size() ? static_cast<int>(spec.universes.size())
+                                    : universes};
+
+  std::unique_ptr<FrameSink> sink;
+  switch (spec.format) {
+    case OutputFormat::y4m:
+      sink = std::make_unique<raw::RawVideoWriter>(height, spec.path,
+                                                   raw::Format::y4m, spec.fps);
+      break;
+    case OutputFormat::gray8:
+      sink = std::make_unique<raw::RawVideoWriter>(
+          height, spec.path, raw::Format::gray8, spec.fps);
+      break;
+    case OutputFormat::dedup:
+      sink = std::make_unique<dedup::Writer>(height, spec.path);
+      if (spec.fps)
+        sink = std::make_unique<ResampleSink>(std::move(sink), spec.fps);
+      break;
+    case OutputFormat::events:
+      sink = std::make_unique<eventlog::Writer>(height, spec.path);
+      if (spec.fps)
+        sink = std::make_unique<ResampleSink>(std::move(sink), spec.fps);
+      break;
+    case OutputFormat::arrow:
+    case OutputFormat::parquet:
+      sink = std::make_unique<table::TableWriter>(
+          spec.path,
+          (spec.format == OutputFormat::arrow) ? table::Container::ipc
+                                               : table::Container::parquet,
+          spec.table, static_cast<unsigned>(std::max(spec.threads, 0)));
+      if (spec.fps)
+        sink = std::make_unique<ResampleSink>(std::move(sink), spec.fps);
+      break;
+    case OutputFormat::ffv1:
+    default: {
+      DMXVideoEncoder::EncoderOptions enc{};
+      enc.codec = spec.codec;
+      enc.threads = spec.threads;
+      enc.group_size = spec.group_size;
+      enc.layout.channels = layout.channels;
+      for (const auto &[u, data] : layout.constants) {
+        if (spec.universes.empty() || spec.universes.count(u))
+          enc.layout.constants.emplace(u, data);
+      }
+      sink = std::make_unique<DMXVideoEncoder::DMXVideoEncoder>(
+          height, spec.path, enc);
+      if (spec.fps)
+        sink = std::make_unique<ResampleSink>(std::move(sink), spec.fps);
+    }
+  }
+
+  if (spec.universes.size())
+    sink = std::make_unique<FilterSink>(std::move(sink), spec.universes);
+
+  return sink;
+}
+
+/**
+ * Estimates the memory an output holds, most of which libav and the writers
+ * allocate out of sight.
+ */
+static std::uint64_t sink_bytes(const SinkSpec &spec, int universes,
+                                const io::ChannelLayout &layout) {
+  std::uint64_t rows{spec.universes.size() ? spec.universes.size()
+                                           : static_cast<std::size_t>(
+                                                 universes)};
+  if (spec.format != OutputFormat::ffv1)
+    return (rows * memory::state_bytes) + (1 << 20);
+
+  // A frame per encoder thread, plus the frame being filled and the packet.
+  std::uint64_t frames{static_cast<std::uint64_t>(std::max(spec.threads, 1)) +
+                       2};
+  std::uint64_t streams{1};
+  if (spec.group_size > 0)
+    streams = (rows + spec.group_size - 1) / spec.group_size;
+  return (rows * layout.width() * frames) +
+         (streams * memory::codec_context_bytes);
+}
+
+static std::vector<SinkSpec> sink_specs(const ConvertOptions &opts) {
+  std::vector<SinkSpec> specs;
+  if (opts.output.size()) {
+    SinkSpec primary{};
+    primary.path = opts.output;
+    primary.format = opts.format;
+    if ((opts.format == OutputFormat::y4m) ||
+        (opts.format == OutputFormat::gray8))
+      primary.fps = opts.raw_fps;
+    primary.threads = opts.threads;
+    primary.group_size = opts.group_size;
+    primary.table = opts.table;
+    specs.emplace_back(std::move(primary));
+  }
+  specs.insert(specs.end(), opts.sinks.begin(), opts.sinks.end());
+
+  if (specs.empty()) throw std::runtime_error{"no output specified"};
+  return specs;
+}
+
+io::ChannelLayout analyse_layout(const std::string &input,
+                                 bool elide_constant,
+                                 budget::Limiter *limiter) {
+  constexpr auto chans{std::tuple_size_v<io::UniverseData>};
+
+  std::ifstream show{input};
+  if (!show) throw std::runtime_error{"could not open showfile"};
+
+  io::UniverseStates first{};
+  std::array<bool, chans> varies{};
+  std::size_t used{1};
+  io::OLAFrame d_frame{};
+  io::LineCache cache{};
+  while (read_frame(show, d_frame, &cache) || (d_frame.duration_ms == -1)) {
+    if (limiter) limiter->charge();
+    // Repeated lines cannot use or change any further channel.
+    if (!d_frame.unchanged) {
+      auto [it, inserted]{first.try_emplace(d_frame.universe, d_frame.data)};
+      const auto &data{d_frame.data};
+      for (std::size_t c{used}; c < chans; ++c)
+        if (data[c]) used = c + 1;
+      if (!inserted) {
+        for (std::size_t c{}; c < chans; ++c)
+          varies[c] = varies[c] || (data[c] != it->second[c]);
+      }
+    }
+    if (d_frame.duration_ms == -1) break;
+  }
+  if (!show.eof()) throw std::runtime_error{"reading showfile"};
+
+  io::ChannelLayout layout{};
+  for (std::size_t c{}; c < used; ++c) {
+    if (!elide_constant || varies[c])
+      layout.channels.push_back(static_cast<std::uint16_t>(c));
+  }
+  // Keep a column even if nothing varies, frames cannot be empty.
+  if (layout.channels.empty()) layout.channels.push_back(0);
+
+  if (elide_constant) {
+    auto elided{io::elided_channels(layout)};
+    for (const auto &[u, data] : first) {
+      if (std::any_of(elided.begin(), elided.end(),
+                      [&data = data](auto c) { return data[c]; }))
+        layout.constants.emplace(u, data);
+    }
+  }
+
+  if (layout.channels.size() == chans) layout.channels.clear();
+  return layout;
+}
+
+ConvertResult convert(const ConvertOptions &opts, std::ostream &log) {
+  auto specs{sink_specs(opts)};
+
+  // Malformed showfiles fail here, before any output is created.
+  prescan::Summary summary{};
+  auto universes{opts.universes};
+  std::vector<merge::Input> inputs;
+  if (opts.merge.size()) {
+    if (opts.crop || opts.elide_constant)
+      throw std::runtime_error{"narrowing frames of merged recordings"};
+
+    const auto last{static_cast<std::uint64_t>(opts.last_duration)};
+    inputs.emplace_back(merge::open(opts.input, last));
+    for (const auto &path : opts.merge)
+      inputs.emplace_back(merge::open(path, last));
+    auto total{static_cast<int>(merge::check(inputs))};
+    if (universes && (universes != total))
+      throw std::runtime_error{"universe count differs from merged inputs"};
+    universes = total;
+  } else if (opts.prescan) {
+    summary = prescan::run(opts.input, prescan::default_chunk_bytes,
+                           opts.limiter.get());
+    universes = prescan::check(summary, universes);
+  }
+  if (universes <= 0) throw std::runtime_error{"non-positive universe count"};
+
+  io::ChannelLayout layout{};
+  if (opts.crop || opts.elide_constant)
+    layout = analyse_layout(opts.input, opts.elide_constant,
+                            opts.limiter.get());
+
+  const auto rows{static_cast<std::uint64_t>(universes)};
+  std::uint64_t outputs{};
+  for (const auto &spec : specs) outputs += sink_bytes(spec, universes, layout);
+  bool line_cache{true};
+  auto queue_depth{opts.queue_depth};
+  if (opts.memory_limit) {
+    // The source holds the current states and the line cache, the outputs
+    // their own buffers. What is left goes to snapshots queued between them.
+    const auto snapshot{rows * memory::state_bytes};
+    auto fixed{snapshot + outputs};
+    if ((fixed + (rows * memory::line_cache_bytes)) <= opts.memory_limit)
+      fixed += rows * memory::line_cache_bytes;
+    else
+      line_cache = false;
+    if (fixed + ((specs.size() > 1) ? 3 * snapshot : 0) > opts.memory_limit)
+      throw std::runtime_error{"memory limit too low for " +
+                               std::to_string(universes) + " universes"};
+    // Queued snapshots, and up to two more being filled and written.
+    auto fit{(opts.memory_limit - fixed) / snapshot};
+    queue_depth = std::max<std::size_t>(
+        1, std::min<std::uint64_t>(queue_depth, (fit > 2) ? fit - 2 : 1));
+  }
+
+  std::unique_ptr<FrameSink> single;
+  std::vector<std::unique_ptr<ThreadedSink>> threaded;
+  if (specs.size() == 1) {
+    single = open_sink(specs.front(), universes, layout);
+  } else {
+    for (const auto &spec : specs)
+      threaded.emplace_back(std::make_unique<ThreadedSink>(
+          open_sink(spec, universes, layout), queue_depth));
+  }
+  SnapshotPool snapshots{};
+
+  std::ifstream show;
+  stream::AnySource source;
+  if (inputs.empty()) {
+    show.open(opts.input);
+    if (!show) throw std::runtime_error{"could not open showfile"};
+    source = stream::ShowSource{show, universes,
+                                static_cast<std::uint64_t>(opts.last_duration),
+                                line_cache};
+  } else {
+    source = merge::merge(std::move(inputs));
+  }
+
+  ConvertResult result{};
+  auto start{std::chrono::steady_clock::now()};
+
+  auto frames{stream::window(std::move(source), opts.start_ms, opts.end_ms)};
+  for (const auto &f : frames) {
+    if (opts.limiter) opts.limiter->charge();
+    if (single && f.changed) {
+      single->write_changed(*f.states, *f.changed, f.duration_ms);
+    } else if (single) {
+      single->write_universe(*f.states, f.duration_ms);
+    } else {
+      // One copy of the states is shared by every output thread.
+      auto snap{snapshots.snapshot(*f.states)};
+      for (auto &t : threaded) t->write_shared(snap, f.duration_ms);
+    }
+    ++result.frames;
+    result.duration_ms += f.duration_ms;
+
+    if (opts.progress && !(result.frames % opts.progress)) {
+      auto elapsedf{seconds_since(start)};
+      log << "Frame " << result.frames << '\n'
+          << "Elapsed " << elapsedf << " s" << '\n'
+          << "Average FPS: " << (result.frames / elapsedf) << '\n';
+      if (summary.frames) {
+        log << "Progress: "
+            << ((100.0 * result.frames) / summary.frames) << " %" << '\n';
+      }
+    }
+  }
+
+  if (single) single->close();
+  std::exception_ptr error;
+  for (auto &t : threaded) {
+    try {
+      t->close();
+    } catch (...) {
+      if (!error) error = std::current_exception();
+    }
+  }
+  if (error) std::rethrow_exception(error);
+  result.elapsed_s = seconds_since(start);
+
+  result.memory.push_back({"source states", rows * memory::state_bytes});
+  if (opts.merge.empty() && line_cache)
+    result.memory.push_back({"line cache", rows * memory::line_cache_bytes});
+  result.memory.push_back(
+      {"output queues", snapshots.size() * rows * memory::state_bytes});
+  result.memory.push_back({"outputs", outputs});
+
+  return result;
+}
+}  // namespace olavc
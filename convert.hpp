@@ -0,0 +1,274 @@
+#ifndef CONVERT_HPP_INCLUDED
+#define CONVERT_HPP_INCLUDED
+
+#include <budget.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <io.hpp>
+#include <iostream>
+#include <memory>
+#include <memory.hpp>
+#include <set>
+#include <string>
+#include <table.hpp>
+#include <vector>
+
+namespace olavc {
+/**
+ * Kind of output written by a conversion.
+ */
+enum class OutputFormat {
+  /**
+   * FFV1 video in an MKV container.
+   */
+  ffv1,
+  /**
+   * Uncompressed YUV4MPEG2 stream.
+   */
+  y4m,
+  /**
+   * Uncompressed GRAY8 frames.
+   */
+  gray8,
+  /**
+   * Archive storing each distinct frame once, see \c dedup::Writer .
+   */
+  dedup,
+  /**
+   * Per-universe change log, see \c eventlog::Writer .
+   */
+  events,
+  /**
+   * Arrow IPC table, see \c table::TableWriter .
+   */
+  arrow,
+  /**
+   * Parquet table, see \c table::TableWriter .
+   */
+  parquet,
+};
+
+/**
+ * Parses an output format name.
+ *
+ * \param name format name, one of \c ffv1, \c y4m, \c gray8, \c dedup,
+ *             \c events, \c arrow or \c parquet .
+ * \return output format.
+ * \throw std::runtime_error if the name is unknown.
+ */
+OutputFormat parse_output_format(const std::string &name);
+
+/**
+ * \param format output format.
+ * \return conventional file name extension of \p format .
+ */
+const char *output_extension(OutputFormat format) noexcept;
+
+/**
+ * Description of one output of a conversion.
+ */
+struct SinkSpec {
+  /**
+   * Path of the output file, \c - for standard output with raw formats.
+   */
+  std::string path;
+  /**
+   * Kind of output to write.
+   */
+  OutputFormat format{OutputFormat::ffv1};
+  /**
+   * libavcodec encoder used for \c OutputFormat::ffv1 outputs.
+   */
+  std::string codec{"ffv1"};
+  /**
+   * Constant output frame rate, \c 0 to keep the showfile timing.
+   *
+   * Raw outputs without a rate write each frame once.
+   */
+  unsigned fps{};
+  /**
+   * Universes to write, empty for all.
+   */
+  std::set<std::uint32_t> universes;
+  /**
+   * Number of encoder threads.
+   */
+  int threads{1};
+  /**
+   * Universes per video stream of \c OutputFormat::ffv1 outputs, \c 0 for a
+   * single stream.
+   */
+  int group_size{};
+  /**
+   * Shape of \c OutputFormat::arrow and \c OutputFormat::parquet outputs.
+   */
+  table::Form table{table::Form::wide};
+};
+
+/**
+ * Parses an output description.
+ *
+ * Descriptions are a path followed by comma-separated \c key=value options:
+ * \c format ( \c ffv1, \c y4m, \c gray8, \c dedup, \c events, \c arrow or
+ * \c parquet ), \c codec (libavcodec encoder name), \c fps , \c threads ,
+ * \c universes (universe numbers and inclusive ranges joined by \c + , e.g.
+ * \c 0-15+32 ), \c group (universes per video stream) and \c table
+ * ( \c wide or \c long ).
+ *
+ * \param spec output description.
+ * \return parsed description.
+ * \throw std::runtime_error if the description is malformed.
+ */
+SinkSpec parse_sink_spec(const std::string &spec);
+
+/**
+ * Parameters for converting a single showfile.
+ */
+struct ConvertOptions {
+  /**
+   * Path of the input showfile.
+   */
+  std::string input;
+  /**
+   * Path of the output file, \c - for standard output with raw formats.
+   */
+  std::string output;
+  /**
+   * Kind of output to write.
+   */
+  OutputFormat format{OutputFormat::ffv1};
+  /**
+   * Constant frame rate of raw outputs, \c 0 to write each frame once.
+   */
+  unsigned raw_fps{};
+  /**
+   * Further recordings merged with \c input into one timeline, each holding
+   * other universes: showfiles, videos, frame archives or event logs, see
+   * \c merge::open() .
+   */
+  std::vector<std::string> merge;
+  /**
+   * Further outputs written from the same pass over the showfile.
+   *
+   * With more than one output in total, each output runs on its own thread.
+   */
+  std::vector<SinkSpec> sinks;
+  /**
+   * Number of universes in the showfile, \c 0 to take it from the pre-scan
+   * or, when merging, from the merged recordings.
+   */
+  int universes{};
+  /**
+   * Duration of the last frame in milliseconds.
+   */
+  int last_duration{1};
+  /**
+   * Time in the showfile at which the output starts in milliseconds.
+   */
+  std::uint64_t start_ms{};
+  /**
+   * Time in the showfile at which the output ends in milliseconds, \c 0 for
+   * the end of the showfile.
+   */
+  std::uint64_t end_ms{};
+  /**
+   * Frame interval between progress reports, \c 0 disables them.
+   */
+  int progress{};
+  /**
+   * Number of encoder threads.
+   */
+  int threads{1};
+  /**
+   * Universes per video stream, \c 0 for a single stream.
+   */
+  int group_size{};
+  /**
+   * Shape of table outputs.
+   */
+  table::Form table{table::Form::wide};
+  /**
+   * Whether to narrow the frames of \c OutputFormat::ffv1 outputs to the
+   * highest channel used anywhere in the showfile.
+   */
+  bool crop{false};
+  /**
+   * Whether to leave channels that never change out of the frames of
+   * \c OutputFormat::ffv1 outputs, recording their values in the file tags
+   * instead. Implies \c crop .
+   */
+  bool elide_constant{false};
+  /**
+   * Whether to check the structure of the showfile before creating any
+   * output, see \c prescan::run() . Also enables progress percentages.
+   */
+  bool prescan{true};
+  /**
+   * Number of frames queued for each output thread.
+   */
+  std::size_t queue_depth{8};
+  /**
+   * Memory the buffers of the conversion may use in bytes, \c 0 for no
+   * limit. Output queues shrink and the line cache is dropped to fit.
+   */
+  std::uint64_t memory_limit{0};
+  /**
+   * I/O budget shared with other conversions, \c nullptr for none.
+   */
+  std::shared_ptr<budget::Limiter> limiter;
+};
+
+/**
+ * Statistics describing a finished conversion.
+ */
+struct ConvertResult {
+  /**
+   * Number of video frames written.
+   */
+  std::size_t frames{};
+  /**
+   * Total duration of the video in milliseconds.
+   */
+  std::uint64_t duration_ms{};
+  /**
+   * Wall-clock time taken in seconds.
+   */
+  double elapsed_s{};
+  /**
+   * Memory held by the buffers of the conversion at its end, estimated
+   * from the universe count where it cannot be measured.
+   */
+  std::vector<memory::Component> memory;
+};
+
+/**
+ * Works out which channels of a showfile need to be stored in video frames.
+ *
+ * Reads the whole showfile once. Channels above the highest one holding a
+ * non-zero value are dropped; with \p elide_constant , every channel whose
+ * value never changes in any universe is dropped as well. At least one
+ * channel is always kept.
+ *
+ * \param input path of the showfile.
+ * \param elide_constant whether to drop constant channels.
+ * \param limiter I/O budget the read is charged to, \c nullptr for none.
+ * \return channel layout covering the showfile.
+ * \throw std::runtime_error on malformed input.
+ */
+io::ChannelLayout analyse_layout(const std::string &input,
+                                 bool elide_constant,
+                                 budget::Limiter *limiter = nullptr);
+
+/**
+ * Converts a showfile to a video.
+ *
+ * \param opts conversion parameters.
+ * \param log stream receiving progress reports.
+ * \return conversion statistics.
+ * \throw std::runtime_error on malformed input or encoder errors.
+ */
+ConvertResult convert(const ConvertOptions &opts,
+                      std::ostream &log = std::cerr);
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,48 @@
+#include <cstdlib>
+#include <memory.hpp>
+#include <new>
+
+// Replaces the global operator new and delete to count allocations for the
+// memory report. Linked into the executables only, so programs loading the
+// library, such as the Python module, keep their own allocator. The other
+// forms of new and delete forward to these.
+
+namespace {
+void *allocate(std::size_t n, std::size_t align) {
+  // aligned_alloc() needs sizes that are multiples of the alignment.
+  if (align) n = ((n + align - 1) / align) * align;
+  while (true) {
+    auto *p{align ? std::aligned_alloc(align, n ? n : align)
+                  : std::malloc(n ? n : 1)};
+    if (p) {
+      olavc::memory::count_allocation();
+      return p;
+    }
+    auto handler{std::get_new_handler()};
+    if (!handler) throw std::bad_alloc{};
+    handler();
+  }
+}
+
+void release(void *p) noexcept {
+  if (!p) return;
+  olavc::memory::count_deallocation();
+  std::free(p);
+}
+}  // namespace
+
+void *operator new(std::size_t n) { return allocate(n, 0); }
+
+void *operator new(std::size_t n, std::align_val_t a) {
+  return allocate(n, static_cast<std::size_t>(a));
+}
+
+void operator delete(void *p) noexcept { release(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { release(p); }
+
+void operator delete(void *p, std::size_t) noexcept { release(p); }
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  release(p);
+}
@@ -0,0 +1,230 @@
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <decoder.hpp>
+#include <stdexcept>
+
+namespace olavc {
+namespace DMXVideoDecoder {
+static constexpr const AVRational millisecond{1, 1000};
+
+using DMXVideoEncoder::PacketRef;
+
+static UniqueAVCodecContext init_decoder_context(const AVStream *st,
+                                                 int threads) {
+  auto *codec{avcodec_find_decoder(st->codecpar->codec_id)};
+  if (!codec) throw std::runtime_error{"finding decoder"};
+
+  UniqueAVCodecContext ctx{avcodec_alloc_context3(codec)};
+  if (!ctx) throw std::runtime_error{"allocating decoder context"};
+  if (avcodec_parameters_to_context(ctx.get(), st->codecpar) < 0)
+    throw std::runtime_error{"setting decoder parameters"};
+
+  // Frame threading delays output by a frame per thread. Slice threading
+  // keeps every packet decoding into its frame straight away.
+  ctx->thread_count = std::max(1, threads);
+  ctx->thread_type = FF_THREAD_SLICE;
+  ctx->pkt_timebase = st->time_base;
+
+  if (avcodec_open2(ctx.get(), codec, nullptr) < 0)
+    throw std::runtime_error{"could not open decoder"};
+
+  return ctx;
+}
+
+DMXVideoDecoder::DMXVideoDecoder(const std::string &path,
+                                 const DecoderOptions &opts)
+    : wanted{opts.universes} {
+  AVFormatContext *ctx{nullptr};
+  if (avformat_open_input(&ctx, path.c_str(), nullptr, nullptr) < 0)
+    throw std::runtime_error{"opening video"};
+  fmt_ctx.reset(ctx);
+
+  if (avformat_find_stream_info(ctx, nullptr) < 0)
+    throw std::runtime_error{"reading stream information"};
+
+  if (const auto *tag{av_dict_get(ctx->metadata, DMXVideoEncoder::channels_tag,
+                                  nullptr, 0)}) {
+    for (auto c : io::parse_range_list(
+             tag->value, std::tuple_size_v<io::UniverseData>)) {
+      if (c >= std::tuple_size_v<io::UniverseData>)
+        throw std::runtime_error{"bad channel layout"};
+      layout.channels.push_back(static_cast<std::uint16_t>(c));
+    }
+    if (layout.channels.empty()) throw std::runtime_error{"bad channel layout"};
+  }
+  if (const auto *tag{av_dict_get(
+          ctx->metadata, DMXVideoEncoder::constants_tag, nullptr, 0)})
+    io::parse_constants(tag->value, layout);
+
+  track_of_stream.assign(ctx->nb_streams, -1);
+  for (unsigned i{}; i < ctx->nb_streams; ++i) {
+    auto *st{ctx->streams[i]};
+    st->discard = AVDISCARD_ALL;
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) continue;
+
+    std::set<std::uint32_t> held;
+    if (const auto *tag{av_dict_get(st->metadata,
+                                    DMXVideoEncoder::universes_tag, nullptr,
+                                    0)})
+      held = io::parse_range_list(tag->value);
+    available.insert(held.begin(), held.end());
+
+    // Streams without a universe list must be decoded to find out.
+    auto needed{wanted.empty() || held.empty() ||
+                std::any_of(held.begin(), held.end(),
+                            [this](auto u) { return wanted.count(u); })};
+    if (!needed) continue;
+    if (!layout.full() && (st->codecpar->width != layout.width()))
+      throw std::runtime_error{"frame width differs from channel layout"};
+
+    track_of_stream[i] = static_cast<int>(tracks.size());
+    tracks.push_back({st, init_decoder_context(st, opts.threads)});
+    contexts.push_back(tracks.back().dec_ctx.get());
+    st->discard = AVDISCARD_DEFAULT;
+  }
+
+  if (tracks.empty()) throw std::runtime_error{"no stream to decode"};
+
+  frame.reset(av_frame_alloc());
+  if (!frame) throw std::runtime_error{"allocating frame"};
+}
+
+std::size_t DMXVideoDecoder::rows() const noexcept {
+  std::size_t n{};
+  for (const auto &t : tracks)
+    n += static_cast<std::size_t>(std::max(0, t.s->codecpar->height));
+  return n;
+}
+
+std::size_t DMXVideoDecoder::frame_bytes() const noexcept {
+  std::size_t n{};
+  for (const auto &t : tracks) {
+    n += static_cast<std::size_t>(std::max(0, t.s->codecpar->width)) *
+         static_cast<std::size_t>(std::max(0, t.s->codecpar->height));
+  }
+  return n;
+}
+
+void DMXVideoDecoder::decode_rows(const AVFrame &f,
+                                  io::UniverseStates &sts) const {
+  const auto chans{std::min<std::size_t>(std::tuple_size_v<io::UniverseData>,
+                                         std::max(0, f.width - 2))};
+  for (int r{}; r < f.height; ++r) {
+    const auto *l{f.data[0] + (static_cast<std::ptrdiff_t>(r) * f.linesize[0])};
+    auto u{io::read_line_universe(l)};
+    if (!wanted.empty() && !wanted.count(u)) continue;
+
+    if (layout.full())
+      std::copy(l + 2, l + 2 + chans, sts[u].begin());
+    else
+      io::read_line(l, layout, sts[u]);
+  }
+}
+
+bool DMXVideoDecoder::read_packets(FramePackets &fp) {
+  fp.packets.resize(tracks.size());
+  for (auto &p : fp.packets) {
+    if (!p) p.reset(av_packet_alloc());
+    if (!p) throw std::runtime_error{"allocating packet"};
+  }
+
+  std::size_t got{};
+  while (got < tracks.size()) {
+    PacketRef ref{};
+    auto &pkt{ref.pkt};
+    auto ret{av_read_frame(fmt_ctx.get(), &pkt)};
+    if (ret == AVERROR_EOF) {
+      if (got) throw std::runtime_error{"truncated frame at end of video"};
+      return false;
+    }
+    if (ret < 0) throw std::runtime_error{"reading packet"};
+
+    if ((pkt.stream_index < 0) ||
+        (static_cast<std::size_t>(pkt.stream_index) >= track_of_stream.size()))
+      continue;
+    auto idx{track_of_stream[pkt.stream_index]};
+    if (idx < 0) continue;
+    auto &t{tracks[idx]};
+
+    auto pts{av_rescale_q(pkt.pts, t.s->time_base, millisecond)};
+    auto dur{av_rescale_q(pkt.duration, t.s->time_base, millisecond)};
+
+    // Every frame is a keyframe, so frames ending before the seek target
+    // need not be decoded at all.
+    if ((seek_target >= 0) && ((pts + dur) <= seek_target)) continue;
+
+    if (got && (pts != fp.pts_ms))
+      throw std::runtime_error{"streams out of step"};
+    fp.pts_ms = pts;
+    fp.duration_ms = dur;
+
+    bytes_decoded += pkt.size;
+    av_packet_unref(fp.packets[idx].get());
+    av_packet_move_ref(fp.packets[idx].get(), &pkt);
+    ++got;
+  }
+
+  seek_target = -1;
+  return true;
+}
+
+void DMXVideoDecoder::decode(const std::vector<AVCodecContext *> &ctxs,
+                             const FramePackets &fp, AVFrame &f,
+                             io::UniverseStates &sts) const {
+  for (std::size_t i{}; i < ctxs.size(); ++i) {
+    if (avcodec_send_packet(ctxs[i], fp.packets[i].get()) < 0)
+      throw std::runtime_error{"sending to decoder"};
+    if (avcodec_receive_frame(ctxs[i], &f) < 0)
+      throw std::runtime_error{"receive frame from decoder"};
+
+    decode_rows(f, sts);
+    av_frame_unref(&f);
+  }
+}
+
+bool DMXVideoDecoder::read(io::UniverseStates &sts, std::int64_t &pts_ms,
+                           std::int64_t &duration_ms) {
+  if (!read_packets(pending)) return false;
+
+  decode(contexts, pending, *frame, sts);
+
+  pts_ms = pending.pts_ms;
+  duration_ms = pending.duration_ms;
+  return true;
+}
+
+void DMXVideoDecoder::seek(std::int64_t ms) {
+  const auto *st{tracks.front().s};
+  auto ts{av_rescale_q(ms, millisecond, st->time_base)};
+  if (av_seek_frame(fmt_ctx.get(), st->index, ts, AVSEEK_FLAG_BACKWARD) < 0)
+    throw std::runtime_error{"seeking"};
+
+  for (auto &t : tracks) avcodec_flush_buffers(t.dec_ctx.get());
+  seek_target = ms;
+}
+
+std::int64_t DMXVideoDecoder::duration_ms() const noexcept {
+  if (fmt_ctx->duration == AV_NOPTS_VALUE) return -1;
+  return fmt_ctx->duration / (AV_TIME_BASE / 1000);
+}
+
+FrameDecoder::FrameDecoder(const DMXVideoDecoder &source, int threads)
+    : source{&source} {
+  for (const auto &t : source.tracks) {
+    ctxs.emplace_back(init_decoder_context(t.s, threads));
+    contexts.push_back(ctxs.back().get());
+  }
+
+  frame.reset(av_frame_alloc());
+  if (!frame) throw std::runtime_error{"allocating frame"};
+}
+
+void FrameDecoder::decode(const FramePackets &fp, io::UniverseStates &sts) {
+  source->decode(contexts, fp, *frame, sts);
+}
+}  // namespace DMXVideoDecoder
+}  // namespace olavc
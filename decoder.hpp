@@ -0,0 +1,232 @@
+#ifndef DECODER_HPP_INCLUDED
+#define DECODER_HPP_INCLUDED
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <cstddef>
+#include <cstdint>
+#include <io.hpp>
+#include <media.hpp>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace DMXVideoDecoder {
+using DMXVideoEncoder::UniqueAVCodecContext;
+using DMXVideoEncoder::UniqueAVFrame;
+using DMXVideoEncoder::UniqueCDeleterPPtr;
+
+using UniqueAVInputFormatContext =
+    UniqueCDeleterPPtr<AVFormatContext, avformat_close_input>;
+
+using UniqueAVPacket = UniqueCDeleterPPtr<AVPacket, av_packet_free>;
+
+/**
+ * Decoder settings.
+ */
+struct DecoderOptions {
+  /**
+   * Universes to decode, empty for all.
+   *
+   * Streams of files encoded with universe groups that hold none of the
+   * requested universes are neither read nor decoded.
+   */
+  std::set<std::uint32_t> universes;
+  /**
+   * Number of decoder threads per stream, \c 1 disables threading.
+   */
+  int threads{1};
+};
+
+/**
+ * Compressed packets of one frame, read by
+ * \c DMXVideoDecoder::read_packets() .
+ */
+struct FramePackets {
+  /**
+   * Packet of each decoded stream, in stream order. Packets are reused
+   * between frames.
+   */
+  std::vector<UniqueAVPacket> packets;
+  /**
+   * Presentation time of the frame in milliseconds.
+   */
+  std::int64_t pts_ms{};
+  /**
+   * Duration of the frame in milliseconds.
+   */
+  std::int64_t duration_ms{};
+};
+
+class FrameDecoder;
+
+/**
+ * Decodes videos written by \c DMXVideoEncoder back into universe states.
+ */
+class DMXVideoDecoder {
+ private:
+  friend class FrameDecoder;
+
+  /**
+   * Decoder for one stream of the file.
+   */
+  struct Track {
+    AVStream *s;
+    UniqueAVCodecContext dec_ctx;
+  };
+
+  UniqueAVInputFormatContext fmt_ctx;
+  std::vector<Track> tracks;
+  std::vector<AVCodecContext *> contexts;
+  std::vector<int> track_of_stream;
+  std::set<std::uint32_t> wanted;
+  std::set<std::uint32_t> available;
+  io::ChannelLayout layout;
+  UniqueAVFrame frame;
+  FramePackets pending;
+  std::int64_t seek_target{-1};
+  std::uint64_t bytes_decoded{0};
+
+  void decode_rows(const AVFrame &f, io::UniverseStates &sts) const;
+  void decode(const std::vector<AVCodecContext *> &ctxs,
+              const FramePackets &fp, AVFrame &f,
+              io::UniverseStates &sts) const;
+
+ public:
+  /**
+   * Opens a video for decoding.
+   *
+   * \param path path of the video.
+   * \param opts decoder settings.
+   * \throw std::runtime_error if the file cannot be opened or holds no
+   *        decodable stream.
+   */
+  explicit DMXVideoDecoder(const std::string &path,
+                           const DecoderOptions &opts = {});
+  DMXVideoDecoder(DMXVideoDecoder &dec) = delete;
+  DMXVideoDecoder(DMXVideoDecoder &&dec) = delete;
+  DMXVideoDecoder &operator=(DMXVideoDecoder &dec) = delete;
+  DMXVideoDecoder &operator=(DMXVideoDecoder &&dec) = delete;
+
+  /**
+   * Decodes the next frame.
+   *
+   * Only universes selected at construction are updated in \p sts . All
+   * 512 channels are restored, including those elided at encode.
+   *
+   * \param sts universe states to update.
+   * \param pts_ms receives the presentation time of the frame.
+   * \param duration_ms receives the duration of the frame.
+   * \return \c false at the end of the video.
+   */
+  bool read(io::UniverseStates &sts, std::int64_t &pts_ms,
+            std::int64_t &duration_ms);
+
+  /**
+   * Reads the packets of the next frame without decoding them.
+   *
+   * Every frame is a keyframe, so the packets can be decoded by a
+   * \c FrameDecoder on another thread, in any order relative to other
+   * frames.
+   *
+   * \param fp receives the packets of the frame.
+   * \return \c false at the end of the video.
+   */
+  bool read_packets(FramePackets &fp);
+
+  /**
+   * Positions the decoder so that the next frame read is the one shown at a
+   * given time.
+   *
+   * Frames before the target are skipped without being decoded.
+   *
+   * \param ms time to seek to.
+   */
+  void seek(std::int64_t ms);
+
+  /**
+   * \return duration of the video in milliseconds, \c -1 if unknown.
+   */
+  std::int64_t duration_ms() const noexcept;
+
+  /**
+   * \return universes stored in the file, empty if the file does not list
+   *         them.
+   */
+  const std::set<std::uint32_t> &universes() const noexcept {
+    return available;
+  }
+
+  /**
+   * \return channels stored in the frames of the file.
+   */
+  const io::ChannelLayout &channel_layout() const noexcept { return layout; }
+
+  /**
+   * \return number of streams that are decoded.
+   */
+  std::size_t active_streams() const noexcept { return tracks.size(); }
+
+  /**
+   * \return number of universe rows in the frames of the decoded streams.
+   */
+  std::size_t rows() const noexcept;
+
+  /**
+   * \return size of a decoded frame of all decoded streams in bytes.
+   */
+  std::size_t frame_bytes() const noexcept;
+
+  /**
+   * \return total number of streams in the file.
+   */
+  std::size_t total_streams() const noexcept {
+    return track_of_stream.size();
+  }
+
+  /**
+   * \return number of compressed bytes decoded so far.
+   */
+  std::uint64_t compressed_bytes() const noexcept { return bytes_decoded; }
+};
+
+/**
+ * Decodes packets read by \c DMXVideoDecoder::read_packets() .
+ *
+ * Holds decoders of its own, so several frame decoders can decode frames of
+ * one video in parallel, each on its own thread.
+ */
+class FrameDecoder {
+ private:
+  const DMXVideoDecoder *source;
+  std::vector<UniqueAVCodecContext> ctxs;
+  std::vector<AVCodecContext *> contexts;
+  UniqueAVFrame frame;
+
+ public:
+  /**
+   * \param source video the packets are read from, must outlive the frame
+   *               decoder.
+   * \param threads number of decoder threads per stream.
+   */
+  explicit FrameDecoder(const DMXVideoDecoder &source, int threads = 1);
+  FrameDecoder(FrameDecoder &dec) = delete;
+  FrameDecoder &operator=(FrameDecoder &dec) = delete;
+
+  /**
+   * Decodes a frame.
+   *
+   * \param fp packets of the frame.
+   * \param sts universe states to update, as by \c DMXVideoDecoder::read() .
+   */
+  void decode(const FramePackets &fp, io::UniverseStates &sts);
+};
+}  // namespace DMXVideoDecoder
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cstring>
+#include <dedup.hpp>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace olavc {
+namespace dedup {
+static constexpr const char magic[]{"OLAVCAR1"};
+static constexpr const char end_magic[]{"OLAVCEND"};
+static constexpr const std::size_t magic_size{sizeof(magic) - 1};
+static constexpr const std::size_t header_bytes{magic_size + 4};
+static constexpr const std::size_t footer_bytes{16 + magic_size};
+static constexpr const std::size_t entry_bytes{8};
+static constexpr const std::size_t row_bytes{
+    std::tuple_size_v<io::UniverseData>};
+
+/**
+ * Hashes a buffer eight bytes at a time.
+ *
+ * Not meant to resist collisions on purpose, matches are verified anyway.
+ */
+static std::uint64_t hash_bytes(const std::uint8_t *p, std::size_t n) noexcept {
+  constexpr std::uint64_t mul{0x9e3779b97f4a7c15};
+  std::uint64_t h{n * mul};
+  std::size_t i{};
+  for (; (i + 8) <= n; i += 8) {
+    std::uint64_t w;
+    std::memcpy(&w, p + i, sizeof(w));
+    h = (h ^ w) * mul;
+    h ^= h >> 29;
+  }
+  for (; i < n; ++i) h = (h ^ p[i]) * mul;
+  return h ^ (h >> 32);
+}
+
+static const std::string &archive_path(const std::string &path) {
+  // Frames are read back to verify matches, so pipes cannot be used.
+  if (path == "-") throw std::runtime_error{"archive output must be a file"};
+  return path;
+}
+
+Writer::Writer(int universes, const std::string &path)
+    : file{archive_path(path), true},
+      universes{static_cast<std::size_t>(std::max(universes, 0))} {
+  if (universes <= 0) throw std::runtime_error{"non-positive universe count"};
+
+  frame_bytes = this->universes * row_bytes;
+  data_offset = header_bytes + (4 * this->universes);
+  frame.resize(frame_bytes);
+  scratch.resize(frame_bytes);
+  row_hashes.resize(this->universes);
+}
+
+Writer::~Writer() {
+  try {
+    close();
+  } catch (const std::exception &) {
+  }
+}
+
+void Writer::ensure_not_closed() {
+  if (closed) throw std::logic_error{"closed"};
+}
+
+void Writer::start(const io::UniverseStates &sts) {
+  if (sts.size() != universes)
+    throw std::runtime_error{"universe state(s) undefined at encode"};
+
+  std::vector<std::uint8_t> header(magic, magic + magic_size);
+  binary::put_le<std::uint32_t>(header, universes);
+  for (const auto &st : sts) {
+    numbers.push_back(st.first);
+    binary::put_le<std::uint32_t>(header, st.first);
+  }
+  file.write_at(header.data(), header.size(), 0);
+  started = true;
+}
+
+void Writer::set_row(std::size_t row, const io::UniverseData &data) {
+  auto *p{frame.data() + (row * row_bytes)};
+  std::copy(data.begin(), data.end(), p);
+  row_hashes[row] = hash_bytes(p, row_bytes);
+}
+
+std::uint32_t Writer::store() {
+  const auto h{hash_bytes(reinterpret_cast<const std::uint8_t *>(
+                              row_hashes.data()),
+                          row_hashes.size() * sizeof(row_hashes.front()))};
+  // Repeats of the previous frame are the most common match, and its
+  // contents are still at hand in the scratch buffer.
+  if (timeline.size() && (h == last_hash) && (scratch == frame))
+    return last_frame;
+  last_hash = h;
+
+  auto &candidates{index[h]};
+  for (auto id : candidates) {
+    file.read_at(scratch.data(), frame_bytes,
+                 data_offset + (static_cast<std::uint64_t>(id) * frame_bytes));
+    if (scratch == frame) return id;
+  }
+
+  if (unique == std::numeric_limits<std::uint32_t>::max())
+    throw std::runtime_error{"too many distinct frames for archive"};
+  auto id{unique++};
+  file.write_at(frame.data(), frame_bytes,
+                data_offset + (static_cast<std::uint64_t>(id) * frame_bytes));
+  candidates.push_back(id);
+  scratch = frame;
+  return id;
+}
+
+void Writer::append(std::uint32_t id, std::uint64_t duration) {
+  constexpr std::uint64_t max{std::numeric_limits<std::uint32_t>::max()};
+  if (scratch != frame) scratch = frame;
+  last_frame = id;
+
+  while (duration) {
+    if (timeline.size() && (timeline.back().frame == id) &&
+        (timeline.back().duration_ms < max)) {
+      auto add{std::min(duration, max - timeline.back().duration_ms)};
+      timeline.back().duration_ms += static_cast<std::uint32_t>(add);
+      duration -= add;
+      continue;
+    }
+
+    auto add{std::min(duration, max)};
+    timeline.push_back({id, static_cast<std::uint32_t>(add)});
+    duration -= add;
+  }
+}
+
+void Writer::write_universe(const io::UniverseStates &sts,
+                            std::uint64_t duration) {
+  ensure_not_closed();
+  if (!started) start(sts);
+  if (sts.size() != universes)
+    throw std::runtime_error{"universe state(s) undefined at encode"};
+
+  std::size_t row{};
+  for (const auto &st : sts) {
+    if (st.first != numbers[row])
+      throw std::runtime_error{"universes changed between frames"};
+    set_row(row++, st.second);
+  }
+  append(store(), duration);
+}
+
+void Writer::write_changed(const io::UniverseStates &sts,
+                           const std::vector<std::uint32_t> &changed,
+                           std::uint64_t duration) {
+  ensure_not_closed();
+  if (!started) return write_universe(sts, duration);
+  if (sts.size() != universes)
+    throw std::runtime_error{"universe state(s) undefined at encode"};
+
+  for (auto u : changed) {
+    auto it{std::lower_bound(numbers.begin(), numbers.end(), u)};
+    if ((it == numbers.end()) || (*it != u))
+      throw std::runtime_error{"universes changed between frames"};
+    set_row(it - numbers.begin(), sts.at(u));
+  }
+  append(store(), duration);
+}
+
+void Writer::close() {
+  if (closed) return;
+
+  closed = true;
+  if (!started) {
+    std::vector<std::uint8_t> header(magic, magic + magic_size);
+    binary::put_le<std::uint32_t>(header, 0);
+    file.write_at(header.data(), header.size(), 0);
+    data_offset = header_bytes;
+  }
+
+  std::vector<std::uint8_t> tail;
+  tail.reserve((timeline.size() * entry_bytes) + footer_bytes);
+  for (const auto &e : timeline) {
+    binary::put_le(tail, e.frame);
+    binary::put_le(tail, e.duration_ms);
+  }
+  binary::put_le<std::uint64_t>(tail, unique);
+  binary::put_le<std::uint64_t>(tail, timeline.size());
+  tail.insert(tail.end(), end_magic, end_magic + magic_size);
+  const auto tail_offset{data_offset +
+                         (static_cast<std::uint64_t>(unique) * frame_bytes)};
+  file.write_at(tail.data(), tail.size(), tail_offset);
+  file.close();
+}
+
+Reader::Reader(const std::string &path) : file{path, false} {
+  const auto size{file.size()};
+  if (size < (header_bytes + footer_bytes))
+    throw std::runtime_error{"not a frame archive"};
+
+  std::uint8_t header[header_bytes];
+  file.read_at(header, sizeof(header), 0);
+  if (std::memcmp(header, magic, magic_size))
+    throw std::runtime_error{"not a frame archive"};
+  const auto count{binary::get_le<std::uint32_t>(header + magic_size)};
+
+  std::uint8_t footer[footer_bytes];
+  file.read_at(footer, sizeof(footer), size - footer_bytes);
+  if (std::memcmp(footer + 16, end_magic, magic_size))
+    throw std::runtime_error{"archive incomplete"};
+  unique = binary::get_le<std::uint64_t>(footer);
+  const auto n{binary::get_le<std::uint64_t>(footer + 8)};
+
+  frame_bytes = static_cast<std::size_t>(count) * row_bytes;
+  data_offset = header_bytes + (4 * static_cast<std::uint64_t>(count));
+  // Checked piecewise, corrupt counts must not overflow the sum.
+  if ((data_offset > size) || (n > (size / entry_bytes)) ||
+      (count && (unique > (size / frame_bytes))) ||
+      ((data_offset + (unique * frame_bytes) + (n * entry_bytes) +
+        footer_bytes) != size))
+    throw std::runtime_error{"archive incomplete"};
+
+  std::vector<std::uint8_t> buf(data_offset - header_bytes);
+  file.read_at(buf.data(), buf.size(), header_bytes);
+  for (std::size_t i{}; i < count; ++i)
+    numbers.push_back(binary::get_le<std::uint32_t>(buf.data() + (4 * i)));
+  if (!std::is_sorted(numbers.begin(), numbers.end()))
+    throw std::runtime_error{"bad archive universes"};
+
+  buf.resize(n * entry_bytes);
+  file.read_at(buf.data(), buf.size(), data_offset + (unique * frame_bytes));
+  timeline.reserve(n);
+  starts.reserve(n + 1);
+  starts.push_back(0);
+  for (std::size_t i{}; i < n; ++i) {
+    const auto *p{buf.data() + (i * entry_bytes)};
+    Entry e{binary::get_le<std::uint32_t>(p),
+            binary::get_le<std::uint32_t>(p + 4)};
+    if (e.frame >= unique) throw std::runtime_error{"bad archive timeline"};
+    timeline.push_back(e);
+    starts.push_back(starts.back() + e.duration_ms);
+  }
+}
+
+bool Reader::probe(const std::string &path) {
+  std::ifstream in{path, std::ios::binary};
+  char buf[magic_size]{};
+  return in.read(buf, sizeof(buf)) && !std::memcmp(buf, magic, magic_size);
+}
+
+std::size_t Reader::find(std::uint64_t time_ms) const {
+  // First entry starting after the time, the one before is shown.
+  auto it{std::upper_bound(starts.begin(), starts.end(), time_ms)};
+  if (it == starts.end()) return timeline.size();
+  return (it - starts.begin()) - 1;
+}
+
+void Reader::read(std::uint32_t id, std::uint8_t *out) const {
+  if (id >= unique) throw std::out_of_range{"archive frame index"};
+  file.read_at(out, frame_bytes,
+               data_offset + (static_cast<std::uint64_t>(id) * frame_bytes));
+}
+
+void Reader::read(std::uint32_t id, io::UniverseStates &sts) const {
+  std::vector<std::uint8_t> buf(frame_bytes);
+  read(id, buf.data());
+  if (sts.size() != numbers.size()) sts.clear();
+  for (std::size_t row{}; row < numbers.size(); ++row) {
+    const auto *p{buf.data() + (row * row_bytes)};
+    auto &data{sts[numbers[row]]};
+    std::copy(p, p + row_bytes, data.begin());
+  }
+}
+
+Source::Source(const Reader &reader, std::uint64_t from_ms)
+    : reader{&reader},
+      i{reader.find(from_ms)},
+      buf(reader.universes().size() * row_bytes) {}
+
+bool Source::next() {
+  if (i >= reader->entries()) return false;
+
+  const auto &e{reader->entry(i)};
+  const auto first{!loaded};
+  changed.clear();
+  if (first || (e.frame != current)) {
+    reader->read(e.frame, buf.data());
+    const auto &numbers{reader->universes()};
+    for (std::size_t row{}; row < numbers.size(); ++row) {
+      const auto *p{buf.data() + (row * row_bytes)};
+      auto &data{states[numbers[row]]};
+      if (!first && std::equal(p, p + row_bytes, data.begin())) continue;
+      std::copy(p, p + row_bytes, data.begin());
+      changed.push_back(numbers[row]);
+    }
+    current = e.frame;
+    loaded = true;
+  }
+
+  view = {&states, nullptr, first ? nullptr : &changed, reader->start_ms(i),
+          e.duration_ms};
+  ++i;
+  return true;
+}
+}  // namespace dedup
+}  // namespace olavc
@@ -0,0 +1,213 @@
+#ifndef DEDUP_HPP_INCLUDED
+#define DEDUP_HPP_INCLUDED
+
+#include <binary.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <io.hpp>
+#include <sink.hpp>
+#include <stream.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace olavc {
+namespace dedup {
+/**
+ * Step of an archive timeline.
+ */
+struct Entry {
+  /**
+   * Index of the stored frame shown.
+   */
+  std::uint32_t frame;
+  /**
+   * Duration of the step in milliseconds.
+   */
+  std::uint32_t duration_ms;
+};
+
+/**
+ * Writes frames into an archive storing each distinct frame once.
+ *
+ * An archive is made up of
+ *  - a header: the magic \c OLAVCAR1 , the number of universes and the
+ *    universe numbers, each as a little-endian \c uint32 ,
+ *  - the distinct frames, each stored uncompressed as one 512 byte row per
+ *    universe in ascending universe order,
+ *  - the timeline: one \c Entry per step, as two little-endian \c uint32 ,
+ *  - a footer: the number of distinct frames and timeline entries as
+ *    little-endian \c uint64 , followed by the magic \c OLAVCEND .
+ *
+ * Frames are identified by a hash over per-row hashes, of which only the rows
+ * of changed universes are recomputed. Frames with matching hashes are
+ * compared in full before being shared, so collisions cannot merge different
+ * frames. Consecutive steps showing the same frame are joined.
+ */
+class Writer : public FrameSink {
+ private:
+  binary::File file;
+  std::size_t universes;
+  std::size_t frame_bytes;
+  std::uint64_t data_offset{};
+  std::vector<std::uint32_t> numbers;
+  std::vector<std::uint8_t> frame;
+  std::vector<std::uint64_t> row_hashes;
+  std::vector<std::uint8_t> scratch;
+  std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> index;
+  std::vector<Entry> timeline;
+  std::uint32_t unique{0};
+  std::uint32_t last_frame{};
+  std::uint64_t last_hash{};
+  bool started{false};
+  bool closed{false};
+
+  void ensure_not_closed();
+  void start(const io::UniverseStates &sts);
+  void set_row(std::size_t row, const io::UniverseData &data);
+  std::uint32_t store();
+  void append(std::uint32_t id, std::uint64_t duration);
+
+ public:
+  /**
+   * Creates an archive.
+   *
+   * \param universes number of universes in every frame.
+   * \param path path of the archive, must be a regular file.
+   */
+  Writer(int universes, const std::string &path);
+  Writer(Writer &w) = delete;
+  Writer(Writer &&w) = delete;
+  Writer &operator=(Writer &w) = delete;
+  Writer &operator=(Writer &&w) = delete;
+  ~Writer() override;
+
+  void write_universe(const io::UniverseStates &sts,
+                      std::uint64_t duration) override;
+  void write_changed(const io::UniverseStates &sts,
+                     const std::vector<std::uint32_t> &changed,
+                     std::uint64_t duration) override;
+  void close() override;
+
+  /**
+   * \return number of distinct frames stored so far.
+   */
+  std::uint32_t unique_frames() const noexcept { return unique; }
+};
+
+/**
+ * Reads an archive written by \c Writer with random access.
+ *
+ * The timeline is loaded when opening, frames are read on demand.
+ */
+class Reader {
+ private:
+  binary::File file;
+  std::vector<std::uint32_t> numbers;
+  std::size_t frame_bytes{};
+  std::uint64_t data_offset{};
+  std::uint64_t unique{};
+  std::vector<Entry> timeline;
+  std::vector<std::uint64_t> starts;
+
+ public:
+  /**
+   * Opens an archive.
+   *
+   * \param path path of the archive.
+   * \throw std::runtime_error if the file is not a complete archive.
+   */
+  explicit Reader(const std::string &path);
+  Reader(Reader &r) = delete;
+  Reader &operator=(Reader &r) = delete;
+
+  /**
+   * \param path path of a file.
+   * \return whether the file starts like an archive.
+   */
+  static bool probe(const std::string &path);
+
+  /**
+   * \return universe numbers of each frame row, ascending.
+   */
+  const std::vector<std::uint32_t> &universes() const noexcept {
+    return numbers;
+  }
+  /**
+   * \return number of distinct frames stored.
+   */
+  std::uint64_t unique_frames() const noexcept { return unique; }
+  /**
+   * \return number of timeline entries.
+   */
+  std::size_t entries() const noexcept { return timeline.size(); }
+  /**
+   * \return timeline entry \p i .
+   */
+  const Entry &entry(std::size_t i) const { return timeline.at(i); }
+  /**
+   * \return time at which timeline entry \p i starts in milliseconds.
+   */
+  std::uint64_t start_ms(std::size_t i) const { return starts.at(i); }
+  /**
+   * \return total duration of the timeline in milliseconds.
+   */
+  std::uint64_t duration_ms() const noexcept { return starts.back(); }
+
+  /**
+   * Finds the timeline entry shown at a given time.
+   *
+   * \param time_ms time in milliseconds.
+   * \return index of the entry, \c entries() if the time is past the end.
+   */
+  std::size_t find(std::uint64_t time_ms) const;
+
+  /**
+   * Reads a stored frame.
+   *
+   * \param id index of the frame.
+   * \param out receives \c universes().size() rows of 512 bytes.
+   */
+  void read(std::uint32_t id, std::uint8_t *out) const;
+  /**
+   * Reads a stored frame.
+   *
+   * \param id index of the frame.
+   * \param sts receives the universe states.
+   */
+  void read(std::uint32_t id, io::UniverseStates &sts) const;
+};
+
+/**
+ * Streams the frames of an archive.
+ *
+ * Frames are only read when the timeline moves to a different stored frame,
+ * and only universes that differ from the previous frame are updated and
+ * reported as changed.
+ */
+class Source : public stream::Stage<Source> {
+ private:
+  const Reader *reader;
+  std::size_t i;
+  std::uint32_t current{};
+  bool loaded{false};
+  std::vector<std::uint8_t> buf;
+  io::UniverseStates states;
+  std::vector<std::uint32_t> changed;
+  stream::FrameView view;
+
+ public:
+  /**
+   * \param reader archive to read, must outlive the source.
+   * \param from_ms time to start at in milliseconds. Streaming starts with
+   *                the entry shown at that time, keeping archive times.
+   */
+  explicit Source(const Reader &reader, std::uint64_t from_ms = 0);
+
+  bool next();
+  const stream::FrameView &frame() const noexcept { return view; }
+};
+}  // namespace dedup
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,275 @@
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <edit.hpp>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+namespace olavc {
+namespace edit {
+static constexpr const AVRational millisecond{1, 1000};
+
+using DMXVideoEncoder::PacketRef;
+
+static bool same_tag(const AVDictionary *a, const AVDictionary *b,
+                     const char *key) {
+  const auto *ta{av_dict_get(a, key, nullptr, 0)};
+  const auto *tb{av_dict_get(b, key, nullptr, 0)};
+  if (!ta || !tb) return !ta && !tb;
+  return std::string_view{ta->value} == tb->value;
+}
+
+static void copy_tag(const AVDictionary *from, AVDictionary **to,
+                     const char *key) {
+  const auto *tag{av_dict_get(from, key, nullptr, 0)};
+  if (tag && (av_dict_set(to, key, tag->value, 0) < 0))
+    throw std::runtime_error{"setting metadata"};
+}
+
+Input::Input(const std::string &path) {
+  AVFormatContext *ctx{nullptr};
+  if (avformat_open_input(&ctx, path.c_str(), nullptr, nullptr) < 0)
+    throw std::runtime_error{"opening video"};
+  fmt_ctx.reset(ctx);
+
+  if (avformat_find_stream_info(ctx, nullptr) < 0)
+    throw std::runtime_error{"reading stream information"};
+  if (!ctx->nb_streams) throw std::runtime_error{"no stream to copy"};
+}
+
+std::int64_t Input::duration_ms() const noexcept {
+  if (fmt_ctx->duration == AV_NOPTS_VALUE) return -1;
+  return fmt_ctx->duration / (AV_TIME_BASE / 1000);
+}
+
+void Input::check_layout(const Input &other) const {
+  const auto *a{context()};
+  const auto *b{other.context()};
+  if (a->nb_streams != b->nb_streams)
+    throw std::runtime_error{"universe layouts differ"};
+
+  for (unsigned i{}; i < a->nb_streams; ++i) {
+    const auto *sa{a->streams[i]};
+    const auto *sb{b->streams[i]};
+    const auto *pa{sa->codecpar};
+    const auto *pb{sb->codecpar};
+    if ((pa->height != pb->height) ||
+        !same_tag(sa->metadata, sb->metadata, DMXVideoEncoder::universes_tag))
+      throw std::runtime_error{"universe layouts differ"};
+    if (pa->width != pb->width)
+      throw std::runtime_error{"channel layouts differ"};
+    // A stream has a single codec configuration for all of its packets.
+    if ((pa->codec_type != pb->codec_type) ||
+        (pa->codec_id != pb->codec_id) || (pa->format != pb->format) ||
+        (pa->extradata_size != pb->extradata_size) ||
+        (pa->extradata_size &&
+         std::memcmp(pa->extradata, pb->extradata, pa->extradata_size)))
+      throw std::runtime_error{"codec settings differ"};
+  }
+
+  if (!same_tag(a->metadata, b->metadata, DMXVideoEncoder::channels_tag) ||
+      !same_tag(a->metadata, b->metadata, DMXVideoEncoder::constants_tag))
+    throw std::runtime_error{"channel layouts differ"};
+}
+
+Output::Output(const std::string &path, const Input &layout) {
+  const auto *mkv{av_guess_format("matroska", nullptr, nullptr)};
+  if (!mkv) throw std::runtime_error{"finding MKV muxer"};
+
+  AVFormatContext *ctx;
+  if (avformat_alloc_output_context2(&ctx, mkv, nullptr, nullptr) < 0)
+    throw std::runtime_error{"allocating MKV context"};
+  fmt_ctx.reset(ctx);
+
+  const auto *src{layout.context()};
+  for (unsigned i{}; i < src->nb_streams; ++i) {
+    const auto *ist{src->streams[i]};
+    auto *st{avformat_new_stream(ctx, nullptr)};
+    if (!st) throw std::runtime_error{"allocating stream for muxer"};
+    if (avcodec_parameters_copy(st->codecpar, ist->codecpar) < 0)
+      throw std::runtime_error{"setting stream codec parameters"};
+    st->time_base = millisecond;
+    copy_tag(ist->metadata, &st->metadata, DMXVideoEncoder::universes_tag);
+  }
+  copy_tag(src->metadata, &ctx->metadata, DMXVideoEncoder::channels_tag);
+  copy_tag(src->metadata, &ctx->metadata, DMXVideoEncoder::constants_tag);
+
+  AVIOContext *io;
+  if (avio_open2(&io, path.c_str(), AVIO_FLAG_WRITE, nullptr, nullptr) < 0)
+    throw std::runtime_error{"allocating output context"};
+  io_ctx.reset(io);
+  ctx->pb = io;
+
+  if (avformat_write_header(ctx, nullptr) < 0)
+    throw std::runtime_error{"writing MKV header"};
+}
+
+Output::~Output() {
+  try {
+    close();
+  } catch (const std::exception &) {
+  }
+}
+
+void Output::ensure_not_closed() {
+  if (closed) throw std::logic_error{"closed"};
+}
+
+std::uint64_t Output::copy(Input &in, std::int64_t from_ms,
+                           std::int64_t to_ms) {
+  ensure_not_closed();
+  auto *src{in.context()};
+  if (src->nb_streams != fmt_ctx->nb_streams)
+    throw std::runtime_error{"universe layouts differ"};
+
+  from_ms = std::max<std::int64_t>(from_ms, 0);
+  if (from_ms &&
+      (av_seek_frame(src, -1, from_ms * (AV_TIME_BASE / 1000),
+                     AVSEEK_FLAG_BACKWARD) < 0))
+    throw std::runtime_error{"seeking"};
+
+  const auto offset{end};
+  std::uint64_t frames{};
+  while (true) {
+    PacketRef ref{};
+    auto &pkt{ref.pkt};
+    auto ret{av_read_frame(src, &pkt)};
+    if (ret == AVERROR_EOF) break;
+    if (ret < 0) throw std::runtime_error{"reading packet"};
+    if ((pkt.stream_index < 0) ||
+        (static_cast<unsigned>(pkt.stream_index) >= src->nb_streams))
+      continue;
+    if (pkt.pts == AV_NOPTS_VALUE)
+      throw std::runtime_error{"packet without timestamp"};
+
+    const auto *ist{src->streams[pkt.stream_index]};
+    const auto *ost{fmt_ctx->streams[pkt.stream_index]};
+    auto pts{av_rescale_q(pkt.pts, ist->time_base, millisecond)};
+    auto dur{av_rescale_q(pkt.duration, ist->time_base, millisecond)};
+
+    // Packets are interleaved in time order, so nothing later is wanted.
+    if ((to_ms >= 0) && (pts >= to_ms)) break;
+    if ((pts < from_ms) && ((pts + dur) <= from_ms)) continue;
+
+    // Every frame is a keyframe holding whole universes, so frames
+    // straddling the ends of the span are kept and shortened.
+    auto first{std::max(pts, from_ms)};
+    auto last{(to_ms >= 0) ? std::min(pts + dur, to_ms) : (pts + dur)};
+    auto out_pts{first - from_ms + offset};
+    pkt.pts = av_rescale_q(out_pts, millisecond, ost->time_base);
+    pkt.dts = pkt.pts;
+    pkt.duration = av_rescale_q(last - first, millisecond, ost->time_base);
+    pkt.pos = -1;
+
+    end = std::max(end, out_pts + (last - first));
+    bytes += pkt.size;
+    ++packets;
+    if (!pkt.stream_index) ++frames;
+
+    if (av_interleaved_write_frame(fmt_ctx.get(), &pkt) < 0)
+      throw std::runtime_error{"write packet to muxer"};
+  }
+
+  return frames;
+}
+
+void Output::close() {
+  if (closed) return;
+
+  closed = true;
+
+  if (av_write_trailer(fmt_ctx.get()))
+    throw std::runtime_error{"writing trailer"};
+
+  if (avio_close(io_ctx.release())) {
+    throw std::runtime_error{"closing output"};
+  }
+}
+
+std::uint64_t trim(const std::string &input, const std::string &output,
+                   std::int64_t from_ms, std::int64_t to_ms) {
+  Input in{input};
+  Output out{output, in};
+  auto frames{out.copy(in, from_ms, to_ms)};
+  out.close();
+  return frames;
+}
+
+std::string segment_path(const std::string &pattern, unsigned index) {
+  std::string path;
+  bool found{false};
+  for (std::size_t i{}; i < pattern.size(); ++i) {
+    if (pattern[i] != '%') {
+      path += pattern[i];
+      continue;
+    }
+    if ((i + 1 < pattern.size()) && (pattern[i + 1] == '%')) {
+      path += '%';
+      ++i;
+      continue;
+    }
+
+    auto end{pattern.find_first_not_of("0123456789", i + 1)};
+    if (found || (end == std::string::npos) || (pattern[end] != 'd'))
+      throw std::runtime_error{"bad segment pattern"};
+    auto width{(end > i + 1) ? std::stoul(pattern.substr(i + 1, end - i - 1))
+                             : 0};
+    auto number{std::to_string(index)};
+    if (number.size() < width) path.append(width - number.size(), '0');
+    path += number;
+    found = true;
+    i = end;
+  }
+  if (!found) throw std::runtime_error{"bad segment pattern"};
+
+  return path;
+}
+
+std::vector<std::string> split(const std::string &input,
+                               const std::string &pattern,
+                               std::int64_t segment_ms) {
+  if (segment_ms <= 0)
+    throw std::runtime_error{"non-positive segment length"};
+
+  Input in{input};
+  const auto duration{in.duration_ms()};
+  if (duration < 0) throw std::runtime_error{"unknown video duration"};
+
+  std::vector<std::string> paths;
+  for (std::int64_t from{}; from < duration; from += segment_ms) {
+    paths.emplace_back(
+        segment_path(pattern, static_cast<unsigned>(paths.size())));
+    Output out{paths.back(), in};
+    out.copy(in, from, from + segment_ms);
+    out.close();
+  }
+
+  return paths;
+}
+
+std::uint64_t concat(const std::vector<std::string> &inputs,
+                     const std::string &output) {
+  if (inputs.empty()) throw std::runtime_error{"no input to join"};
+
+  // Layouts are checked before the output is created.
+  Input first{inputs.front()};
+  for (auto it{std::next(inputs.begin())}; it != inputs.end(); ++it)
+    first.check_layout(Input{*it});
+
+  Output out{output, first};
+  auto frames{out.copy(first, 0)};
+  for (auto it{std::next(inputs.begin())}; it != inputs.end(); ++it) {
+    Input in{*it};
+    frames += out.copy(in, 0);
+  }
+  out.close();
+
+  return frames;
+}
+}  // namespace edit
+}  // namespace olavc
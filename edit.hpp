@@ -0,0 +1,174 @@
+#ifndef EDIT_HPP_INCLUDED
+#define EDIT_HPP_INCLUDED
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <cstdint>
+#include <decoder.hpp>
+#include <media.hpp>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace edit {
+using DMXVideoDecoder::UniqueAVInputFormatContext;
+using DMXVideoEncoder::UniqueAVFormatContext;
+using DMXVideoEncoder::UniqueAVIOContext;
+
+/**
+ * Video opened for copying its packets, without decoders.
+ */
+class Input {
+ private:
+  UniqueAVInputFormatContext fmt_ctx;
+
+ public:
+  /**
+   * Opens a video.
+   *
+   * \param path path of the video.
+   * \throw std::runtime_error if the file cannot be opened.
+   */
+  explicit Input(const std::string &path);
+  Input(Input &in) = delete;
+  Input &operator=(Input &in) = delete;
+
+  /**
+   * \return demuxer context of the video.
+   */
+  AVFormatContext *context() const noexcept { return fmt_ctx.get(); }
+
+  /**
+   * \return duration of the video in milliseconds, \c -1 if unknown.
+   */
+  std::int64_t duration_ms() const noexcept;
+
+  /**
+   * Checks that two videos hold the same universes in the same streams, with
+   * the same channel layout and codec settings, so that their packets can be
+   * placed in a single file.
+   *
+   * \param other video to compare with.
+   * \throw std::runtime_error if the layouts differ.
+   */
+  void check_layout(const Input &other) const;
+};
+
+/**
+ * MKV receiving packets copied from videos of a single layout.
+ *
+ * Packets are written without being decoded again. Since every frame of a
+ * DMX video is a keyframe, spans can start and end at any time: frames
+ * straddling the ends of a span are shortened to fit. The muxer writes
+ * fresh cues for the copied packets on close.
+ */
+class Output {
+ private:
+  UniqueAVFormatContext fmt_ctx;
+  UniqueAVIOContext io_ctx;
+  std::int64_t end{0};
+  std::uint64_t packets{0};
+  std::uint64_t bytes{0};
+  bool closed{false};
+
+  void ensure_not_closed();
+
+ public:
+  /**
+   * Creates an MKV with the streams and tags of a video.
+   *
+   * \param path path of the output file.
+   * \param layout video whose streams, universes and channel layout are
+   *               copied.
+   */
+  Output(const std::string &path, const Input &layout);
+  Output(Output &out) = delete;
+  Output(Output &&out) = delete;
+  Output &operator=(Output &out) = delete;
+  Output &operator=(Output &&out) = delete;
+  ~Output();
+
+  /**
+   * Appends a span of a video to the output.
+   *
+   * \param in video to copy from, must have the layout of the output.
+   * \param from_ms start of the span in \p in .
+   * \param to_ms end of the span in \p in , \c -1 for the end of the video.
+   * \return number of frames copied.
+   * \throw std::runtime_error if the layouts differ.
+   */
+  std::uint64_t copy(Input &in, std::int64_t from_ms, std::int64_t to_ms = -1);
+
+  /**
+   * \return duration written so far in milliseconds.
+   */
+  std::int64_t duration_ms() const noexcept { return end; }
+  /**
+   * \return number of packets written so far.
+   */
+  std::uint64_t packets_written() const noexcept { return packets; }
+  /**
+   * \return number of compressed bytes written so far.
+   */
+  std::uint64_t bytes_written() const noexcept { return bytes; }
+
+  /**
+   * Writes the cues and trailer and closes the file.
+   */
+  void close();
+};
+
+/**
+ * Copies a span of a video into a new file.
+ *
+ * \param input path of the video.
+ * \param output path of the new file.
+ * \param from_ms start of the span.
+ * \param to_ms end of the span, \c -1 for the end of the video.
+ * \return number of frames copied.
+ */
+std::uint64_t trim(const std::string &input, const std::string &output,
+                   std::int64_t from_ms, std::int64_t to_ms = -1);
+
+/**
+ * Formats the path of a segment.
+ *
+ * \param pattern path holding a single \c %d conversion, optionally with a
+ *                zero-padded width such as \c %03d , and \c %% for a
+ *                literal percent sign.
+ * \param index segment number.
+ * \return path of the segment.
+ * \throw std::runtime_error if the pattern is malformed.
+ */
+std::string segment_path(const std::string &pattern, unsigned index);
+
+/**
+ * Splits a video into segments of equal length.
+ *
+ * \param input path of the video.
+ * \param pattern pattern of the segment paths, see \c segment_path() .
+ * \param segment_ms length of each segment, the last may be shorter.
+ * \return paths of the segments written.
+ * \throw std::runtime_error if the duration of the video is unknown.
+ */
+std::vector<std::string> split(const std::string &input,
+                               const std::string &pattern,
+                               std::int64_t segment_ms);
+
+/**
+ * Joins videos of the same layout, one after the other.
+ *
+ * \param inputs paths of the videos, in order.
+ * \param output path of the joined file.
+ * \return number of frames copied.
+ * \throw std::runtime_error if the layouts of the videos differ.
+ */
+std::uint64_t concat(const std::vector<std::string> &inputs,
+                     const std::string &output);
+}  // namespace edit
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <cstring>
+#include <eventlog.hpp>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace olavc {
+namespace eventlog {
+static constexpr const char magic[]{"OLAVCEL1"};
+static constexpr const char end_magic[]{"OLAVCELE"};
+static constexpr const std::size_t magic_size{sizeof(magic) - 1};
+static constexpr const std::size_t header_bytes{magic_size + 4};
+static constexpr const std::size_t footer_bytes{16 + magic_size};
+static constexpr const std::size_t event_header_bytes{12};
+static constexpr const std::size_t track_header_bytes{8};
+static constexpr const std::size_t block_entry_bytes{24};
+static constexpr const std::size_t row_bytes{
+    std::tuple_size_v<io::UniverseData>};
+
+/**
+ * Size at which a block is written even if the snapshot interval is not
+ * reached, bounding the memory buffered per universe.
+ */
+static constexpr const std::size_t max_block_bytes{64 << 10};
+
+bool next_event(const std::vector<std::uint8_t> &block, std::size_t &pos,
+                Event &e) {
+  if (pos == block.size()) return false;
+  if ((block.size() - pos) < event_header_bytes)
+    throw std::runtime_error{"bad event log block"};
+
+  const auto *p{block.data() + pos};
+  e.time_ms = binary::get_le<std::uint64_t>(p);
+  e.first = binary::get_le<std::uint16_t>(p + 8);
+  e.count = binary::get_le<std::uint16_t>(p + 10);
+  e.data = p + event_header_bytes;
+  if (((e.first + e.count) > row_bytes) ||
+      ((block.size() - pos - event_header_bytes) < e.count))
+    throw std::runtime_error{"bad event log block"};
+
+  pos += event_header_bytes + e.count;
+  return true;
+}
+
+static const std::string &log_path(const std::string &path) {
+  // Blocks are written at known offsets, so pipes cannot be used.
+  if (path == "-") throw std::runtime_error{"event log output must be a file"};
+  return path;
+}
+
+Writer::Writer(int universes, const std::string &path,
+               std::uint32_t snapshot_interval)
+    : file{log_path(path), true},
+      universes{static_cast<std::size_t>(std::max(universes, 0))},
+      interval{snapshot_interval},
+      end{header_bytes} {
+  if (universes <= 0) throw std::runtime_error{"non-positive universe count"};
+  if (!interval) throw std::runtime_error{"zero snapshot interval"};
+
+  std::vector<std::uint8_t> header(magic, magic + magic_size);
+  binary::put_le(header, interval);
+  file.write_at(header.data(), header.size(), 0);
+}
+
+Writer::~Writer() {
+  try {
+    close();
+  } catch (const std::exception &) {
+  }
+}
+
+void Writer::ensure_not_closed() {
+  if (closed) throw std::logic_error{"closed"};
+}
+
+void Writer::start(const io::UniverseStates &sts) {
+  if (sts.size() != universes)
+    throw std::runtime_error{"universe state(s) undefined at encode"};
+
+  pending.resize(universes);
+  std::size_t i{};
+  for (const auto &st : sts) pending[i++].track.universe = st.first;
+  started = true;
+}
+
+Writer::Pending &Writer::find(std::uint32_t u) {
+  auto it{std::lower_bound(
+      pending.begin(), pending.end(), u,
+      [](const Pending &p, std::uint32_t u) { return p.track.universe < u; })};
+  if ((it == pending.end()) || (it->track.universe != u))
+    throw std::runtime_error{"universes changed between frames"};
+  return *it;
+}
+
+void Writer::record(Pending &p, const io::UniverseData &data) {
+  const auto initial{p.track.blocks.empty() && p.block.empty()};
+  if (!initial && (data == p.last)) return;
+
+  std::size_t first{0};
+  std::size_t last{row_bytes};
+  // Blocks start with a snapshot, later events hold the changed span.
+  if (p.block.size()) {
+    while (data[first] == p.last[first]) ++first;
+    while (data[last - 1] == p.last[last - 1]) --last;
+  } else {
+    p.time_ms = time_ms;
+  }
+
+  binary::put_le(p.block, time_ms);
+  binary::put_le<std::uint16_t>(p.block, first);
+  binary::put_le<std::uint16_t>(p.block, last - first);
+  p.block.insert(p.block.end(), data.begin() + first, data.begin() + last);
+  p.last = data;
+
+  if ((++p.events >= interval) || (p.block.size() >= max_block_bytes))
+    flush(p);
+}
+
+void Writer::flush(Pending &p) {
+  if (p.block.empty()) return;
+
+  file.write_at(p.block.data(), p.block.size(), end);
+  p.track.blocks.push_back({end, p.time_ms,
+                            static_cast<std::uint32_t>(p.block.size()),
+                            p.events});
+  end += p.block.size();
+  p.block.clear();
+  p.events = 0;
+}
+
+void Writer::write_universe(const io::UniverseStates &sts,
+                            std::uint64_t duration) {
+  ensure_not_closed();
+  if (!started) start(sts);
+  if (sts.size() != universes)
+    throw std::runtime_error{"universe state(s) undefined at encode"};
+
+  std::size_t i{};
+  for (const auto &st : sts) {
+    auto &p{pending[i++]};
+    if (st.first != p.track.universe)
+      throw std::runtime_error{"universes changed between frames"};
+    record(p, st.second);
+  }
+  time_ms += duration;
+}
+
+void Writer::write_changed(const io::UniverseStates &sts,
+                           const std::vector<std::uint32_t> &changed,
+                           std::uint64_t duration) {
+  ensure_not_closed();
+  if (!started) return write_universe(sts, duration);
+  if (sts.size() != universes)
+    throw std::runtime_error{"universe state(s) undefined at encode"};
+
+  for (auto u : changed) record(find(u), sts.at(u));
+  time_ms += duration;
+}
+
+void Writer::close() {
+  if (closed) return;
+
+  closed = true;
+  for (auto &p : pending) flush(p);
+
+  std::vector<std::uint8_t> tail;
+  binary::put_le<std::uint32_t>(tail, pending.size());
+  for (const auto &p : pending) {
+    binary::put_le(tail, p.track.universe);
+    binary::put_le<std::uint32_t>(tail, p.track.blocks.size());
+    for (const auto &b : p.track.blocks) {
+      binary::put_le(tail, b.offset);
+      binary::put_le(tail, b.time_ms);
+      binary::put_le(tail, b.bytes);
+      binary::put_le(tail, b.events);
+    }
+  }
+  binary::put_le(tail, end);
+  binary::put_le(tail, time_ms);
+  tail.insert(tail.end(), end_magic, end_magic + magic_size);
+  file.write_at(tail.data(), tail.size(), end);
+  file.close();
+}
+
+Reader::Reader(const std::string &path) : file{path, false} {
+  const auto size{file.size()};
+  if (size < (header_bytes + footer_bytes))
+    throw std::runtime_error{"not an event log"};
+
+  std::uint8_t header[header_bytes];
+  file.read_at(header, sizeof(header), 0);
+  if (std::memcmp(header, magic, magic_size))
+    throw std::runtime_error{"not an event log"};
+
+  std::uint8_t footer[footer_bytes];
+  file.read_at(footer, sizeof(footer), size - footer_bytes);
+  if (std::memcmp(footer + 16, end_magic, magic_size))
+    throw std::runtime_error{"event log incomplete"};
+  const auto index_offset{binary::get_le<std::uint64_t>(footer)};
+  duration = binary::get_le<std::uint64_t>(footer + 8);
+  if ((index_offset < header_bytes) || (index_offset > (size - footer_bytes)))
+    throw std::runtime_error{"event log incomplete"};
+
+  std::vector<std::uint8_t> buf(size - footer_bytes - index_offset);
+  file.read_at(buf.data(), buf.size(), index_offset);
+  std::size_t pos{};
+  auto need = [&buf, &pos](std::size_t n) {
+    if ((buf.size() - pos) < n) throw std::runtime_error{"bad event log index"};
+    const auto *p{buf.data() + pos};
+    pos += n;
+    return p;
+  };
+
+  const auto count{binary::get_le<std::uint32_t>(need(4))};
+  for (std::uint32_t i{}; i < count; ++i) {
+    const auto *p{need(track_header_bytes)};
+    Track t{binary::get_le<std::uint32_t>(p), {}};
+    const auto blocks{binary::get_le<std::uint32_t>(p + 4)};
+    if (index.size() && (index.back().universe >= t.universe))
+      throw std::runtime_error{"bad event log index"};
+
+    for (std::uint32_t k{}; k < blocks; ++k) {
+      p = need(block_entry_bytes);
+      Block b{binary::get_le<std::uint64_t>(p),
+              binary::get_le<std::uint64_t>(p + 8),
+              binary::get_le<std::uint32_t>(p + 16),
+              binary::get_le<std::uint32_t>(p + 20)};
+      if ((b.offset < header_bytes) || (b.offset > index_offset) ||
+          (b.bytes > (index_offset - b.offset)) ||
+          (t.blocks.size() && (t.blocks.back().time_ms > b.time_ms)))
+        throw std::runtime_error{"bad event log index"};
+      t.blocks.push_back(b);
+    }
+    index.emplace_back(std::move(t));
+  }
+}
+
+bool Reader::probe(const std::string &path) {
+  std::ifstream in{path, std::ios::binary};
+  char buf[magic_size]{};
+  return in.read(buf, sizeof(buf)) && !std::memcmp(buf, magic, magic_size);
+}
+
+std::vector<std::uint32_t> Reader::universes() const {
+  std::vector<std::uint32_t> us;
+  for (const auto &t : index) us.push_back(t.universe);
+  return us;
+}
+
+const Track &Reader::track(std::uint32_t u) const {
+  auto it{std::lower_bound(
+      index.begin(), index.end(), u,
+      [](const Track &t, std::uint32_t u) { return t.universe < u; })};
+  if ((it == index.end()) || (it->universe != u))
+    throw std::runtime_error{"universe " + std::to_string(u) +
+                             " not in event log"};
+  return *it;
+}
+
+std::size_t Reader::find_block(const Track &t, std::uint64_t time_ms) {
+  auto it{std::upper_bound(
+      t.blocks.begin(), t.blocks.end(), time_ms,
+      [](std::uint64_t time, const Block &b) { return time < b.time_ms; })};
+  return (it == t.blocks.begin()) ? 0 : ((it - t.blocks.begin()) - 1);
+}
+
+void Reader::read(const Block &b, std::vector<std::uint8_t> &out) const {
+  out.resize(b.bytes);
+  file.read_at(out.data(), out.size(), b.offset);
+}
+
+void Reader::state_at(std::uint32_t u, std::uint64_t time_ms,
+                      io::UniverseData &data) const {
+  const auto &t{track(u)};
+  data = {};
+  if (t.blocks.empty()) return;
+
+  std::vector<std::uint8_t> buf;
+  read(t.blocks[find_block(t, time_ms)], buf);
+  std::size_t pos{};
+  Event e;
+  // The snapshot opening the block applies even to earlier times.
+  for (bool first{true}; next_event(buf, pos, e); first = false) {
+    if (!first && (e.time_ms > time_ms)) break;
+    e.apply(data);
+  }
+}
+
+Source::Source(const Reader &reader, const std::set<std::uint32_t> &universes,
+               std::uint64_t from_ms)
+    : reader{&reader}, time_ms{from_ms} {
+  for (auto u : universes) reader.track(u);
+  for (const auto &t : reader.tracks()) {
+    if (universes.size() && !universes.count(t.universe)) continue;
+    cursors.push_back({&t, Reader::find_block(t, from_ms), {}});
+  }
+
+  for (auto &c : cursors) {
+    auto &data{states[c.track->universe]};
+    if (c.track->blocks.empty()) continue;
+
+    reader.read(c.track->blocks[c.block], c.buf);
+    advance(c);
+    if (c.live) {
+      c.next.apply(data);
+      advance(c);
+    }
+    while (c.live && (c.next.time_ms <= from_ms)) {
+      c.next.apply(data);
+      advance(c);
+    }
+  }
+}
+
+void Source::advance(Cursor &c) {
+  c.live = next_event(c.buf, c.pos, c.next);
+  while (!c.live && ((c.block + 1) < c.track->blocks.size())) {
+    reader->read(c.track->blocks[++c.block], c.buf);
+    c.pos = 0;
+    c.live = next_event(c.buf, c.pos, c.next);
+  }
+}
+
+std::uint64_t Source::next_time() const noexcept {
+  auto t{reader->duration_ms()};
+  for (const auto &c : cursors) {
+    if (c.live) t = std::min(t, c.next.time_ms);
+  }
+  return std::max(t, time_ms);
+}
+
+bool Source::next() {
+  if (first) {
+    first = false;
+    if (cursors.empty() || (time_ms >= reader->duration_ms())) return false;
+    view = {&states, nullptr, nullptr, time_ms, next_time() - time_ms};
+    return true;
+  }
+
+  const auto t{next_time()};
+  if (t >= reader->duration_ms()) return false;
+
+  time_ms = t;
+  changed.clear();
+  for (auto &c : cursors) {
+    if (!c.live || (c.next.time_ms != t)) continue;
+    auto &data{states[c.track->universe]};
+    while (c.live && (c.next.time_ms == t)) {
+      c.next.apply(data);
+      advance(c);
+    }
+    changed.push_back(c.track->universe);
+  }
+
+  view = {&states, nullptr, &changed, time_ms, next_time() - time_ms};
+  return true;
+}
+}  // namespace eventlog
+}  // namespace olavc
@@ -0,0 +1,293 @@
+#ifndef EVENTLOG_HPP_INCLUDED
+#define EVENTLOG_HPP_INCLUDED
+
+#include <algorithm>
+#include <binary.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <io.hpp>
+#include <set>
+#include <sink.hpp>
+#include <stream.hpp>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace eventlog {
+/**
+ * Default maximum number of events between snapshots of a universe.
+ */
+static constexpr const std::uint32_t default_snapshot_interval{256};
+
+/**
+ * Run of events of one universe, starting with a snapshot.
+ */
+struct Block {
+  /**
+   * Byte offset of the block in the log.
+   */
+  std::uint64_t offset;
+  /**
+   * Time of the first event of the block in milliseconds.
+   */
+  std::uint64_t time_ms;
+  /**
+   * Size of the block in bytes.
+   */
+  std::uint32_t bytes;
+  /**
+   * Number of events in the block.
+   */
+  std::uint32_t events;
+};
+
+/**
+ * Blocks of one universe, in time order.
+ */
+struct Track {
+  std::uint32_t universe;
+  std::vector<Block> blocks;
+};
+
+/**
+ * Change of the channels of one universe.
+ *
+ * The first event of a block holds all 512 channels.
+ */
+struct Event {
+  /**
+   * Time of the change in milliseconds.
+   */
+  std::uint64_t time_ms;
+  /**
+   * First channel changed.
+   */
+  std::uint16_t first;
+  /**
+   * Number of consecutive channels stored from \c first .
+   */
+  std::uint16_t count;
+  /**
+   * New values of the stored channels, borrowed from the block.
+   */
+  const std::uint8_t *data;
+
+  /**
+   * Applies the change to a universe state.
+   */
+  void apply(io::UniverseData &d) const noexcept {
+    std::copy(data, data + count, d.begin() + first);
+  }
+};
+
+/**
+ * Decodes the next event of a block.
+ *
+ * \param block bytes of the block.
+ * \param pos offset of the event in \p block , advanced past it.
+ * \param e receives the event.
+ * \return whether an event was left in the block.
+ * \throw std::runtime_error if the event is malformed.
+ */
+bool next_event(const std::vector<std::uint8_t> &block, std::size_t &pos,
+                Event &e);
+
+/**
+ * Writes frames as a per-universe change log.
+ *
+ * A log is made up of
+ *  - a header: the magic \c OLAVCEL1 and the snapshot interval as a
+ *    little-endian \c uint32 ,
+ *  - blocks of events, each holding the changes of a single universe,
+ *  - an index listing the blocks of each universe, see \c Reader ,
+ *  - a footer: the offset of the index and the duration of the log as
+ *    little-endian \c uint64 , followed by the magic \c OLAVCELE .
+ *
+ * Events are stored as a little-endian \c uint64 time, \c uint16 first
+ * channel and \c uint16 count, followed by the channel values. An event is
+ * written only when a universe changes, holding the span between the first
+ * and last channel changed. Each block starts with a snapshot of all 512
+ * channels, so the state of a universe at any time can be restored from a
+ * single block.
+ *
+ * Events are buffered per universe until a block is full, so the blocks of
+ * different universes are interleaved in the log.
+ */
+class Writer : public FrameSink {
+ private:
+  struct Pending {
+    Track track;
+    io::UniverseData last;
+    std::vector<std::uint8_t> block;
+    std::uint32_t events{0};
+    std::uint64_t time_ms{0};
+  };
+
+  binary::File file;
+  std::size_t universes;
+  std::uint32_t interval;
+  std::uint64_t end;
+  std::vector<Pending> pending;
+  std::uint64_t time_ms{0};
+  bool started{false};
+  bool closed{false};
+
+  void ensure_not_closed();
+  void start(const io::UniverseStates &sts);
+  Pending &find(std::uint32_t u);
+  void record(Pending &p, const io::UniverseData &data);
+  void flush(Pending &p);
+
+ public:
+  /**
+   * Creates a log.
+   *
+   * \param universes number of universes in every frame.
+   * \param path path of the log, must be a regular file.
+   * \param snapshot_interval maximum number of events between snapshots of
+   *                          a universe, must be non-zero.
+   */
+  Writer(int universes, const std::string &path,
+         std::uint32_t snapshot_interval = default_snapshot_interval);
+  Writer(Writer &w) = delete;
+  Writer(Writer &&w) = delete;
+  Writer &operator=(Writer &w) = delete;
+  Writer &operator=(Writer &&w) = delete;
+  ~Writer() override;
+
+  void write_universe(const io::UniverseStates &sts,
+                      std::uint64_t duration) override;
+  void write_changed(const io::UniverseStates &sts,
+                     const std::vector<std::uint32_t> &changed,
+                     std::uint64_t duration) override;
+  void close() override;
+};
+
+/**
+ * Reads a log written by \c Writer .
+ *
+ * The index is loaded when opening, blocks are read on demand. The index
+ * holds, for each universe, its blocks in time order as
+ * a little-endian \c uint32 universe number and block count followed by
+ * each block's \c uint64 offset and time and \c uint32 size and event
+ * count. It starts with the number of universes as a \c uint32 .
+ */
+class Reader {
+ private:
+  binary::File file;
+  std::vector<Track> index;
+  std::uint64_t duration{};
+
+ public:
+  /**
+   * Opens a log.
+   *
+   * \param path path of the log.
+   * \throw std::runtime_error if the file is not a complete log.
+   */
+  explicit Reader(const std::string &path);
+  Reader(Reader &r) = delete;
+  Reader &operator=(Reader &r) = delete;
+
+  /**
+   * \param path path of a file.
+   * \return whether the file starts like a log.
+   */
+  static bool probe(const std::string &path);
+
+  /**
+   * \return blocks of each universe, in ascending universe order.
+   */
+  const std::vector<Track> &tracks() const noexcept { return index; }
+  /**
+   * \return universe numbers, ascending.
+   */
+  std::vector<std::uint32_t> universes() const;
+  /**
+   * \return duration of the log in milliseconds.
+   */
+  std::uint64_t duration_ms() const noexcept { return duration; }
+
+  /**
+   * \param u universe number.
+   * \return track of universe \p u .
+   * \throw std::runtime_error if the universe is not in the log.
+   */
+  const Track &track(std::uint32_t u) const;
+  /**
+   * Finds the block holding the state of a universe at a given time.
+   *
+   * \return index of the last block starting no later than \p time_ms , \c 0
+   *         if there is none.
+   */
+  static std::size_t find_block(const Track &t, std::uint64_t time_ms);
+  /**
+   * Reads a block.
+   *
+   * \param b block to read.
+   * \param out receives the bytes of the block.
+   */
+  void read(const Block &b, std::vector<std::uint8_t> &out) const;
+
+  /**
+   * Restores the state of a universe without reading other universes.
+   *
+   * Takes a binary search over the universe's blocks and a single block
+   * read.
+   *
+   * \param u universe number.
+   * \param time_ms time in milliseconds.
+   * \param data receives the state of \p u at \p time_ms .
+   * \throw std::runtime_error if the universe is not in the log.
+   */
+  void state_at(std::uint32_t u, std::uint64_t time_ms,
+                io::UniverseData &data) const;
+};
+
+/**
+ * Streams the frames of a log.
+ *
+ * A frame is produced at each time at which a streamed universe changes.
+ * Blocks of universes that are not streamed are never read.
+ */
+class Source : public stream::Stage<Source> {
+ private:
+  struct Cursor {
+    const Track *track;
+    std::size_t block;
+    std::vector<std::uint8_t> buf;
+    std::size_t pos{0};
+    Event next{};
+    bool live{false};
+  };
+
+  const Reader *reader;
+  std::uint64_t time_ms;
+  std::vector<Cursor> cursors;
+  io::UniverseStates states;
+  std::vector<std::uint32_t> changed;
+  bool first{true};
+  stream::FrameView view;
+
+  void advance(Cursor &c);
+  std::uint64_t next_time() const noexcept;
+
+ public:
+  /**
+   * \param reader log to read, must outlive the source.
+   * \param universes universes to stream, empty for all.
+   * \param from_ms time to start at in milliseconds. The first frame holds
+   *                the states at that time, keeping log times.
+   * \throw std::runtime_error if a universe is not in the log.
+   */
+  explicit Source(const Reader &reader,
+                  const std::set<std::uint32_t> &universes = {},
+                  std::uint64_t from_ms = 0);
+
+  bool next();
+  const stream::FrameView &frame() const noexcept { return view; }
+};
+}  // namespace eventlog
+}  // namespace olavc
+
+#endif
@@ -10,9 +10,13 @@
 #include <limits>
 #include <locale>
 #include <map>
+#include <set>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace olavc {
 namespace io {
@@ -61,6 +65,13 @@ struct OLAFrame {
    * Data contained within the frame.
    */
   UniverseData data;
+  /**
+   * Whether the channel text of the frame is identical to that of the
+   * previous frame read for the same universe.
+   *
+   * Only set by readers given a \c LineCache .
+   */
+  bool unchanged;
 
   OLAFrame() { clear(); }
 
@@ -72,9 +83,52 @@ struct OLAFrame {
     data.fill(0);
     duration_ms = 0;
     universe = 0;
+    unchanged = false;
   }
 };
 
+/**
+ * Shape of the channel text of showfile lines.
+ */
+enum class ChannelFormat {
+  /**
+   * Not known yet.
+   */
+  unknown,
+  /**
+   * Values of one to three digits.
+   */
+  variable,
+  /**
+   * Values always written with three digits, e.g. \c 000,255 .
+   */
+  fixed_width,
+};
+
+/**
+ * Last channel text and data read for each universe of a showfile.
+ *
+ * Recorders often repeat a universe line with identical values, which
+ * \c read_frame() can then copy instead of parsing again.
+ */
+struct LineCache {
+  struct Entry {
+    std::string text;
+    UniverseData data;
+  };
+
+  std::unordered_map<std::uint32_t, Entry> last;
+  /**
+   * Channel text of the line kept by the frame being read, entered once the
+   * frame is complete, as later lines of a frame replace earlier ones.
+   */
+  std::string pending;
+  /**
+   * Channel format detected from the first universe line.
+   */
+  ChannelFormat format{ChannelFormat::unknown};
+};
+
 /**
  * Writes a line (a single universe worth of data) to a buffer.
  *
@@ -106,6 +160,147 @@ inline static void write_lines(uint8_t *l, size_t stride,
   }
 }
 
+/**
+ * Writes a contiguous run of universe states to a buffer.
+ *
+ * \param l buffer to write to.
+ * \param stride number of bytes actually allocated for each line.
+ * \param first first universe state to write.
+ * \param last universe state past the last one to write.
+ */
+template <typename It>
+inline static void write_lines(uint8_t *l, size_t stride, It first,
+                               It last) noexcept {
+  for (; first != last; ++first) {
+    write_line(l, first->first, first->second);
+    l += stride;
+  }
+}
+
+/**
+ * Reads the universe number of a line written by \c write_line() .
+ *
+ * \param l line to read.
+ * \return universe number.
+ */
+inline static std::uint32_t read_line_universe(const uint8_t *l) noexcept {
+  return l[0] | (static_cast<std::uint32_t>(l[1]) << 8);
+}
+
+/**
+ * Mapping between DMX channels and the columns of a frame.
+ *
+ * Frames normally hold all 512 channels of each universe. Rigs that patch
+ * only part of each universe can store just the channels that vary; the
+ * others hold a fixed value per universe, recorded here.
+ */
+struct ChannelLayout {
+  /**
+   * Channels stored as frame columns, in ascending order. Empty if every
+   * channel is stored.
+   */
+  std::vector<std::uint16_t> channels;
+  /**
+   * Values of the channels not stored, for universes where any of them is
+   * non-zero.
+   */
+  std::map<std::uint32_t, UniverseData> constants;
+
+  /**
+   * \return whether every channel is stored.
+   */
+  bool full() const noexcept { return channels.empty(); }
+
+  /**
+   * \return whether the stored channels are the first \c n channels.
+   */
+  bool prefix() const noexcept {
+    return full() || ((channels.back() + 1u) == channels.size());
+  }
+
+  /**
+   * \return frame width in bytes.
+   */
+  int width() const noexcept {
+    return 2 + static_cast<int>(full() ? std::tuple_size_v<UniverseData>
+                                       : channels.size());
+  }
+};
+
+/**
+ * Writes a line holding only the channels stored by a layout.
+ *
+ * \param l buffer to write to.
+ * \param universe universe data is meant for.
+ * \param data universe channel data.
+ * \param layout channels to store.
+ */
+inline static void write_line(uint8_t *l, std::uint32_t universe,
+                              const UniverseData &data,
+                              const ChannelLayout &layout) noexcept {
+  if (layout.full()) {
+    write_line(l, universe, data);
+    return;
+  }
+
+  l[0] = universe & static_cast<uint32_t>(0xff);
+  l[1] = (universe & static_cast<uint32_t>(0xff00)) >> 8;
+  l += 2;
+  if (layout.prefix()) {
+    std::copy_n(data.begin(), layout.channels.size(), l);
+    return;
+  }
+  for (auto c : layout.channels) *l++ = data[c];
+}
+
+/**
+ * Writes a contiguous run of universe states to a buffer, storing only the
+ * channels of a layout.
+ *
+ * \param l buffer to write to.
+ * \param stride number of bytes actually allocated for each line.
+ * \param first first universe state to write.
+ * \param last universe state past the last one to write.
+ * \param layout channels to store.
+ */
+template <typename It>
+inline static void write_lines(uint8_t *l, size_t stride, It first, It last,
+                               const ChannelLayout &layout) noexcept {
+  for (; first != last; ++first) {
+    write_line(l, first->first, first->second, layout);
+    l += stride;
+  }
+}
+
+/**
+ * Restores all channels of a universe from a line written with a layout.
+ *
+ * \param l line to read.
+ * \param layout channels stored in the line.
+ * \param data receives the channel data.
+ */
+inline static void read_line(const uint8_t *l, const ChannelLayout &layout,
+                             UniverseData &data) noexcept {
+  const auto universe{read_line_universe(l)};
+  l += 2;
+  if (layout.full()) {
+    std::copy_n(l, data.size(), data.begin());
+    return;
+  }
+
+  auto it{layout.constants.find(universe)};
+  if (it == layout.constants.end())
+    data.fill(0);
+  else
+    data = it->second;
+
+  if (layout.prefix()) {
+    std::copy_n(l, layout.channels.size(), data.begin());
+    return;
+  }
+  for (auto c : layout.channels) data[c] = *l++;
+}
+
 inline static auto trim(std::string_view s) {
   static const auto &loc_c{std::locale::classic()};
   auto not_space = [](char c) { return !std::isspace(c, loc_c); };
@@ -122,13 +317,12 @@ inline static auto split_char(std::string_view s, char c) {
   using rtype = std::pair<std::string_view, std::string_view>;
   auto bpos{s.find(c)};
   if (bpos == std::string_view::npos)
-    return rtype{s, std::string_view{s.end()}};
+    return rtype{s, s.substr(s.size())};
 
   bpos = s.find_first_not_of(c, bpos);
   if (bpos == std::string_view::npos) bpos = s.size();
 
-  return rtype{std::string_view{s.begin(), bpos},
-               std::string_view{s.begin() + bpos}};
+  return rtype{s.substr(0, bpos), s.substr(bpos)};
 }
 
 inline static void ParseChans(std::string_view s, UniverseData &d) {
@@ -164,6 +358,275 @@ inline static void ParseChans(std::string_view s, UniverseData &d) {
   }
 }
 
+/**
+ * Parses channel text of a known shape.
+ *
+ * Only accepts well-formed text: values of up to 255 separated by single
+ * commas, at most 512 of them. Anything else is left to \c ParseChans() ,
+ * which reports errors and accepts the quirkier lines it always has.
+ *
+ * \tparam Format shape of the text, \c ChannelFormat::variable or
+ *                \c ChannelFormat::fixed_width .
+ * \param s channel text.
+ * \param d receives the channel data, unspecified on failure.
+ * \return whether the text had the expected shape.
+ */
+template <ChannelFormat Format>
+inline static bool ParseChansAs(std::string_view s, UniverseData &d) noexcept;
+
+template <>
+inline bool ParseChansAs<ChannelFormat::fixed_width>(
+    std::string_view s, UniverseData &d) noexcept {
+  // "ddd" followed by ",ddd" for each further channel.
+  if (((s.size() % 4) != 3) || (s.size() >= (4 * d.size()))) return false;
+
+  const auto n{(s.size() + 1) / 4};
+  const auto *p{s.data()};
+  bool bad{false};
+  for (std::size_t c{}; c < n; ++c, p += 4) {
+    auto h{static_cast<unsigned>(p[0] - '0')};
+    auto t{static_cast<unsigned>(p[1] - '0')};
+    auto o{static_cast<unsigned>(p[2] - '0')};
+    auto v{(h * 100) + (t * 10) + o};
+    bad |= (h > 9) | (t > 9) | (o > 9) | (v > 255);
+    bad |= ((c + 1) < n) && (p[3] != ',');
+    d[c] = static_cast<UniverseData::value_type>(v);
+  }
+  std::fill(d.begin() + n, d.end(), 0);
+
+  return !bad;
+}
+
+template <>
+inline bool ParseChansAs<ChannelFormat::variable>(std::string_view s,
+                                                 UniverseData &d) noexcept {
+  const auto *p{s.data()};
+  const auto *end{p + s.size()};
+  std::size_t c{};
+  while (true) {
+    unsigned v{};
+    const auto *first{p};
+    for (; (p != end) && (static_cast<unsigned>(*p - '0') <= 9); ++p)
+      v = (v * 10) + static_cast<unsigned>(*p - '0');
+    if ((p == first) || ((p - first) > 3) || (v > 255) || (c == d.size()))
+      return false;
+    d[c++] = static_cast<UniverseData::value_type>(v);
+
+    if (p == end) break;
+    if (*p++ != ',') return false;
+  }
+  std::fill(d.begin() + c, d.end(), 0);
+
+  return true;
+}
+
+/**
+ * Parses channel text with the kernel for its detected shape, falling back
+ * to the general parser for lines that deviate from it.
+ *
+ * \param s channel text.
+ * \param d receives the channel data.
+ * \param format channel format, detected from \p s if still unknown.
+ */
+inline static void ParseChans(std::string_view s, UniverseData &d,
+                              ChannelFormat &format) {
+  if (format == ChannelFormat::unknown) {
+    format = ParseChansAs<ChannelFormat::fixed_width>(s, d)
+                 ? ChannelFormat::fixed_width
+                 : ChannelFormat::variable;
+    if (format == ChannelFormat::fixed_width) return;
+  }
+
+  if ((format == ChannelFormat::fixed_width) &&
+      ParseChansAs<ChannelFormat::fixed_width>(s, d))
+    return;
+  if (ParseChansAs<ChannelFormat::variable>(s, d)) return;
+  ParseChans(s, d);
+}
+
+/**
+ * Formats universe or channel numbers as a compact list.
+ *
+ * Consecutive numbers are collapsed into inclusive ranges and items are
+ * joined by \c + , e.g. \c 0-15+32 .
+ *
+ * \param numbers numbers in ascending order.
+ * \return formatted list.
+ */
+template <typename Container>
+inline static std::string format_range_list(const Container &numbers) {
+  std::string out;
+  auto it{std::begin(numbers)};
+  while (it != std::end(numbers)) {
+    std::uint32_t first{*it};
+    auto last{first};
+    for (++it; (it != std::end(numbers)) && (*it == (last + 1)); ++it)
+      last = *it;
+
+    if (out.size()) out += '+';
+    out += std::to_string(first);
+    if (last != first) out += '-' + std::to_string(last);
+  }
+
+  return out;
+}
+
+/**
+ * Largest number of items \c parse_range_list() accepts by default, well
+ * above the universe count of any rig.
+ */
+static constexpr const std::size_t max_range_list_items{1 << 16};
+
+/**
+ * Parses a list written by \c format_range_list() .
+ *
+ * \param s list to parse.
+ * \param max_items largest number of items the list may hold.
+ * \return numbers in the list.
+ * \throw std::runtime_error if the list is malformed or holds more than
+ *        \p max_items numbers.
+ */
+inline static std::set<std::uint32_t> parse_range_list(
+    std::string_view s, std::size_t max_items = max_range_list_items) {
+  auto number = [](std::string_view n) {
+    std::uint32_t v{};
+    auto rslt{std::from_chars(n.data(), n.data() + n.size(), v)};
+    if ((rslt.ec != std::errc{}) || (rslt.ptr != (n.data() + n.size())))
+      throw std::runtime_error{"bad number in list"};
+    return v;
+  };
+
+  std::set<std::uint32_t> numbers;
+  while (s.size()) {
+    auto item{s.substr(0, s.find('+'))};
+    s.remove_prefix(std::min(s.size(), item.size() + 1));
+
+    auto dash{item.find('-')};
+    auto first{number(item.substr(0, dash))};
+    auto last{first};
+    if (dash != std::string_view::npos) last = number(item.substr(dash + 1));
+    if (last < first) throw std::runtime_error{"bad range in list"};
+    if ((last - first) >= max_items)
+      throw std::runtime_error{"too many numbers in list"};
+
+    for (auto n{first};; ++n) {
+      numbers.insert(n);
+      if (n == last) break;
+    }
+    if (numbers.size() > max_items)
+      throw std::runtime_error{"too many numbers in list"};
+  }
+
+  return numbers;
+}
+
+/**
+ * Lists the channels a layout does not store.
+ *
+ * \param layout channel layout.
+ * \return channels missing from \c layout.channels , in ascending order.
+ */
+inline static std::vector<std::uint16_t> elided_channels(
+    const ChannelLayout &layout) {
+  std::vector<std::uint16_t> elided;
+  if (layout.full()) return elided;
+
+  auto kept{layout.channels.begin()};
+  for (std::uint16_t c{}; c < std::tuple_size_v<UniverseData>; ++c) {
+    if ((kept != layout.channels.end()) && (*kept == c))
+      ++kept;
+    else
+      elided.push_back(c);
+  }
+  return elided;
+}
+
+/**
+ * Formats the constant channel values of a layout.
+ *
+ * Each universe is written as \c UNIVERSE:HEX , where \c HEX holds the
+ * values of the elided channels in ascending channel order with trailing
+ * zeros dropped. Universes are joined by \c ; .
+ *
+ * \param layout channel layout.
+ * \return formatted values.
+ */
+inline static std::string format_constants(const ChannelLayout &layout) {
+  static constexpr const char digits[]{"0123456789abcdef"};
+  const auto elided{elided_channels(layout)};
+
+  std::string out;
+  for (const auto &[universe, data] : layout.constants) {
+    auto end{elided.size()};
+    while (end && !data[elided[end - 1]]) --end;
+    if (!end) continue;
+
+    if (out.size()) out += ';';
+    out += std::to_string(universe);
+    out += ':';
+    for (std::size_t i{}; i < end; ++i) {
+      out += digits[data[elided[i]] >> 4];
+      out += digits[data[elided[i]] & 0xf];
+    }
+  }
+  return out;
+}
+
+/**
+ * Parses values written by \c format_constants() into a layout.
+ *
+ * \param s values to parse.
+ * \param layout layout to update, whose channels must already be set.
+ */
+inline static void parse_constants(std::string_view s, ChannelLayout &layout) {
+  auto nibble = [](char c) {
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    throw std::runtime_error{"bad constant channel value"};
+  };
+  const auto elided{elided_channels(layout)};
+
+  while (s.size()) {
+    auto item{s.substr(0, s.find(';'))};
+    s.remove_prefix(std::min(s.size(), item.size() + 1));
+
+    auto colon{item.find(':')};
+    if (colon == std::string_view::npos)
+      throw std::runtime_error{"bad constant channel list"};
+    auto universes{parse_range_list(item.substr(0, colon))};
+    auto hex{item.substr(colon + 1)};
+    if ((universes.size() != 1) || (hex.size() % 2) ||
+        ((hex.size() / 2) > elided.size()))
+      throw std::runtime_error{"bad constant channel list"};
+
+    auto &data{layout.constants[*universes.begin()]};
+    data.fill(0);
+    for (std::size_t i{}; i < (hex.size() / 2); ++i)
+      data[elided[i]] = (nibble(hex[2 * i]) << 4) | nibble(hex[(2 * i) + 1]);
+  }
+}
+
+/**
+ * Writes a showfile line holding a universe's channel data.
+ *
+ * \param s stream to write to.
+ * \param universe universe number.
+ * \param data channel data.
+ */
+inline static void write_chans(std::ostream &s, std::uint32_t universe,
+                               const UniverseData &data) {
+  // Longest line: 10 digit universe, space, 512 * "255,".
+  char buf[10 + 1 + (4 * 512)];
+  auto *p{std::to_chars(buf, buf + sizeof(buf), universe).ptr};
+  *p++ = ' ';
+  for (std::size_t c{}; c < data.size(); ++c) {
+    if (c) *p++ = ',';
+    p = std::to_chars(p, buf + sizeof(buf), data[c]).ptr;
+  }
+  *p++ = '\n';
+  s.write(buf, p - buf);
+}
+
 /**
  * Reads frames from an OLA recorder showfile.
  *
@@ -171,11 +634,14 @@ inline static void ParseChans(std::string_view s, UniverseData &d) {
  *
  * \param s character input stream to read from.
  * \param f frame to write to.
+ * \param cache if not null, channel text last read for each universe. Lines
+ *              repeating it are not parsed again, and \c f.unchanged is set.
  * \return \c s.
  *
  * \note Not a fully compliant reader: accepts header at non-0 position.
  */
-static std::istream &read_frame(std::istream &s, OLAFrame &f) {
+inline static std::istream &read_frame(std::istream &s, OLAFrame &f,
+                                       LineCache *cache = nullptr) {
   thread_local std::string buf{};
   bool readdata{false};
 
@@ -186,7 +652,13 @@ static std::istream &read_frame(std::istream &s, OLAFrame &f) {
       break;
     }
 
-    const auto bufv{trim(buf)};
+    // Lines usually start and end with a digit once any CR is dropped, and
+    // then need no trimming.
+    std::string_view bufv{buf};
+    if (bufv.size() && (bufv.back() == '\r')) bufv.remove_suffix(1);
+    auto is_digit = [](char c) { return (c >= '0') && (c <= '9'); };
+    if (!bufv.size() || !is_digit(bufv.front()) || !is_digit(bufv.back()))
+      bufv = trim(bufv);
     if ((bufv == show_header) || !bufv.size()) continue;
 
     auto segs{split_char(bufv, ' ')};
@@ -204,8 +676,27 @@ static std::istream &read_frame(std::istream &s, OLAFrame &f) {
     }
 
     f.universe = val;
-    ParseChans(segs.second, f.data);
     readdata = true;
+    if (!cache) {
+      ParseChans(segs.second, f.data);
+      continue;
+    }
+
+    auto it{cache->last.find(val)};
+    f.unchanged = (it != cache->last.end()) && (it->second.text == segs.second);
+    if (f.unchanged) {
+      f.data = it->second.data;
+      continue;
+    }
+
+    ParseChans(segs.second, f.data, cache->format);
+    cache->pending.assign(segs.second);
+  }
+
+  if (cache && readdata && !f.unchanged) {
+    auto &e{cache->last[f.universe]};
+    e.text.swap(cache->pending);
+    e.data = f.data;
   }
 
   return s;
@@ -3,9 +3,13 @@ extern "C" {
 #include <libavformat/avformat.h>
 }
 
+#include <algorithm>
+#include <functional>
 #include <io.hpp>
+#include <iterator>
 #include <media.hpp>
 #include <stdexcept>
+#include <vector>
 
 namespace olavc {
 namespace DMXVideoEncoder {
@@ -16,35 +20,82 @@ static bool operator!=(const AVRational &r1, const AVRational &r2) {
   return (r1.num != r2.num) || (r1.den != r2.den);
 }
 
-static UniqueAVCodecContext init_ffv1_context(int universes) {
-  auto *ffv1 = avcodec_find_encoder_by_name("ffv1");
-  if (!ffv1) throw std::runtime_error{"finding FFV1 encoder"};
-
-  auto *ffv1_ctx = avcodec_alloc_context3(nullptr);
-  if (!ffv1_ctx) throw std::runtime_error{"allocating encoder context"};
-
+/**
+ * Smallest rig for which FFV1 slice threading is enabled.
+ *
+ * Slices split the frame into a grid, so very short frames do not leave
+ * enough rows for each slice.
+ */
+static constexpr const auto min_threaded_universes{16};
+
+/**
+ * Codec and muxer lookups and the fixed encoder options.
+ *
+ * Resolved once per process and shared read-only by every encoder, so
+ * long-running processes converting many files do not repeat them per file.
+ */
+struct EncoderSetup {
+  const AVCodec *ffv1{avcodec_find_encoder_by_name("ffv1")};
+  const AVOutputFormat *mkv{av_guess_format("matroska", nullptr, nullptr)};
   AVDictionary *options{nullptr};
-  try {
+  bool options_ok{true};
+
+  EncoderSetup() {
     // GOP size fixed to 1. Changing it between 1 -> 30 doesn't change
     // resulting filesize significantly and may increase chance of
     // corruption.
     // Compressing output file with XZ leads to significantly
     // more space savings.
-    if (av_dict_set(&options, "g", "1", 0) < 0)
-      throw std::runtime_error{"setting encoder options"};
+    options_ok &= (av_dict_set(&options, "g", "1", 0) >= 0);
 
     // Turned off to try and improve compatability.
-    if (av_dict_set(&options, "slicecrc", "0", 0) < 0)
-      throw std::runtime_error{"setting encoder options"};
+    options_ok &= (av_dict_set(&options, "slicecrc", "0", 0) >= 0);
+  }
+  EncoderSetup(EncoderSetup &s) = delete;
+  EncoderSetup &operator=(EncoderSetup &s) = delete;
+  ~EncoderSetup() { av_dict_free(&options); }
+};
+
+static const EncoderSetup &encoder_setup() {
+  static const EncoderSetup setup{};
+  return setup;
+}
+
+static UniqueAVCodecContext init_codec_context(int universes,
+                                               const EncoderOptions &opts) {
+  const auto &setup{encoder_setup()};
+  const auto is_ffv1{opts.codec == "ffv1"};
+  const auto *codec{is_ffv1 ? setup.ffv1
+                            : avcodec_find_encoder_by_name(opts.codec.c_str())};
+  if (!codec) throw std::runtime_error{"finding encoder " + opts.codec};
+  if (!setup.options_ok) throw std::runtime_error{"setting encoder options"};
+  const auto threads{opts.threads};
 
-    ffv1_ctx->framerate = AVRational{0, 1};
-    ffv1_ctx->pix_fmt = image_format;
-    ffv1_ctx->time_base = millisecond;
-    ffv1_ctx->width = io::frame_width;
-    ffv1_ctx->height = universes;
-    ffv1_ctx->sample_aspect_ratio = AVRational{1, 1};
+  auto *codec_ctx = avcodec_alloc_context3(nullptr);
+  if (!codec_ctx) throw std::runtime_error{"allocating encoder context"};
+
+  AVDictionary *options{nullptr};
+  try {
+    if (av_dict_copy(&options, setup.options, 0) < 0)
+      throw std::runtime_error{"setting encoder options"};
 
-    if (avcodec_open2(ffv1_ctx, ffv1, &options) < 0)
+    // FFV1 only threads across slices, which need a version 3 bitstream.
+    // Stick with the default single-slice stream otherwise.
+    if ((threads > 1) && (!is_ffv1 || (universes >= min_threaded_universes))) {
+      if (is_ffv1 && (av_dict_set(&options, "level", "3", 0) < 0))
+        throw std::runtime_error{"setting encoder options"};
+      if (av_dict_set_int(&options, "threads", threads, 0) < 0)
+        throw std::runtime_error{"setting encoder options"};
+    }
+
+    codec_ctx->framerate = AVRational{0, 1};
+    codec_ctx->pix_fmt = image_format;
+    codec_ctx->time_base = millisecond;
+    codec_ctx->width = opts.layout.width();
+    codec_ctx->height = universes;
+    codec_ctx->sample_aspect_ratio = AVRational{1, 1};
+
+    if (avcodec_open2(codec_ctx, codec, &options) < 0)
       throw std::runtime_error{"could not open encoder"};
 
     // Ugly "finally"-like construct here because av_dict_* functions may free
@@ -56,11 +107,11 @@ static UniqueAVCodecContext init_ffv1_context(int universes) {
   }
   av_dict_free(&options);
 
-  return UniqueAVCodecContext{ffv1_ctx};
+  return UniqueAVCodecContext{codec_ctx};
 }
 
 static UniqueAVFormatContext init_mkv_context() {
-  auto fmt = av_guess_format("matroska", nullptr, nullptr);
+  auto fmt = encoder_setup().mkv;
   if (!fmt) throw std::runtime_error{"finding MKV muxer"};
 
   AVFormatContext *ctx;
@@ -93,39 +144,94 @@ static UniqueAVFrame init_frame(AVCodecContext *cctx) {
   return UniqueAVFrame{v_frame};
 }
 
-DMXVideoEncoder::DMXVideoEncoder(int universes, const std::string &path)
-    : enc_ctx{init_ffv1_context(universes)},
-      fmt_ctx{init_mkv_context()},
-      io_ctx{init_output_context(path)},
-      fbuf{init_frame(enc_ctx.get())} {
-  fmt_ctx->pb = io_ctx.get();
+DMXVideoEncoder::DMXVideoEncoder(int universes, const std::string &path,
+                                 const EncoderOptions &opts)
+    : fmt_ctx{init_mkv_context()}, io_ctx{init_output_context(path)} {
+  if (universes <= 0) throw std::runtime_error{"non-positive universe count"};
+  const auto &chans{opts.layout.channels};
+  if ((std::adjacent_find(chans.begin(), chans.end(), std::greater_equal{}) !=
+       chans.end()) ||
+      (chans.size() && (chans.back() >= std::tuple_size_v<io::UniverseData>)))
+    throw std::runtime_error{"bad channel layout"};
 
-  s = avformat_new_stream(fmt_ctx.get(), enc_ctx->codec);
-  if (!s) throw std::runtime_error{"allocating stream for muxer"};
-  if (avcodec_parameters_from_context(s->codecpar, enc_ctx.get()) < 0)
-    throw std::runtime_error{"setting stream codec parameters"};
-  s->time_base = enc_ctx->time_base;
+  fmt_ctx->pb = io_ctx.get();
 
-  if (avformat_write_header(fmt_ctx.get(), nullptr) < 0)
-    throw std::runtime_error{"writing MKV header"};
-  if (s->time_base != enc_ctx->time_base)
-    throw std::runtime_error{"using millisecond time base for stream"};
+  const auto group{(opts.group_size > 0) ? std::min(opts.group_size, universes)
+                                         : universes};
+  for (int first{}; first < universes; first += group) {
+    Track t{};
+    t.rows = std::min(group, universes - first);
+    t.enc_ctx = init_codec_context(t.rows, opts);
+    t.fbuf = init_frame(t.enc_ctx.get());
+
+    t.s = avformat_new_stream(fmt_ctx.get(), t.enc_ctx->codec);
+    if (!t.s) throw std::runtime_error{"allocating stream for muxer"};
+    if (avcodec_parameters_from_context(t.s->codecpar, t.enc_ctx.get()) < 0)
+      throw std::runtime_error{"setting stream codec parameters"};
+    t.s->time_base = t.enc_ctx->time_base;
+
+    tracks.emplace_back(std::move(t));
+  }
+  layout = opts.layout;
+  rows = universes;
 }
 
-DMXVideoEncoder::~DMXVideoEncoder() { close(); }
+DMXVideoEncoder::~DMXVideoEncoder() {
+  try {
+    close();
+  } catch (const std::exception &) {
+  }
+}
 
 void DMXVideoEncoder::ensure_not_closed() {
   if (closed) throw std::logic_error{"closed"};
 }
 
-void DMXVideoEncoder::write_frame(std::uint64_t duration, bool flush) {
-  if (avcodec_send_frame(enc_ctx.get(), flush ? nullptr : fbuf.get()) < 0)
+void DMXVideoEncoder::write_header(const io::UniverseStates &sts) {
+  // The universes held by each stream are only known once the first frame
+  // arrives, so the header is written then.
+  auto it{sts.begin()};
+  for (auto &t : tracks) {
+    std::vector<std::uint32_t> universes;
+    for (int r{}; (r < t.rows) && (it != sts.end()); ++r, ++it)
+      universes.push_back(it->first);
+
+    if (universes.size() &&
+        (av_dict_set(&t.s->metadata, universes_tag,
+                     io::format_range_list(universes).c_str(), 0) < 0))
+      throw std::runtime_error{"setting stream metadata"};
+  }
+
+  if (!layout.full()) {
+    if (av_dict_set(&fmt_ctx->metadata, channels_tag,
+                    io::format_range_list(layout.channels).c_str(), 0) < 0)
+      throw std::runtime_error{"setting file metadata"};
+    auto constants{io::format_constants(layout)};
+    if (constants.size() &&
+        (av_dict_set(&fmt_ctx->metadata, constants_tag, constants.c_str(),
+                     0) < 0))
+      throw std::runtime_error{"setting file metadata"};
+  }
+
+  if (avformat_write_header(fmt_ctx.get(), nullptr) < 0)
+    throw std::runtime_error{"writing MKV header"};
+  for (const auto &t : tracks) {
+    if (t.s->time_base != t.enc_ctx->time_base)
+      throw std::runtime_error{"using millisecond time base for stream"};
+  }
+
+  header_written = true;
+}
+
+void DMXVideoEncoder::write_frame(Track &t, std::uint64_t duration,
+                                  bool flush) {
+  if (avcodec_send_frame(t.enc_ctx.get(), flush ? nullptr : t.fbuf.get()) < 0)
     throw std::runtime_error{"sending to encoder"};
 
   AVPacket pkt{};
   int ret;
-  while (!(ret = avcodec_receive_packet(enc_ctx.get(), &pkt))) {
-    pkt.stream_index = s->index;
+  while (!(ret = avcodec_receive_packet(t.enc_ctx.get(), &pkt))) {
+    pkt.stream_index = t.s->index;
     if (!flush) pkt.duration = duration;
 
     if (av_interleaved_write_frame(fmt_ctx.get(), &pkt) < 0)
@@ -137,26 +243,65 @@ void DMXVideoEncoder::write_frame(std::uint64_t duration, bool flush) {
     throw std::runtime_error{"receive packet from encoder"};
 }
 
-void DMXVideoEncoder::write_universe(const io::UniverseStates &sts,
-                                     std::uint64_t duration) {
+void DMXVideoEncoder::write_rows(const io::UniverseStates &sts,
+                                 const std::vector<std::uint32_t> *changed,
+                                 std::uint64_t duration) {
   ensure_not_closed();
+  if (sts.size() != static_cast<std::size_t>(rows))
+    throw std::runtime_error{"universe count differs from encoder"};
+  // Frame buffers hold no rows before the first frame.
+  if (!header_written) {
+    write_header(sts);
+    changed = nullptr;
+  }
 
-  // Copy frame data if encoder is still referencing it.
-  if (av_frame_make_writable(fbuf.get()) < 0)
-    throw std::runtime_error{"write to allocated frame"};
-
-  io::write_lines(fbuf->data[0], fbuf->linesize[0], sts);
-  fbuf->pts = next_pts;
-  write_frame(duration);
+  auto it{sts.begin()};
+  std::vector<std::uint32_t>::const_iterator c;
+  if (changed) c = changed->begin();
+  for (auto &t : tracks) {
+    // Copy frame data if encoder is still referencing it. The copy keeps the
+    // rows of the previous frame.
+    if (av_frame_make_writable(t.fbuf.get()) < 0)
+      throw std::runtime_error{"write to allocated frame"};
+
+    auto last{std::next(it, t.rows)};
+    if (!changed) {
+      io::write_lines(t.fbuf->data[0], t.fbuf->linesize[0], it, last, layout);
+      it = last;
+    } else {
+      auto *l{t.fbuf->data[0]};
+      for (; it != last; ++it, l += t.fbuf->linesize[0]) {
+        while ((c != changed->end()) && (*c < it->first)) ++c;
+        if ((c != changed->end()) && (*c == it->first))
+          io::write_line(l, it->first, it->second, layout);
+      }
+    }
+
+    t.fbuf->pts = next_pts;
+    write_frame(t, duration);
+  }
   next_pts += duration;
 }
 
+void DMXVideoEncoder::write_universe(const io::UniverseStates &sts,
+                                     std::uint64_t duration) {
+  write_rows(sts, nullptr, duration);
+}
+
+void DMXVideoEncoder::write_changed(const io::UniverseStates &sts,
+                                    const std::vector<std::uint32_t> &changed,
+                                    std::uint64_t duration) {
+  write_rows(sts, &changed, duration);
+}
+
 void DMXVideoEncoder::close() {
   if (closed) return;
 
   closed = true;
 
-  write_frame(0, true);
+  if (!header_written) write_header({});
+
+  for (auto &t : tracks) write_frame(t, 0, true);
 
   if (av_write_trailer(fmt_ctx.get()))
     throw std::runtime_error{"writing trailer"};
@@ -9,7 +9,10 @@ extern "C" {
 #include <cstdint>
 #include <io.hpp>
 #include <memory>
+#include <sink.hpp>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 namespace olavc {
 namespace DMXVideoEncoder {
@@ -40,29 +43,126 @@ using UniqueAVFormatContext =
 
 using UniqueAVFrame = UniqueCDeleterPPtr<AVFrame, av_frame_free>;
 
-class DMXVideoEncoder {
+/**
+ * Packet unreferenced on scope exit.
+ */
+struct PacketRef {
+  AVPacket pkt{};
+
+  PacketRef() = default;
+  PacketRef(PacketRef &p) = delete;
+  PacketRef &operator=(PacketRef &p) = delete;
+  ~PacketRef() { av_packet_unref(&pkt); }
+};
+
+/**
+ * Encoder settings.
+ */
+struct EncoderOptions {
+  /**
+   * Name of the libavcodec encoder.
+   *
+   * The encoder must accept GRAY8 frames, and must be lossless for the output
+   * to be played back as DMX.
+   */
+  std::string codec{"ffv1"};
+  /**
+   * Number of encoder threads, \c 1 disables threading.
+   */
+  int threads{1};
+  /**
+   * Number of universes per video stream, \c 0 to keep all of them in a
+   * single stream.
+   *
+   * Each group is encoded as an independent stream tagged with the universes
+   * it holds, so that players can decode only the groups they need.
+   */
+  int group_size{0};
+  /**
+   * Channels stored in each frame line, all of them by default.
+   *
+   * Narrower layouts are recorded in the file tags named by \c channels_tag
+   * and \c constants_tag , from which \c DMXVideoDecoder restores the
+   * elided channels.
+   */
+  io::ChannelLayout layout;
+};
+
+/**
+ * Name of the stream tag listing the universes held by a stream.
+ *
+ * The list is formatted by \c io::format_range_list() .
+ */
+static constexpr const char *universes_tag{"DMX_UNIVERSES"};
+
+/**
+ * Name of the file tag listing the channels stored in each frame line.
+ *
+ * The list is formatted by \c io::format_range_list() . Files without it
+ * store all channels.
+ */
+static constexpr const char *channels_tag{"DMX_CHANNELS"};
+
+/**
+ * Name of the file tag holding the values of channels not stored in the
+ * frames, formatted by \c io::format_constants() .
+ */
+static constexpr const char *constants_tag{"DMX_CONSTANTS"};
+
+class DMXVideoEncoder : public FrameSink {
  private:
-  UniqueAVCodecContext enc_ctx;
+  /**
+   * Encoder and stream for one group of universes.
+   */
+  struct Track {
+    UniqueAVCodecContext enc_ctx;
+    UniqueAVFrame fbuf;
+    AVStream *s;
+    int rows;
+  };
+
   UniqueAVFormatContext fmt_ctx;
   UniqueAVIOContext io_ctx;
-  UniqueAVFrame fbuf;
-  AVStream *s;
+  std::vector<Track> tracks;
+  io::ChannelLayout layout;
+  int rows;
+  bool header_written{false};
   bool closed{false};
   std::uint64_t next_pts{0};
 
   void ensure_not_closed();
-  void write_frame(std::uint64_t duration, bool flush = false);
+  void write_header(const io::UniverseStates &sts);
+  void write_frame(Track &t, std::uint64_t duration, bool flush = false);
+  void write_rows(const io::UniverseStates &sts,
+                  const std::vector<std::uint32_t> *changed,
+                  std::uint64_t duration);
 
  public:
-  DMXVideoEncoder(int universes, const std::string &path);
+  /**
+   * Opens an encoder writing to a new MKV file.
+   *
+   * \param universes number of universes (frame height).
+   * \param path path of the output file.
+   * \param opts encoder settings.
+   */
+  DMXVideoEncoder(int universes, const std::string &path,
+                  const EncoderOptions &opts = {});
   DMXVideoEncoder(DMXVideoEncoder &enc) = delete;
   DMXVideoEncoder(DMXVideoEncoder &&enc) = delete;
   DMXVideoEncoder &operator=(DMXVideoEncoder &enc) = delete;
   DMXVideoEncoder &operator=(DMXVideoEncoder &&enc) = delete;
-  ~DMXVideoEncoder();
-
-  void write_universe(const io::UniverseStates &sts, uint64_t duration);
-  void close();
+  ~DMXVideoEncoder() override;
+
+  void write_universe(const io::UniverseStates &sts,
+                      std::uint64_t duration) override;
+  /**
+   * Rewrites only the rows of changed universes, keeping the other rows of
+   * the previous frame.
+   */
+  void write_changed(const io::UniverseStates &sts,
+                     const std::vector<std::uint32_t> &changed,
+                     std::uint64_t duration) override;
+  void close() override;
 };
 }  // namespace DMXVideoEncoder
 }  // namespace olavc
@@ -0,0 +1,98 @@
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <memory.hpp>
+#include <stdexcept>
+#include <string_view>
+
+namespace olavc {
+namespace memory {
+namespace {
+std::atomic<std::uint64_t> allocated{0};
+std::atomic<std::uint64_t> freed{0};
+
+/**
+ * Reads a field of \c /proc/self/status in kilobytes.
+ */
+std::uint64_t status_kb(std::string_view key) {
+  std::ifstream status{"/proc/self/status"};
+  for (std::string k; status >> k;) {
+    if (k == key) {
+      std::uint64_t kb{};
+      status >> kb;
+      return kb;
+    }
+    status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+}
+
+double mib(std::uint64_t bytes) noexcept {
+  return static_cast<double>(bytes) / (1 << 20);
+}
+
+}  // namespace
+
+std::uint64_t rss_bytes() { return status_kb("VmRSS:") * 1024; }
+
+std::uint64_t peak_rss_bytes() {
+  if (auto kb{status_kb("VmHWM:")}) return kb * 1024;
+  rusage ru{};
+  if (getrusage(RUSAGE_SELF, &ru)) return 0;
+  return static_cast<std::uint64_t>(ru.ru_maxrss) * 1024;
+}
+
+std::uint64_t heap_bytes() noexcept {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  auto mi{mallinfo2()};
+#else
+  auto mi{mallinfo()};
+#endif
+  return static_cast<std::uint64_t>(mi.uordblks) +
+         static_cast<std::uint64_t>(mi.hblkhd);
+}
+
+std::uint64_t allocations() noexcept {
+  return allocated.load(std::memory_order_relaxed);
+}
+
+std::uint64_t deallocations() noexcept {
+  return freed.load(std::memory_order_relaxed);
+}
+
+void count_allocation() noexcept {
+  allocated.fetch_add(1, std::memory_order_relaxed);
+}
+
+void count_deallocation() noexcept {
+  freed.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::uint64_t available(std::uint64_t limit_mib) {
+  auto limit{limit_mib << 20};
+  auto used{rss_bytes()};
+  if (used >= limit)
+    throw std::runtime_error{"memory limit below memory already in use"};
+  return limit - used;
+}
+
+void write_report(std::ostream &s, const std::vector<Component> &components) {
+  auto heap{heap_bytes()};
+  std::uint64_t held{};
+  for (const auto &c : components) held += c.bytes;
+
+  s << "Peak resident memory: " << mib(peak_rss_bytes()) << " MiB" << '\n'
+    << "Resident memory: " << mib(rss_bytes()) << " MiB" << '\n'
+    << "Heap: " << mib(heap) << " MiB" << '\n';
+  for (const auto &c : components)
+    s << "  " << c.name << ": " << mib(c.bytes) << " MiB" << '\n';
+  s << "  libav and other: " << mib((heap > held) ? (heap - held) : 0)
+    << " MiB" << '\n'
+    << "Allocations: " << allocations() << " (" << deallocations()
+    << " freed)" << '\n';
+}
+}  // namespace memory
+}  // namespace olavc
@@ -0,0 +1,94 @@
+#ifndef MEMORY_HPP_INCLUDED
+#define MEMORY_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <io.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace memory {
+/**
+ * Memory held by one universe of \c io::UniverseStates , including the map
+ * node and allocator overhead.
+ */
+constexpr const std::size_t state_bytes{sizeof(io::UniverseData) + 64};
+
+/**
+ * Memory held by an open libav codec context, beyond its frame buffers.
+ */
+constexpr const std::size_t codec_context_bytes{1 << 20};
+
+/**
+ * Memory held by one universe of an \c io::LineCache , whose channel text
+ * takes up to four characters per channel.
+ */
+constexpr const std::size_t line_cache_bytes{
+    (5 * sizeof(io::UniverseData)) + 96};
+
+/**
+ * \return resident memory of the process in bytes, \c 0 if unknown.
+ */
+std::uint64_t rss_bytes();
+
+/**
+ * \return largest resident memory of the process so far in bytes, \c 0 if
+ *         unknown.
+ */
+std::uint64_t peak_rss_bytes();
+
+/**
+ * \return memory allocated from the heap by the process in bytes, including
+ *         allocations by libav.
+ */
+std::uint64_t heap_bytes() noexcept;
+
+/**
+ * \return number of C++ allocations and deallocations made by the process so
+ *         far. libav allocates through its own allocator and is not counted.
+ *         Only executables linking \c counting_new.cpp count allocations,
+ *         others report \c 0 .
+ */
+std::uint64_t allocations() noexcept;
+std::uint64_t deallocations() noexcept;
+
+/**
+ * Counts an allocation or deallocation, called by the global
+ * \c operator new and \c operator delete of \c counting_new.cpp .
+ */
+void count_allocation() noexcept;
+void count_deallocation() noexcept;
+
+/**
+ * Converts a memory limit into the memory left for buffers.
+ *
+ * \param limit_mib memory the process may use in mebibytes.
+ * \return \p limit_mib less the memory already in use, in bytes.
+ * \throw std::runtime_error if the process already uses more.
+ */
+std::uint64_t available(std::uint64_t limit_mib);
+
+/**
+ * Memory held by a part of a converter or player.
+ */
+struct Component {
+  std::string name;
+  std::uint64_t bytes{};
+};
+
+/**
+ * Writes a report of the memory used by the process.
+ *
+ * Heap memory not held by any of \p components is reported as held by libav
+ * and other internals.
+ *
+ * \param s stream to write to.
+ * \param components memory held by parts of the process.
+ */
+void write_report(std::ostream &s, const std::vector<Component> &components);
+}  // namespace memory
+}  // namespace olavc
+
+#endif
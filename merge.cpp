@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <array>
+#include <decoder.hpp>
+#include <dedup.hpp>
+#include <eventlog.hpp>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <merge.hpp>
+#include <prescan.hpp>
+#include <stdexcept>
+#include <utility>
+
+namespace olavc {
+namespace merge {
+namespace {
+/**
+ * Stage reading from a file or reader it owns.
+ *
+ * The owned object lives on the heap, so the stage can be moved while the
+ * wrapped stage keeps referring to it.
+ */
+template <typename Owned, typename Src>
+class Owning : public stream::Stage<Owning<Owned, Src>> {
+ private:
+  std::unique_ptr<Owned> owned;
+  Src src;
+
+ public:
+  template <typename... Args>
+  explicit Owning(std::unique_ptr<Owned> owned, Args &&...args)
+      : owned{std::move(owned)},
+        src{*this->owned, std::forward<Args>(args)...} {}
+
+  bool next() { return src.next(); }
+  const stream::FrameView &frame() const noexcept { return src.frame(); }
+};
+
+/**
+ * Decodes the frames of a video.
+ */
+class VideoSource : public stream::Stage<VideoSource> {
+ private:
+  std::unique_ptr<DMXVideoDecoder::DMXVideoDecoder> decoder;
+  io::UniverseStates states;
+  stream::FrameView view;
+
+ public:
+  explicit VideoSource(std::unique_ptr<DMXVideoDecoder::DMXVideoDecoder> dec)
+      : decoder{std::move(dec)} {}
+
+  bool next() {
+    std::int64_t pts, duration;
+    if (!decoder->read(states, pts, duration)) return false;
+
+    // Every row of a video frame is decoded again.
+    view = {&states, nullptr, nullptr,
+            static_cast<std::uint64_t>(std::max<std::int64_t>(pts, 0)),
+            static_cast<std::uint64_t>(std::max<std::int64_t>(duration, 0))};
+    return true;
+  }
+
+  const stream::FrameView &frame() const noexcept { return view; }
+};
+}  // namespace
+
+/**
+ * \return whether the file starts like a Matroska file.
+ */
+static bool is_video(const std::string &path) {
+  static constexpr const std::array<char, 4> ebml{'\x1a', '\x45', '\xdf',
+                                                  '\xa3'};
+  std::array<char, 4> magic{};
+  std::ifstream in{path, std::ios::binary};
+  return in.read(magic.data(), magic.size()) && (magic == ebml);
+}
+
+Input open(const std::string &path, std::uint64_t last_duration,
+           int threads) {
+  Input in{};
+  in.path = path;
+
+  if (eventlog::Reader::probe(path)) {
+    auto log{std::make_unique<eventlog::Reader>(path)};
+    auto universes{log->universes()};
+    in.universes.insert(universes.begin(), universes.end());
+    in.frames = Owning<eventlog::Reader, eventlog::Source>{std::move(log)};
+  } else if (dedup::Reader::probe(path)) {
+    auto archive{std::make_unique<dedup::Reader>(path)};
+    const auto &universes{archive->universes()};
+    in.universes.insert(universes.begin(), universes.end());
+    in.frames = Owning<dedup::Reader, dedup::Source>{std::move(archive)};
+  } else if (is_video(path)) {
+    DMXVideoDecoder::DecoderOptions opts{};
+    opts.threads = threads;
+    auto decoder{
+        std::make_unique<DMXVideoDecoder::DMXVideoDecoder>(path, opts)};
+    in.universes = decoder->universes();
+    if (in.universes.empty()) {
+      io::UniverseStates sts;
+      std::int64_t pts, duration;
+      decoder->read(sts, pts, duration);
+      for (const auto &s : sts) in.universes.insert(s.first);
+      decoder->seek(0);
+    }
+    in.frames = VideoSource{std::move(decoder)};
+  } else {
+    auto summary{prescan::run(path)};
+    auto universes{prescan::check(summary, 0)};
+    in.universes = std::move(summary.universes);
+
+    auto show{std::make_unique<std::ifstream>(path)};
+    if (!*show) throw std::runtime_error{"could not open showfile"};
+    in.frames = Owning<std::ifstream, stream::ShowSource>{
+        std::move(show), universes, last_duration};
+  }
+
+  return in;
+}
+
+std::size_t check(const std::vector<Input> &inputs) {
+  std::map<std::uint32_t, const std::string *> owner;
+  for (const auto &in : inputs) {
+    for (auto u : in.universes) {
+      auto [it, inserted]{owner.try_emplace(u, &in.path)};
+      if (!inserted) {
+        throw std::runtime_error{"universe " + std::to_string(u) +
+                                 " in both " + *it->second + " and " +
+                                 in.path};
+      }
+    }
+  }
+
+  return owner.size();
+}
+
+stream::MergeAll<stream::AnySource> merge(std::vector<Input> inputs) {
+  std::vector<stream::AnySource> srcs;
+  srcs.reserve(inputs.size());
+  for (auto &in : inputs) srcs.emplace_back(std::move(in.frames));
+
+  return stream::merge_all(std::move(srcs));
+}
+}  // namespace merge
+}  // namespace olavc
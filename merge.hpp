@@ -0,0 +1,73 @@
+#ifndef MERGE_HPP_INCLUDED
+#define MERGE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <stream.hpp>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace merge {
+/**
+ * Recording opened for merging.
+ */
+struct Input {
+  /**
+   * Path of the recording.
+   */
+  std::string path;
+  /**
+   * Universes held by the recording, empty if unknown.
+   */
+  std::set<std::uint32_t> universes;
+  /**
+   * Frames of the recording.
+   */
+  stream::AnySource frames;
+};
+
+/**
+ * Opens a showfile, video, frame archive or event log as a stream.
+ *
+ * The kind of recording is found from the start of the file. Showfiles are
+ * pre-scanned to find their universes, see \c prescan::run() . Videos list
+ * their universes in their stream tags; the first frame of files encoded
+ * before those tags existed is decoded to find them.
+ *
+ * \param path path of the recording.
+ * \param last_duration duration of the last frame of showfiles that do not
+ *                      give one.
+ * \param threads number of decoder threads per video stream.
+ * \return opened recording, read as it is merged.
+ * \throw std::runtime_error if the recording cannot be opened or is
+ *        malformed.
+ */
+Input open(const std::string &path, std::uint64_t last_duration = 1,
+           int threads = 1);
+
+/**
+ * Checks that no universe is held by more than one recording.
+ *
+ * \param inputs recordings to merge.
+ * \return number of universes held by the recordings together.
+ * \throw std::runtime_error naming a universe held twice.
+ */
+std::size_t check(const std::vector<Input> &inputs);
+
+/**
+ * Merges recordings into a single timeline.
+ *
+ * Recordings are read in step, a frame at a time, so none of them is loaded
+ * as a whole. Universes showing up in more than one recording are reported
+ * when read, see \c stream::MergeAll .
+ *
+ * \param inputs recordings to merge, each starting at time \c 0 .
+ * \return stage producing the merged frames.
+ */
+stream::MergeAll<stream::AnySource> merge(std::vector<Input> inputs);
+}  // namespace merge
+}  // namespace olavc
+
+#endif
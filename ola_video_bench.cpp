@@ -0,0 +1,133 @@
+#include <bench.hpp>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
+#include <io.hpp>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int prog(int argc, char **argv) {
+  using namespace olavc;
+
+  cxxopts::Options options{"ola_video_bench",
+                           "measures decoding and seeking speed of videos"};
+  // clang-format off
+  options.add_options()
+    ("i,input", "path of video to measure (repeatable)",
+      cxxopts::value<std::vector<std::string>>())
+    ("o,output", "path of tab-separated report (default: stdout)",
+      cxxopts::value<std::string>())
+    ("seeks", "number of seeks to random times",
+      cxxopts::value<std::size_t>()->default_value("200"))
+    ("steps", "number of steps back by a frame",
+      cxxopts::value<std::size_t>()->default_value("200"))
+    ("t,threads", "number of decoder threads per stream",
+      cxxopts::value<int>()->default_value("1"))
+    ("universes", "universes to decode, e.g. 0-15+32 (default: all)",
+      cxxopts::value<std::string>())
+    ("seed", "seed of the random seek times",
+      cxxopts::value<std::uint64_t>()->default_value("1"))
+    ("synth", "also measure synthetic videos of these universe counts, "
+      "e.g. 8+64+512", cxxopts::value<std::string>())
+    ("synth-groups", "universes per stream of synthetic videos "
+      "(0 = single stream)", cxxopts::value<std::string>()->default_value("0"))
+    ("synth-threads", "encoder threads of synthetic videos",
+      cxxopts::value<std::string>()->default_value("1"))
+    ("synth-frames", "number of frames of synthetic videos",
+      cxxopts::value<std::size_t>()->default_value("2000"))
+    ("work-dir", "directory receiving synthetic videos "
+      "(default: temporary directory)", cxxopts::value<std::string>())
+    ("keep", "keep synthetic videos")
+    ("h,help", "show help");
+
+  options.positional_help("INPUT...");
+  options.show_positional_help();
+  // clang-format on
+  options.parse_positional({"input"});
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    return 0;
+  }
+
+  if (!result.count("input") && !result.count("synth")) {
+    std::cerr << "Error: no input path specified." << '\n';
+    return 1;
+  }
+
+  bench::Options opts{};
+  opts.seeks = result["seeks"].as<std::size_t>();
+  opts.steps = result["steps"].as<std::size_t>();
+  opts.threads = result["threads"].as<int>();
+  opts.seed = result["seed"].as<std::uint64_t>();
+  if (result.count("universes"))
+    opts.universes =
+        io::parse_range_list(result["universes"].as<std::string>());
+
+  std::vector<std::string> inputs;
+  if (result.count("input"))
+    inputs = result["input"].as<std::vector<std::string>>();
+
+  std::vector<std::string> synthetic;
+  if (result.count("synth")) {
+    std::filesystem::path dir{std::filesystem::temp_directory_path()};
+    if (result.count("work-dir"))
+      dir = result["work-dir"].as<std::string>();
+
+    bench::Synthetic s{};
+    s.frames = result["synth-frames"].as<std::size_t>();
+    auto groups{
+        io::parse_range_list(result["synth-groups"].as<std::string>())};
+    auto threads{
+        io::parse_range_list(result["synth-threads"].as<std::string>())};
+    for (auto u : io::parse_range_list(result["synth"].as<std::string>())) {
+      for (auto g : groups) {
+        for (auto t : threads) {
+          s.universes = static_cast<int>(u);
+          s.group_size = static_cast<int>(g);
+          s.threads = static_cast<int>(t);
+          auto path{dir / ("ola_video_bench-u" + std::to_string(u) + "-g" +
+                           std::to_string(g) + "-t" + std::to_string(t) +
+                           ".mkv")};
+          std::cerr << "Encoding " << path.string() << '\n';
+          bench::synthesise(path.string(), s);
+          synthetic.push_back(path.string());
+        }
+      }
+    }
+    inputs.insert(inputs.end(), synthetic.begin(), synthetic.end());
+  }
+
+  std::vector<bench::Result> results;
+  for (const auto &in : inputs) {
+    std::cerr << "Measuring " << in << '\n';
+    results.emplace_back(bench::run(in, opts));
+  }
+
+  if (!result.count("keep")) {
+    for (const auto &p : synthetic) std::filesystem::remove(p);
+  }
+
+  if (result.count("output")) {
+    std::ofstream report{result["output"].as<std::string>()};
+    if (!report) throw std::runtime_error{"could not open report"};
+    bench::write_report(report, results);
+  } else {
+    bench::write_report(std::cout, results);
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  try {
+    return prog(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "Exiting with error: " << e.what() << '\n';
+    return 1;
+  }
+}
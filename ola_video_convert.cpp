@@ -1,11 +1,22 @@
 #include <algorithm>
-#include <chrono>
+#include <batch.hpp>
+#include <budget.hpp>
+#include <convert.hpp>
 #include <cxxopts.hpp>
 #include <fstream>
 #include <iostream>
-#include <media.hpp>
+#include <memory>
+#include <memory.hpp>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <watch.hpp>
+
+static void report_io(const olavc::budget::Stats &st) {
+  std::cerr << "Read " << (st.read_bytes / 1e6) << " MB, wrote "
+            << (st.write_bytes / 1e6) << " MB, waited " << st.waited_s
+            << " s for the I/O budget" << '\n';
+}
 
 int prog(int argc, char **argv) {
   using namespace olavc;
@@ -14,16 +25,80 @@ int prog(int argc, char **argv) {
                            "converts an OLA showfile to a video"};
   // clang-format off
   options.add_options()
-    ("u,universes", "number of universes", cxxopts::value<int>())
-    ("o,output", "path of output FFV1 MKV file", cxxopts::value<std::string>())
+    ("u,universes", "number of universes (default: found by the pre-scan)",
+      cxxopts::value<int>())
+    ("o,output", "path of output file (- for stdout with raw formats)",
+      cxxopts::value<std::string>())
+    ("f,format", "output format: ffv1 (MKV), y4m or gray8 (uncompressed), "
+      "dedup (archive storing each distinct frame once), events "
+      "(per-universe change log), arrow or parquet (tables for analysis)",
+      cxxopts::value<std::string>()->default_value("ffv1"))
+    ("table", "shape of arrow/parquet output: wide or long",
+      cxxopts::value<std::string>()->default_value("wide"))
+    ("raw-fps", "constant frame rate of raw outputs "
+      "(0 = each showfile frame once, timing discarded)",
+      cxxopts::value<unsigned>()->default_value("0"))
     ("i,input", "path of input showfile", cxxopts::value<std::string>())
-    ("l,last-duration", "duration of last frame (ms)", 
+    ("l,last-duration", "duration of last frame (ms)",
       cxxopts::value<int>()->default_value("1"))
+    ("start", "time in the showfile to start converting from (ms)",
+      cxxopts::value<std::uint64_t>()->default_value("0"))
+    ("end", "time in the showfile to stop converting at (ms, 0 = end)",
+      cxxopts::value<std::uint64_t>()->default_value("0"))
     ("p,progress",
       "frame interval between showing encoding statistics and progress. "
       "(0 = statistics off).", cxxopts::value<int>()->default_value("0"))
+    ("sink", "additional output written from the same pass: "
+      "PATH[,format=F][,codec=C][,fps=N][,threads=N][,group=N]"
+      "[,universes=A-B+C][,table=T] "
+      "(repeatable)", cxxopts::value<std::vector<std::string>>())
+    ("merge", "further showfile, video, frame archive or event log holding "
+      "other universes, merged with the input into one timeline "
+      "(repeatable)", cxxopts::value<std::vector<std::string>>())
+    ("t,threads", "number of encoder threads",
+      cxxopts::value<int>()->default_value("1"))
+    ("g,group-size", "universes per video stream, allowing players to decode "
+      "only the groups they need (0 = single stream)",
+      cxxopts::value<int>()->default_value("0"))
+    ("crop", "narrow video frames to the highest channel used "
+      "(reads the showfile twice)")
+    ("elide-constant", "also leave channels that never change out of video "
+      "frames, storing their values in the file tags (implies --crop)")
+    ("no-prescan", "skip checking the showfile structure before converting "
+      "(requires -u, no progress percentage)")
+    ("batch", "convert all jobs listed in a manifest "
+      "(lines of: INPUT OUTPUT [UNIVERSES])", cxxopts::value<std::string>())
+    ("glob", "convert all showfiles matching a glob pattern",
+      cxxopts::value<std::string>())
+    ("watch", "run as a daemon converting showfiles completed in a "
+      "directory (repeatable)", cxxopts::value<std::vector<std::string>>())
+    ("suffix", "file name suffix of showfiles picked up by --watch",
+      cxxopts::value<std::string>()->default_value(".show"))
+    ("stats", "path of counter file written by --watch",
+      cxxopts::value<std::string>())
+    ("stats-interval", "interval between counter updates (s)",
+      cxxopts::value<unsigned>()->default_value("10"))
+    ("output-dir", "directory receiving outputs of --glob and --watch "
+      "(default: next to inputs)", cxxopts::value<std::string>())
+    ("j,jobs", "core budget shared by all conversions of a batch or daemon "
+      "(0 = all cores)", cxxopts::value<unsigned>()->default_value("0"))
+    ("report", "path of batch summary report (default: stdout)",
+      cxxopts::value<std::string>())
+    ("max-cores", "number of CPUs the conversion runs on (0 = all)",
+      cxxopts::value<unsigned>()->default_value("0"))
+    ("read-limit", "largest read rate (MB/s, 0 = unlimited)",
+      cxxopts::value<double>()->default_value("0"))
+    ("write-limit", "largest write rate (MB/s, 0 = unlimited)",
+      cxxopts::value<double>()->default_value("0"))
+    ("idle", "only use CPU and disk time left over by other processes "
+      "(SCHED_IDLE and idle I/O class)")
+    ("memory-limit", "memory the converter may use (MiB), sizing output "
+      "queues and caches to fit; shared by the jobs of a batch or daemon",
+      cxxopts::value<std::uint64_t>())
+    ("memory-report", "print peak memory use and the memory held by "
+      "buffers after converting")
     ("h,help", "show help")
-    ("extra-positional", "extra positional arguments", 
+    ("extra-positional", "extra positional arguments",
       cxxopts::value<std::vector<std::string>>());
 
   options.positional_help("OUTPUT INPUT");
@@ -37,67 +112,147 @@ int prog(int argc, char **argv) {
     return 0;
   }
 
-  if (!result.count("universes")) {
-    std::cerr << "Error: no universe count specified." << '\n';
-    return 1;
-  }
+  ConvertOptions opts{};
+  if (result.count("universes"))
+    opts.universes = result["universes"].as<int>();
+  opts.format = parse_output_format(result["format"].as<std::string>());
+  opts.raw_fps = result["raw-fps"].as<unsigned>();
+  opts.last_duration = result["last-duration"].as<int>();
+  opts.start_ms = result["start"].as<std::uint64_t>();
+  opts.end_ms = result["end"].as<std::uint64_t>();
+  opts.progress = result["progress"].as<int>();
+  opts.threads = result["threads"].as<int>();
+  opts.group_size = result["group-size"].as<int>();
+  opts.table = table::parse_form(result["table"].as<std::string>());
+  opts.crop = result.count("crop");
+  opts.elide_constant = result.count("elide-constant");
+  opts.prescan = !result.count("no-prescan");
 
-  if (!result.count("output")) {
-    std::cerr << "Error: no output path specified." << '\n';
-    return 1;
+  // Applied before any thread is started, so every thread inherits it.
+  budget::Options bopts{};
+  bopts.cores = result["max-cores"].as<unsigned>();
+  bopts.read_mb_s = result["read-limit"].as<double>();
+  bopts.write_mb_s = result["write-limit"].as<double>();
+  bopts.idle = result.count("idle");
+  budget::apply(bopts);
+  opts.threads = budget::cap_threads(bopts, opts.threads);
+  opts.queue_depth = budget::queue_depth(bopts);
+  if ((bopts.read_mb_s > 0) || (bopts.write_mb_s > 0))
+    opts.limiter = std::make_shared<budget::Limiter>(bopts);
+
+  if (result.count("sink")) {
+    if (result.count("watch") || result.count("batch") ||
+        result.count("glob")) {
+      std::cerr << "Error: --sink only applies to single conversions." << '\n';
+      return 1;
+    }
+    for (const auto &spec : result["sink"].as<std::vector<std::string>>()) {
+      opts.sinks.emplace_back(parse_sink_spec(spec));
+      opts.sinks.back().threads =
+          budget::cap_threads(bopts, opts.sinks.back().threads);
+    }
   }
 
-  if (!result.count("input")) {
-    std::cerr << "Error: no input path specified." << '\n';
-    return 1;
+  if (result.count("merge")) {
+    if (result.count("watch") || result.count("batch") ||
+        result.count("glob")) {
+      std::cerr << "Error: --merge only applies to single conversions."
+                << '\n';
+      return 1;
+    }
+    opts.merge = result["merge"].as<std::vector<std::string>>();
   }
 
-  auto num_universe{result["universes"].as<int>()};
-  if (num_universe <= 0)
-    throw std::runtime_error{"non-positive universe count"};
+  auto cores{result["jobs"].as<unsigned>()};
+  if (!cores) cores = std::max(1u, std::thread::hardware_concurrency());
+  if (bopts.cores) cores = std::min(cores, bopts.cores);
 
-  DMXVideoEncoder::DMXVideoEncoder encoder{num_universe,
-                                           result["output"].as<std::string>()};
+  // Batches and daemons run up to one conversion per core at a time.
+  if (result.count("memory-limit")) {
+    opts.memory_limit =
+        memory::available(result["memory-limit"].as<std::uint64_t>());
+    if (result.count("watch") || result.count("batch") ||
+        result.count("glob"))
+      opts.memory_limit /= cores;
+  }
 
-  std::ifstream show{result["input"].as<std::string>()};
-  if (!show) throw std::runtime_error{"could not open showfile"};
+  if (result.count("watch")) {
+    if (!result.count("universes") && !opts.prescan) {
+      std::cerr << "Error: no universe count specified." << '\n';
+      return 1;
+    }
 
-  auto last_frame_time{result["last-duration"].as<int>()};
-  io::UniverseStates universe_states{};
-  io::OLAFrame d_frame{};
-  auto interval{result["progress"].as<int>()};
-  auto start{std::chrono::steady_clock::now()};
+    watch::Options wopts{};
+    wopts.dirs = result["watch"].as<std::vector<std::string>>();
+    if (result.count("output-dir"))
+      wopts.output_dir = result["output-dir"].as<std::string>();
+    wopts.suffix = result["suffix"].as<std::string>();
+    if (result.count("stats"))
+      wopts.stats_path = result["stats"].as<std::string>();
+    wopts.stats_interval_s = result["stats-interval"].as<unsigned>();
+    wopts.cores = cores;
+    wopts.defaults = opts;
 
-  for (std::size_t count{0};
-       (read_frame(show, d_frame) || (d_frame.duration_ms == -1)); ++count) {
-    universe_states[d_frame.universe] = d_frame.data;
-    if (universe_states.size() > num_universe)
-      throw std::runtime_error{"too many universes in showfile"};
+    return watch::run(wopts) ? 1 : 0;
+  }
 
-    if (!d_frame.duration_ms) continue;
+  if (result.count("batch") || result.count("glob")) {
+    std::vector<ConvertOptions> jobs;
+    if (result.count("batch"))
+      jobs = batch::read_manifest(result["batch"].as<std::string>(), opts);
+    if (result.count("glob")) {
+      if (!result.count("universes") && !opts.prescan) {
+        std::cerr << "Error: no universe count specified." << '\n';
+        return 1;
+      }
 
-    if (d_frame.duration_ms == -1) d_frame.duration_ms = last_frame_time;
+      std::string output_dir{};
+      if (result.count("output-dir"))
+        output_dir = result["output-dir"].as<std::string>();
+      auto matched{batch::glob_jobs(result["glob"].as<std::string>(),
+                                    output_dir, opts)};
+      jobs.insert(jobs.end(), matched.begin(), matched.end());
+    }
 
-    if (universe_states.size() != num_universe)
-      throw std::runtime_error{"universe state(s) undefined at encode"};
+    auto outcomes{batch::run(jobs, cores)};
+    if (result.count("report")) {
+      std::ofstream report{result["report"].as<std::string>()};
+      if (!report) throw std::runtime_error{"could not open report"};
+      batch::write_report(report, outcomes);
+    } else {
+      batch::write_report(std::cout, outcomes);
+    }
 
-    encoder.write_universe(universe_states, d_frame.duration_ms);
+    auto failed{std::count_if(outcomes.begin(), outcomes.end(),
+                              [](const auto &o) { return !o.ok; })};
+    std::cerr << (outcomes.size() - failed) << " converted, " << failed
+              << " failed" << '\n';
+    if (opts.limiter) report_io(opts.limiter->stats());
+    if (result.count("memory-report")) memory::write_report(std::cerr, {});
+    return failed ? 1 : 0;
+  }
 
-    if (interval && count && !(count % interval)) {
-      auto elapsed{std::chrono::steady_clock::now() - start};
-      auto elapsedf{
-          std::chrono::duration<double, decltype(elapsed)::period>{elapsed}
-              .count() /
-          (decltype(elapsed)::period::den)};
-      std::cerr << "Frame " << count << '\n'
-                << "Elapsed " << elapsedf << " s" << '\n'
-                << "Average FPS: " << (count / elapsedf) << '\n';
-    }
-  };
+  if (!result.count("universes") && !opts.prescan) {
+    std::cerr << "Error: no universe count specified." << '\n';
+    return 1;
+  }
 
-  if (!show.eof()) throw std::runtime_error{"reading showfile"};
+  if (!result.count("output") && opts.sinks.empty()) {
+    std::cerr << "Error: no output path specified." << '\n';
+    return 1;
+  }
+
+  if (!result.count("input")) {
+    std::cerr << "Error: no input path specified." << '\n';
+    return 1;
+  }
 
-  encoder.close();
+  if (result.count("output")) opts.output = result["output"].as<std::string>();
+  opts.input = result["input"].as<std::string>();
+  auto converted{convert(opts)};
+  if (opts.limiter) report_io(opts.limiter->stats());
+  if (result.count("memory-report"))
+    memory::write_report(std::cerr, converted.memory);
 
   return 0;
 }
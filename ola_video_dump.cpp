@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cxxopts.hpp>
+#include <decoder.hpp>
+#include <dedup.hpp>
+#include <eventlog.hpp>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <stream.hpp>
+#include <string>
+
+int prog(int argc, char **argv) {
+  using namespace olavc;
+
+  cxxopts::Options options{"ola_video_dump",
+                           "converts a video, frame archive or event log back "
+                           "to an OLA showfile"};
+  // clang-format off
+  options.add_options()
+    ("i,input", "path of input video, frame archive or event log",
+      cxxopts::value<std::string>())
+    ("o,output", "path of output showfile (default: stdout)",
+      cxxopts::value<std::string>())
+    ("universes", "universes to dump, e.g. 0-15+32 (default: all)",
+      cxxopts::value<std::string>())
+    ("s,start", "time to start dumping from (ms)",
+      cxxopts::value<std::int64_t>()->default_value("0"))
+    ("t,threads", "number of decoder threads per stream",
+      cxxopts::value<int>()->default_value("1"))
+    ("stats", "print decoding statistics")
+    ("h,help", "show help");
+
+  options.positional_help("INPUT");
+  options.show_positional_help();
+  // clang-format on
+  options.parse_positional({"input"});
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    return 0;
+  }
+
+  if (!result.count("input")) {
+    std::cerr << "Error: no input path specified." << '\n';
+    return 1;
+  }
+
+  std::ofstream file;
+  if (result.count("output")) {
+    file.open(result["output"].as<std::string>());
+    if (!file) throw std::runtime_error{"could not open output"};
+  }
+  auto &out{result.count("output") ? static_cast<std::ostream &>(file)
+                                   : std::cout};
+
+  out << io::show_header << '\n';
+
+  auto write_frame = [&out](const stream::FrameView &frame,
+                            std::int64_t duration) {
+    std::size_t n{};
+    frame.for_each([&](auto u, const auto &data) {
+      io::write_chans(out, u, data);
+      out << ((++n == frame.size()) ? duration : 0) << '\n';
+    });
+  };
+
+  const auto input{result["input"].as<std::string>()};
+  const auto start{result["start"].as<std::int64_t>()};
+  std::set<std::uint32_t> universes;
+  if (result.count("universes"))
+    universes = io::parse_range_list(result["universes"].as<std::string>());
+
+  std::size_t frames{};
+  auto from{static_cast<std::uint64_t>(std::max<std::int64_t>(start, 0))};
+  if (eventlog::Reader::probe(input)) {
+    eventlog::Reader log{input};
+    // Universes not dumped are never read.
+    for (const auto &f :
+         stream::window(eventlog::Source{log, universes, from}, from)) {
+      write_frame(f, f.duration_ms);
+      ++frames;
+    }
+
+    if (!out) throw std::runtime_error{"writing showfile"};
+
+    if (result.count("stats")) std::cerr << "Frames: " << frames << '\n';
+    return 0;
+  }
+
+  if (dedup::Reader::probe(input)) {
+    dedup::Reader archive{input};
+    const auto &all{archive.universes()};
+    if (universes.empty()) universes.insert(all.begin(), all.end());
+    for (auto u : universes) {
+      if (!std::binary_search(all.begin(), all.end(), u))
+        throw std::runtime_error{"universe " + std::to_string(u) +
+                                 " not in archive"};
+    }
+
+    // Only the part of the timeline from the start is read.
+    for (const auto &f :
+         stream::filter(stream::window(dedup::Source{archive, from}, from),
+                        universes)) {
+      write_frame(f, f.duration_ms);
+      ++frames;
+    }
+
+    if (!out) throw std::runtime_error{"writing showfile"};
+
+    if (result.count("stats")) {
+      std::cerr << "Frames: " << frames << '\n'
+                << "Distinct frames stored: " << archive.unique_frames()
+                << '\n';
+    }
+    return 0;
+  }
+
+  DMXVideoDecoder::DecoderOptions opts{};
+  opts.universes = universes;
+  opts.threads = result["threads"].as<int>();
+
+  DMXVideoDecoder::DMXVideoDecoder decoder{input, opts};
+  if (start) decoder.seek(start);
+
+  io::UniverseStates sts{};
+  std::int64_t pts, duration;
+  while (decoder.read(sts, pts, duration)) {
+    write_frame(stream::FrameView{&sts}, duration);
+    ++frames;
+  }
+
+  if (!out) throw std::runtime_error{"writing showfile"};
+
+  if (result.count("stats")) {
+    std::cerr << "Frames: " << frames << '\n'
+              << "Streams decoded: " << decoder.active_streams() << " of "
+              << decoder.total_streams() << '\n'
+              << "Compressed bytes decoded: " << decoder.compressed_bytes()
+              << '\n';
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  try {
+    return prog(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "Exiting with error: " << e.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,95 @@
+#include <cxxopts.hpp>
+#include <edit.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int prog(int argc, char **argv) {
+  using namespace olavc;
+
+  cxxopts::Options options{"ola_video_edit",
+                           "trims, splits and joins videos without "
+                           "re-encoding"};
+  // clang-format off
+  options.add_options()
+    ("command", "trim, split or concat", cxxopts::value<std::string>())
+    ("i,input", "path of input video (repeatable for concat)",
+      cxxopts::value<std::vector<std::string>>())
+    ("o,output", "path of output video, or segment path pattern for split "
+      "holding %d (e.g. show-%03d.mkv)", cxxopts::value<std::string>())
+    ("start", "time to start the trimmed video at (ms)",
+      cxxopts::value<std::int64_t>()->default_value("0"))
+    ("end", "time to end the trimmed video at (ms, 0 = end)",
+      cxxopts::value<std::int64_t>()->default_value("0"))
+    ("segment", "length of split segments (ms)",
+      cxxopts::value<std::int64_t>())
+    ("h,help", "show help");
+
+  options.positional_help("COMMAND INPUT...");
+  options.show_positional_help();
+  // clang-format on
+  options.parse_positional({"command", "input"});
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    return 0;
+  }
+
+  if (!result.count("command")) {
+    std::cerr << "Error: no command specified." << '\n';
+    return 1;
+  }
+
+  if (!result.count("input")) {
+    std::cerr << "Error: no input path specified." << '\n';
+    return 1;
+  }
+
+  if (!result.count("output")) {
+    std::cerr << "Error: no output path specified." << '\n';
+    return 1;
+  }
+
+  const auto command{result["command"].as<std::string>()};
+  const auto inputs{result["input"].as<std::vector<std::string>>()};
+  const auto output{result["output"].as<std::string>()};
+  if ((command != "concat") && (inputs.size() != 1)) {
+    std::cerr << "Error: " << command << " takes a single input." << '\n';
+    return 1;
+  }
+
+  if (command == "trim") {
+    const auto end{result["end"].as<std::int64_t>()};
+    auto frames{edit::trim(inputs.front(), output,
+                           result["start"].as<std::int64_t>(),
+                           (end > 0) ? end : -1)};
+    std::cerr << frames << " frames copied" << '\n';
+  } else if (command == "split") {
+    if (!result.count("segment")) {
+      std::cerr << "Error: no segment length specified." << '\n';
+      return 1;
+    }
+    auto paths{edit::split(inputs.front(), output,
+                           result["segment"].as<std::int64_t>())};
+    for (const auto &p : paths) std::cout << p << '\n';
+  } else if (command == "concat") {
+    auto frames{edit::concat(inputs, output)};
+    std::cerr << frames << " frames copied" << '\n';
+  } else {
+    std::cerr << "Error: unknown command " << command << '.' << '\n';
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  try {
+    return prog(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "Exiting with error: " << e.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,284 @@
+#include <pthread.h>
+#include <signal.h>
+
+#include <control.hpp>
+#include <cstring>
+#include <cxxopts.hpp>
+#include <fstream>
+#include <io.hpp>
+#include <iostream>
+#include <memory>
+#include <memory.hpp>
+#include <player.hpp>
+#include <realtime.hpp>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <timecode.hpp>
+#include <vector>
+
+static olavc::timecode::Options parse_chase(const std::string &spec) {
+  using namespace olavc::timecode;
+  Options opts{};
+  auto colon{spec.find(':')};
+  auto kind{spec.substr(0, colon)};
+  if (kind == "mtc")
+    opts.kind = SourceKind::mtc;
+  else if (kind == "ltc")
+    opts.kind = SourceKind::ltc;
+  else if (kind == "socket")
+    opts.kind = SourceKind::socket;
+  else
+    throw std::runtime_error{"unknown timecode source " + kind};
+  if ((colon == std::string::npos) || ((colon + 1) == spec.size()))
+    throw std::runtime_error{"timecode source without path"};
+  opts.path = spec.substr(colon + 1);
+  return opts;
+}
+
+/**
+ * Reports real-time tuning that could not be applied, which playback does
+ * without.
+ */
+static void warn(const std::string &what, int err = 0) {
+  std::cerr << "Warning: could not " << what;
+  if (err) std::cerr << " (" << std::strerror(err) << ')';
+  std::cerr << ", continuing without" << '\n';
+}
+
+int prog(int argc, char **argv) {
+  using namespace olavc;
+
+  cxxopts::Options options{"ola_video_play",
+                           "plays a video in real time as OLA universe lines"};
+  // clang-format off
+  options.add_options()
+    ("i,input", "paths of input videos, played in order",
+      cxxopts::value<std::vector<std::string>>())
+    ("playlist", "path of a file listing videos to play, one per line",
+      cxxopts::value<std::string>())
+    ("repeat", "play the videos again from the first after the last")
+    ("o,output", "path of output (default: stdout)",
+      cxxopts::value<std::string>())
+    ("universes", "universes to play, e.g. 0-15+32 (default: all)",
+      cxxopts::value<std::string>())
+    ("s,start", "time to start playing at (ms)",
+      cxxopts::value<std::int64_t>()->default_value("0"))
+    ("t,threads", "number of frames decoded in parallel (0 = all cores)",
+      cxxopts::value<unsigned>()->default_value("0"))
+    ("decoder-threads", "number of decoder threads per stream and frame",
+      cxxopts::value<int>()->default_value("1"))
+    ("pool", "number of decoded frames held ahead of the output",
+      cxxopts::value<std::size_t>()->default_value("32"))
+    ("c,control", "path of a control socket, keeps the last frame at the end",
+      cxxopts::value<std::string>())
+    ("chase", "timecode to follow: mtc:PATH, ltc:PATH or socket:PATH",
+      cxxopts::value<std::string>())
+    ("fps", "frame rate of LTC and text timecodes (24, 25, 29.97, 30)",
+      cxxopts::value<std::string>()->default_value("25"))
+    ("sample-rate", "sample rate of LTC audio",
+      cxxopts::value<unsigned>()->default_value("48000"))
+    ("max-drift", "timecode difference that relocates playback (ms)",
+      cxxopts::value<double>()->default_value("20"))
+    ("freewheel", "time played through timecode dropouts (ms)",
+      cxxopts::value<unsigned>()->default_value("1000"))
+    ("memory-limit", "memory the player may use (MiB), sizing the frame pool "
+      "and decoder threads to fit", cxxopts::value<std::uint64_t>())
+    ("lock-memory", "lock memory into RAM and prefault the frame pool")
+    ("output-cpus", "CPUs the output thread runs on, e.g. 3",
+      cxxopts::value<std::string>())
+    ("decode-cpus", "CPUs the decoding threads run on, e.g. 0-2",
+      cxxopts::value<std::string>())
+    ("rt-priority", "SCHED_FIFO priority of the output thread (0 = none)",
+      cxxopts::value<int>()->default_value("0"))
+    ("compare-modes", "play this long (ms) in each real-time mode and report "
+      "output delays", cxxopts::value<std::int64_t>())
+    ("stats", "print playback statistics")
+    ("h,help", "show help");
+
+  options.positional_help("INPUT...");
+  options.show_positional_help();
+  // clang-format on
+  options.parse_positional({"input"});
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cerr << options.help() << '\n';
+    return 0;
+  }
+
+  std::vector<std::string> inputs;
+  if (result.count("input"))
+    inputs = result["input"].as<std::vector<std::string>>();
+  if (result.count("playlist")) {
+    std::ifstream list{result["playlist"].as<std::string>()};
+    if (!list) throw std::runtime_error{"could not open playlist"};
+    for (std::string line; std::getline(list, line);) {
+      auto path{io::trim(line)};
+      if (path.size() && (path.front() != '#')) inputs.emplace_back(path);
+    }
+  }
+
+  if (inputs.empty()) {
+    std::cerr << "Error: no input path specified." << '\n';
+    return 1;
+  }
+  if (result.count("chase") && ((inputs.size() > 1) || result.count("repeat")))
+    throw std::runtime_error{"chasing timecode through a playlist"};
+
+  std::ofstream file;
+  if (result.count("output")) {
+    file.open(result["output"].as<std::string>());
+    if (!file) throw std::runtime_error{"could not open output"};
+  }
+  auto &out{result.count("output") ? static_cast<std::ostream &>(file)
+                                   : std::cout};
+
+  player::Options opts{};
+  opts.pool_frames = result["pool"].as<std::size_t>();
+  opts.threads = result["threads"].as<unsigned>();
+  opts.decoder_threads = result["decoder-threads"].as<int>();
+  if (result.count("universes"))
+    opts.universes =
+        io::parse_range_list(result["universes"].as<std::string>());
+  opts.hold = result.count("control") || result.count("chase");
+  opts.paused = result.count("chase");
+  opts.repeat = result.count("repeat");
+  opts.prefault = result.count("lock-memory");
+  if (result.count("decode-cpus"))
+    opts.decode_cpus =
+        io::parse_range_list(result["decode-cpus"].as<std::string>());
+  std::set<std::uint32_t> output_cpus;
+  if (result.count("output-cpus"))
+    output_cpus = io::parse_range_list(result["output-cpus"].as<std::string>());
+  auto priority{result["rt-priority"].as<int>()};
+  if ((priority < 0) || (priority > 99))
+    throw std::runtime_error{"priority out of range"};
+
+  if (result.count("compare-modes")) {
+    if (inputs.size() > 1)
+      throw std::runtime_error{"comparing modes of a playlist"};
+    auto modes{realtime::standard_modes(output_cpus, priority ? priority : 50)};
+    if (result.count("decode-cpus")) {
+      for (auto it{modes.begin() + 2}; it != modes.end(); ++it)
+        it->decode_cpus = opts.decode_cpus;
+    }
+    realtime::write_report(
+        std::cout,
+        realtime::compare(inputs.front(), opts, modes,
+                          result["compare-modes"].as<std::int64_t>()));
+    return 0;
+  }
+
+  if (result.count("lock-memory")) {
+    if (auto err{realtime::lock_memory()}) warn("lock memory", err);
+  }
+  if (result.count("memory-limit"))
+    opts.memory_limit =
+        memory::available(result["memory-limit"].as<std::uint64_t>());
+
+  // Players that hold their last frame are stopped by SIGINT and SIGTERM,
+  // which are blocked before any thread starts so only sigwait() gets them.
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if (opts.hold && pthread_sigmask(SIG_BLOCK, &mask, nullptr))
+    throw std::runtime_error{"blocking signals"};
+
+  player::Player player{inputs, out, opts};
+  if (!player.stats().decode_pinned) warn("pin decoding threads");
+  std::unique_ptr<control::Server> server;
+  if (result.count("control"))
+    server = std::make_unique<control::Server>(
+        result["control"].as<std::string>(), player);
+  std::unique_ptr<timecode::Chaser> chaser;
+  if (result.count("chase")) {
+    auto copts{parse_chase(result["chase"].as<std::string>())};
+    copts.rate = timecode::parse_rate(result["fps"].as<std::string>());
+    copts.sample_rate = result["sample-rate"].as<unsigned>();
+    copts.max_drift_ms = result["max-drift"].as<double>();
+    copts.freewheel_ms = result["freewheel"].as<unsigned>();
+    chaser = std::make_unique<timecode::Chaser>(copts, player);
+  }
+
+  // Woken and joined on every way out of here, including errors from run().
+  struct SignalThread {
+    std::thread t;
+    void join() {
+      if (!t.joinable()) return;
+      pthread_kill(t.native_handle(), SIGTERM);
+      t.join();
+    }
+    ~SignalThread() { join(); }
+  } signals;
+  if (opts.hold) {
+    signals.t = std::thread{[&mask, &player]() {
+      int sig;
+      sigwait(&mask, &sig);
+      player.stop();
+    }};
+  }
+
+  // The calling thread is the output thread.
+  if (auto err{realtime::pin(pthread_self(), output_cpus)})
+    warn("pin output thread", err);
+  if (auto err{realtime::set_priority(pthread_self(), priority)})
+    warn("set real-time priority", err);
+  player.run(result["start"].as<std::int64_t>());
+  signals.join();
+  server.reset();
+
+  if (result.count("stats")) {
+    const auto &st{player.stats()};
+    std::cerr << "Frames shown: " << st.shown << '\n'
+              << "Frames skipped: " << st.skipped << '\n'
+              << "Frames due before decoded: " << st.stalls << '\n'
+              << "Largest output delay: " << st.max_late_ms << " ms" << '\n'
+              << "Output delay p50 / p99 / max: " << st.lateness.p50_ms
+              << " / " << st.lateness.p99_ms << " / " << st.lateness.max_ms
+              << " ms" << '\n'
+              << "Memory on transparent hugepages: "
+              << realtime::huge_pages_kb() << " kB" << '\n'
+              << "Allocations while playing: " << st.allocations << '\n';
+    memory::write_report(std::cerr, player.memory());
+    if (result.count("control")) {
+      auto l{player.command_latency()};
+      std::cerr << "Commands: " << l.count << '\n'
+                << "Command latency p50 / p99 / max: " << l.p50_ms << " / "
+                << l.p99_ms << " / " << l.max_ms << " ms" << '\n';
+    }
+    for (const auto &tn : st.transitions) {
+      std::cerr << "Handover to " << tn.path << ": preloaded in "
+                << tn.preload_ms << " ms, waited " << tn.wait_ms
+                << " ms, first frame " << tn.late_ms << " ms late" << '\n';
+    }
+    if (chaser) {
+      auto cs{chaser->stats()};
+      auto r{player.seek_latency()};
+      std::cerr << "Timecodes: " << cs.timecodes << '\n'
+                << "Relocations: " << cs.relocations << '\n'
+                << "Dropouts / stops: " << cs.dropouts << " / " << cs.stops
+                << '\n'
+                << "Timecode jitter p50 / p99 / max: " << cs.jitter.p50_ms
+                << " / " << cs.jitter.p99_ms << " / " << cs.jitter.max_ms
+                << " ms" << '\n'
+                << "Position error p50 / p99 / max: " << cs.error.p50_ms
+                << " / " << cs.error.p99_ms << " / " << cs.error.max_ms
+                << " ms" << '\n'
+                << "Relocation latency p50 / p99 / max: " << r.p50_ms
+                << " / " << r.p99_ms << " / " << r.max_ms << " ms" << '\n';
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  try {
+    return prog(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "Exiting with error: " << e.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,444 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <decoder.hpp>
+#include <exception>
+#include <io.hpp>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+using namespace olavc;
+
+constexpr const auto channels{std::tuple_size_v<io::UniverseData>};
+
+/**
+ * Contiguous frame data exposed through the buffer protocol.
+ *
+ * Arrays are created over the buffer without copying it, and keep the
+ * object alive for as long as they use it.
+ */
+struct Frames {
+  PyObject_HEAD
+  std::vector<std::uint8_t> *data;
+  std::vector<std::int64_t> *pts;
+  Py_ssize_t shape[3];
+  Py_ssize_t strides[3];
+  int ndim;
+  bool as_pts;
+};
+
+/**
+ * Decoder object, with rows of frames in ascending universe order.
+ *
+ * The decoder and states are used with the GIL released, so \c lock is held
+ * while using them.
+ */
+struct Decoder {
+  PyObject_HEAD
+  DMXVideoDecoder::DMXVideoDecoder *dec;
+  std::vector<std::uint32_t> *rows;
+  io::UniverseStates *sts;
+  std::mutex *lock;
+};
+
+PyTypeObject *frames_type;
+PyObject *numpy_asarray;
+
+/**
+ * Runs \p f with the GIL released, translating C++ exceptions into Python
+ * ones.
+ */
+template <typename F>
+bool call(F &&f) {
+  std::string error;
+  Py_BEGIN_ALLOW_THREADS;
+  try {
+    f();
+  } catch (const std::exception &e) {
+    error = e.what();
+    if (error.empty()) error = "error";
+  }
+  Py_END_ALLOW_THREADS;
+
+  if (error.size()) PyErr_SetString(PyExc_RuntimeError, error.c_str());
+  return error.empty();
+}
+
+/**
+ * Runs \p f with the GIL released while holding the lock of a decoder, so
+ * that Python threads sharing it take turns.
+ */
+template <typename F>
+bool call(Decoder &d, F &&f) {
+  return call([&]() {
+    std::lock_guard<std::mutex> lk{*d.lock};
+    f();
+  });
+}
+
+/**
+ * Wraps frame data, as a numpy array when numpy is available.
+ */
+PyObject *wrap(std::vector<std::uint8_t> data, std::size_t frames,
+               std::size_t universes, bool single) {
+  auto *f{PyObject_New(Frames, frames_type)};
+  if (!f) return nullptr;
+  f->data = new std::vector<std::uint8_t>{std::move(data)};
+  f->pts = nullptr;
+  f->as_pts = false;
+  f->ndim = single ? 2 : 3;
+  Py_ssize_t dims[]{static_cast<Py_ssize_t>(frames),
+                    static_cast<Py_ssize_t>(universes),
+                    static_cast<Py_ssize_t>(channels)};
+  std::copy(dims + (single ? 1 : 0), dims + 3, f->shape);
+  f->strides[f->ndim - 1] = 1;
+  for (auto i{f->ndim - 2}; i >= 0; --i)
+    f->strides[i] = f->strides[i + 1] * f->shape[i + 1];
+
+  auto *obj{reinterpret_cast<PyObject *>(f)};
+  if (!numpy_asarray) return obj;
+  auto *arr{PyObject_CallOneArg(numpy_asarray, obj)};
+  Py_DECREF(obj);
+  return arr;
+}
+
+PyObject *wrap_pts(std::vector<std::int64_t> pts) {
+  auto *f{PyObject_New(Frames, frames_type)};
+  if (!f) return nullptr;
+  f->data = nullptr;
+  f->pts = new std::vector<std::int64_t>{std::move(pts)};
+  f->as_pts = true;
+  f->ndim = 1;
+  f->shape[0] = static_cast<Py_ssize_t>(f->pts->size());
+  f->strides[0] = sizeof(std::int64_t);
+
+  auto *obj{reinterpret_cast<PyObject *>(f)};
+  if (!numpy_asarray) return obj;
+  auto *arr{PyObject_CallOneArg(numpy_asarray, obj)};
+  Py_DECREF(obj);
+  return arr;
+}
+
+int frames_getbuffer(PyObject *self, Py_buffer *view, int flags) {
+  auto *f{reinterpret_cast<Frames *>(self)};
+  void *buf{f->as_pts ? static_cast<void *>(f->pts->data())
+                      : static_cast<void *>(f->data->data())};
+  auto len{f->as_pts ? f->pts->size() * sizeof(std::int64_t)
+                     : f->data->size()};
+
+  view->obj = self;
+  Py_INCREF(self);
+  view->buf = buf;
+  view->len = static_cast<Py_ssize_t>(len);
+  view->readonly = 0;
+  view->itemsize = f->as_pts ? sizeof(std::int64_t) : 1;
+  view->format = (flags & PyBUF_FORMAT)
+                     ? const_cast<char *>(f->as_pts ? "q" : "B")
+                     : nullptr;
+  view->ndim = f->ndim;
+  view->shape = (flags & PyBUF_ND) ? f->shape : nullptr;
+  view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? f->strides
+                                                              : nullptr;
+  view->suboffsets = nullptr;
+  view->internal = nullptr;
+  return 0;
+}
+
+void frames_dealloc(PyObject *self) {
+  auto *f{reinterpret_cast<Frames *>(self)};
+  delete f->data;
+  delete f->pts;
+  auto *tp{Py_TYPE(self)};
+  tp->tp_free(self);
+  Py_DECREF(tp);
+}
+
+/**
+ * Copies the decoded universes into rows of a frame.
+ */
+void copy_rows(const Decoder &d, std::uint8_t *dst) {
+  for (auto u : *d.rows) {
+    auto it{d.sts->find(u)};
+    if (it != d.sts->end())
+      std::memcpy(dst, it->second.data(), channels);
+    else
+      std::memset(dst, 0, channels);
+    dst += channels;
+  }
+}
+
+int decoder_init(PyObject *self, PyObject *args, PyObject *kwds) {
+  auto *d{reinterpret_cast<Decoder *>(self)};
+  static const char *kwlist[]{"path", "universes", "threads", nullptr};
+  const char *path;
+  PyObject *universes{nullptr};
+  int threads{1};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|Oi",
+                                   const_cast<char **>(kwlist), &path,
+                                   &universes, &threads))
+    return -1;
+
+  DMXVideoDecoder::DecoderOptions opts{};
+  opts.threads = threads;
+  if (universes && (universes != Py_None)) {
+    auto *it{PyObject_GetIter(universes)};
+    if (!it) return -1;
+    while (auto *item{PyIter_Next(it)}) {
+      auto u{PyLong_AsUnsignedLong(item)};
+      Py_DECREF(item);
+      if (PyErr_Occurred()) break;
+      opts.universes.insert(static_cast<std::uint32_t>(u));
+    }
+    Py_DECREF(it);
+    if (PyErr_Occurred()) return -1;
+  }
+
+  std::string p{path};
+  std::unique_ptr<DMXVideoDecoder::DMXVideoDecoder> dec;
+  auto sts{std::make_unique<io::UniverseStates>()};
+  auto rows{std::make_unique<std::vector<std::uint32_t>>()};
+  if (!call([&]() {
+        dec = std::make_unique<DMXVideoDecoder::DMXVideoDecoder>(p, opts);
+
+        // Files that do not list their universes are read once to find
+        // them.
+        std::set<std::uint32_t> us{dec->universes()};
+        if (us.empty()) {
+          std::int64_t pts, dur;
+          dec->read(*sts, pts, dur);
+          for (const auto &s : *sts) us.insert(s.first);
+          dec->seek(0);
+        }
+        for (auto u : us) {
+          if (opts.universes.empty() || opts.universes.count(u))
+            rows->push_back(u);
+        }
+      }))
+    return -1;
+
+  // Other threads may be using a decoder that is already open.
+  if (d->dec) {
+    PyErr_SetString(PyExc_RuntimeError, "decoder already initialised");
+    return -1;
+  }
+  d->lock = new std::mutex{};
+  d->dec = dec.release();
+  d->sts = sts.release();
+  d->rows = rows.release();
+  return 0;
+}
+
+void decoder_dealloc(PyObject *self) {
+  auto *d{reinterpret_cast<Decoder *>(self)};
+  delete d->dec;
+  delete d->rows;
+  delete d->sts;
+  delete d->lock;
+  auto *tp{Py_TYPE(self)};
+  tp->tp_free(self);
+  Py_DECREF(tp);
+}
+
+bool check_open(Decoder *d) {
+  if (d->dec) return true;
+  PyErr_SetString(PyExc_RuntimeError, "decoder not initialised");
+  return false;
+}
+
+PyObject *decoder_read(PyObject *self, PyObject *) {
+  auto *d{reinterpret_cast<Decoder *>(self)};
+  if (!check_open(d)) return nullptr;
+
+  std::vector<std::uint8_t> data(d->rows->size() * channels);
+  std::int64_t pts, dur;
+  bool got{false};
+  if (!call(*d, [&]() {
+        got = d->dec->read(*d->sts, pts, dur);
+        if (got) copy_rows(*d, data.data());
+      }))
+    return nullptr;
+  if (!got) Py_RETURN_NONE;
+
+  auto *frame{wrap(std::move(data), 1, d->rows->size(), true)};
+  if (!frame) return nullptr;
+  return Py_BuildValue("(LLN)", static_cast<long long>(pts),
+                       static_cast<long long>(dur), frame);
+}
+
+PyObject *decoder_seek(PyObject *self, PyObject *args) {
+  auto *d{reinterpret_cast<Decoder *>(self)};
+  long long ms;
+  if (!check_open(d) || !PyArg_ParseTuple(args, "L", &ms)) return nullptr;
+  if (!call(*d, [&]() { d->dec->seek(ms); })) return nullptr;
+  Py_RETURN_NONE;
+}
+
+PyObject *decoder_read_range(PyObject *self, PyObject *args, PyObject *kwds) {
+  auto *d{reinterpret_cast<Decoder *>(self)};
+  static const char *kwlist[]{"t0", "t1", "out", nullptr};
+  long long t0, t1;
+  PyObject *out{nullptr};
+  if (!check_open(d) ||
+      !PyArg_ParseTupleAndKeywords(args, kwds, "LL|O",
+                                   const_cast<char **>(kwlist), &t0, &t1,
+                                   &out))
+    return nullptr;
+
+  auto frame_bytes{d->rows->size() * channels};
+  Py_buffer view{};
+  std::size_t capacity{0};
+  if (out && (out != Py_None)) {
+    if (PyObject_GetBuffer(out, &view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS))
+      return nullptr;
+    if (!frame_bytes || (view.len % frame_bytes)) {
+      PyBuffer_Release(&view);
+      PyErr_SetString(PyExc_ValueError,
+                      "output is not a whole number of frames");
+      return nullptr;
+    }
+    capacity = view.len / frame_bytes;
+  }
+
+  std::vector<std::uint8_t> data;
+  std::vector<std::int64_t> pts;
+  auto ok{call(*d, [&]() {
+    d->dec->seek(t0);
+    std::int64_t p, dur;
+    while ((!view.buf || (pts.size() < capacity)) &&
+           d->dec->read(*d->sts, p, dur)) {
+      if (p >= t1) break;
+      std::uint8_t *dst;
+      if (view.buf) {
+        dst = static_cast<std::uint8_t *>(view.buf) +
+              (pts.size() * frame_bytes);
+      } else {
+        data.resize(data.size() + frame_bytes);
+        dst = data.data() + data.size() - frame_bytes;
+      }
+      copy_rows(*d, dst);
+      pts.push_back(p);
+    }
+  })};
+  if (view.buf) PyBuffer_Release(&view);
+  if (!ok) return nullptr;
+
+  auto n{pts.size()};
+  auto *times{wrap_pts(std::move(pts))};
+  if (!times) return nullptr;
+  if (out && (out != Py_None)) return Py_BuildValue("(nN)", n, times);
+
+  auto *frames{wrap(std::move(data), n, d->rows->size(), false)};
+  if (!frames) {
+    Py_DECREF(times);
+    return nullptr;
+  }
+  return Py_BuildValue("(NN)", frames, times);
+}
+
+PyObject *decoder_universes(PyObject *self, void *) {
+  auto *d{reinterpret_cast<Decoder *>(self)};
+  if (!check_open(d)) return nullptr;
+  auto *l{PyList_New(d->rows->size())};
+  if (!l) return nullptr;
+  for (std::size_t i{0}; i < d->rows->size(); ++i)
+    PyList_SET_ITEM(l, i, PyLong_FromUnsignedLong((*d->rows)[i]));
+  return l;
+}
+
+PyObject *decoder_duration(PyObject *self, void *) {
+  auto *d{reinterpret_cast<Decoder *>(self)};
+  if (!check_open(d)) return nullptr;
+  std::int64_t ms;
+  {
+    std::lock_guard<std::mutex> lk{*d->lock};
+    ms = d->dec->duration_ms();
+  }
+  return PyLong_FromLongLong(ms);
+}
+
+PyMethodDef decoder_methods[]{
+    {"read", decoder_read, METH_NOARGS,
+     "read() -> (pts_ms, duration_ms, frame) or None at the end\n\n"
+     "frame has one row of 512 channels per universe."},
+    {"seek", decoder_seek, METH_VARARGS,
+     "seek(ms): positions the decoder at the frame shown at ms"},
+    {"read_range", reinterpret_cast<PyCFunction>(
+         reinterpret_cast<void (*)()>(decoder_read_range)),
+     METH_VARARGS | METH_KEYWORDS,
+     "read_range(t0, t1, out=None) -> (frames, pts)\n\n"
+     "Decodes the frames shown from t0 until t1 into one array of shape\n"
+     "(frames, universes, 512). With out, a writable buffer of whole\n"
+     "frames, fills it instead and returns (count, pts)."},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyGetSetDef decoder_getset[]{
+    {"universes", decoder_universes, nullptr, "universes of the frame rows",
+     nullptr},
+    {"duration_ms", decoder_duration, nullptr,
+     "duration of the video, -1 if unknown", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+PyType_Slot frames_slots[]{
+    {Py_bf_getbuffer, reinterpret_cast<void *>(frames_getbuffer)},
+    {Py_tp_dealloc, reinterpret_cast<void *>(frames_dealloc)},
+    {Py_tp_doc, const_cast<char *>("Decoded frames, exposing their buffer")},
+    {0, nullptr}};
+
+PyType_Spec frames_spec{"olavc.Frames", sizeof(Frames), 0, Py_TPFLAGS_DEFAULT,
+                        frames_slots};
+
+PyType_Slot decoder_slots[]{
+    {Py_tp_init, reinterpret_cast<void *>(decoder_init)},
+    {Py_tp_new, reinterpret_cast<void *>(PyType_GenericNew)},
+    {Py_tp_dealloc, reinterpret_cast<void *>(decoder_dealloc)},
+    {Py_tp_methods, decoder_methods},
+    {Py_tp_getset, decoder_getset},
+    {Py_tp_doc,
+     const_cast<char *>("Decoder(path, universes=None, threads=1)\n\n"
+                        "Decodes a video written by ola_video_convert.")},
+    {0, nullptr}};
+
+PyType_Spec decoder_spec{"olavc.Decoder", sizeof(Decoder), 0,
+                         Py_TPFLAGS_DEFAULT, decoder_slots};
+
+PyModuleDef module{PyModuleDef_HEAD_INIT,
+                   "olavc",
+                   "Native decoder for videos written by ola_video_convert.",
+                   -1,
+                   nullptr,
+                   nullptr,
+                   nullptr,
+                   nullptr,
+                   nullptr};
+}  // namespace
+
+PyMODINIT_FUNC PyInit_olavc() {
+  auto *m{PyModule_Create(&module)};
+  if (!m) return nullptr;
+
+  frames_type = reinterpret_cast<PyTypeObject *>(PyType_FromSpec(&frames_spec));
+  auto *decoder_type{PyType_FromSpec(&decoder_spec)};
+  if (!frames_type || !decoder_type ||
+      PyModule_AddObject(m, "Decoder", decoder_type)) {
+    Py_XDECREF(decoder_type);
+    Py_DECREF(m);
+    return nullptr;
+  }
+
+  // Frames are returned as numpy arrays when numpy is installed.
+  if (auto *np{PyImport_ImportModule("numpy")}) {
+    numpy_asarray = PyObject_GetAttrString(np, "asarray");
+    Py_DECREF(np);
+  }
+  PyErr_Clear();
+
+  return m;
+}
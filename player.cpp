@@ -0,0 +1,613 @@
+#include <algorithm>
+#include <cmath>
+#include <player.hpp>
+#include <realtime.hpp>
+#include <stdexcept>
+
+namespace olavc {
+namespace player {
+/**
+ * Longest wait for a frame that is not decoded yet, so the output keeps
+ * checking for frames while a decoder lags behind.
+ */
+static constexpr const std::chrono::milliseconds max_wait{5};
+
+/**
+ * Longest wait while nothing is due, such as when paused.
+ */
+static constexpr const std::chrono::seconds idle_wait{1};
+
+/**
+ * Moves a thread to the decoding CPUs at normal priority, as threads
+ * started by the output thread inherit its CPUs and priority.
+ *
+ * \return whether the thread was moved.
+ */
+static bool to_decode_cpus(std::thread::native_handle_type t,
+                           const Options &opts) {
+  return !realtime::set_priority(t, 0) && !realtime::pin(t, opts.decode_cpus);
+}
+
+static DMXVideoDecoder::DecoderOptions decoder_options(const Options &opts) {
+  DMXVideoDecoder::DecoderOptions dopts{};
+  dopts.universes = opts.universes;
+  dopts.threads = opts.decoder_threads;
+  return dopts;
+}
+
+/**
+ * Memory held by a decoder thread: its codec contexts and frame.
+ */
+static std::size_t decoder_bytes(const DMXVideoDecoder::DMXVideoDecoder &d) {
+  return d.frame_bytes() + (d.active_streams() * memory::codec_context_bytes);
+}
+
+/**
+ * Memory held by a frame slot: its universe states and packets, which are
+ * at most as large as the raw frame.
+ */
+static std::size_t slot_bytes(const DMXVideoDecoder::DMXVideoDecoder &d) {
+  return (d.rows() * memory::state_bytes) + d.frame_bytes();
+}
+
+DecodeAhead::DecodeAhead(const std::string &path, const Options &opts)
+    : decoder{path, decoder_options(opts)} {
+  auto n{opts.threads ? opts.threads
+                      : std::max(1u, std::thread::hardware_concurrency())};
+  auto pool{std::max<std::size_t>(2, opts.pool_frames)};
+
+  if (opts.memory_limit) {
+    // The reading decoder counts as one more decoder thread.
+    auto fixed = [&](unsigned threads) {
+      return (threads + 1) * decoder_bytes(decoder);
+    };
+    auto slot{std::max<std::size_t>(1, slot_bytes(decoder))};
+    while ((n > 1) && ((fixed(n) + (2 * slot)) > opts.memory_limit)) --n;
+    if ((fixed(n) + (2 * slot)) > opts.memory_limit)
+      throw std::runtime_error{"memory limit too low for video"};
+    pool = std::min<std::size_t>(pool, (opts.memory_limit - fixed(n)) / slot);
+  }
+
+  slots.resize(pool);
+  for (unsigned i{}; i < n; ++i) {
+    decoders.emplace_back(std::make_unique<DMXVideoDecoder::FrameDecoder>(
+        decoder, opts.decoder_threads));
+  }
+
+  if (opts.prefault) {
+    for (auto &s : slots) {
+      for (auto u : decoder.universes()) {
+        if (opts.universes.empty() || opts.universes.count(u))
+          s.frame.states[u].fill(0);
+      }
+    }
+  }
+
+  threads.emplace_back([this]() { read_loop(); });
+  for (auto &d : decoders)
+    threads.emplace_back([this, &dec = *d]() { decode_loop(dec); });
+  for (auto &t : threads) {
+    if (!to_decode_cpus(t.native_handle(), opts)) pinned = false;
+  }
+}
+
+DecodeAhead::~DecodeAhead() {
+  {
+    std::lock_guard<std::mutex> lk{m};
+    stopping = true;
+  }
+  cv.notify_all();
+  for (auto &t : threads) t.join();
+}
+
+void DecodeAhead::fail() {
+  std::lock_guard<std::mutex> lk{m};
+  if (!error) error = std::current_exception();
+  at_end = true;
+  stopping = true;
+  cv.notify_all();
+}
+
+void DecodeAhead::read_loop() {
+  try {
+    std::unique_lock<std::mutex> lk{m};
+    while (true) {
+      cv.wait(lk, [this]() {
+        return stopping || seeking ||
+               (!at_end && ((tail - head) < slots.size()));
+      });
+      if (stopping) return;
+
+      if (seeking) {
+        // Slots being decoded are dropped once their decoders let go.
+        cv.wait(lk, [this]() { return stopping || !decoding; });
+        if (stopping) return;
+        // The frame taken by the output stays until it is released by pick().
+        for (auto &s : slots) s.state = State::free;
+        if (held) {
+          slot(head).state = State::ready;
+          tail = head + 1;
+        }
+        head = held ? head : tail;
+        next_decode = tail;
+        at_end = false;
+        decoder.seek(seek_ms);
+        seeking = false;
+        cv.notify_all();
+        continue;
+      }
+
+      // The slot at the tail belongs to the reader until it is marked read.
+      auto &s{slot(tail)};
+      lk.unlock();
+      auto got{decoder.read_packets(s.packets)};
+      lk.lock();
+      if (seeking) continue;
+
+      if (got) {
+        s.state = State::read;
+        ++tail;
+      } else {
+        at_end = true;
+      }
+      cv.notify_all();
+    }
+  } catch (...) {
+    fail();
+  }
+}
+
+void DecodeAhead::decode_loop(DMXVideoDecoder::FrameDecoder &dec) {
+  try {
+    std::unique_lock<std::mutex> lk{m};
+    while (true) {
+      cv.wait(lk, [this]() {
+        return stopping || (!seeking && (next_decode < tail));
+      });
+      if (stopping) return;
+
+      auto &s{slot(next_decode++)};
+      s.state = State::decoding;
+      ++decoding;
+      lk.unlock();
+
+      try {
+        dec.decode(s.packets, s.frame.states);
+        s.frame.pts_ms = s.packets.pts_ms;
+        s.frame.duration_ms = s.packets.duration_ms;
+      } catch (...) {
+        lk.lock();
+        --decoding;
+        throw;
+      }
+
+      lk.lock();
+      --decoding;
+      s.state = State::ready;
+      cv.notify_all();
+    }
+  } catch (...) {
+    fail();
+  }
+}
+
+const Frame *DecodeAhead::pick(double position_ms) {
+  std::unique_lock<std::mutex> lk{m};
+  if (error) std::rethrow_exception(error);
+  if (seeking) return nullptr;
+
+  auto due = [&](std::uint64_t n) {
+    return (n < tail) && (slot(n).state == State::ready) &&
+           (slot(n).frame.pts_ms <= position_ms);
+  };
+
+  auto released{held};
+  if (held) {
+    slot(head++).state = State::free;
+    held = false;
+  }
+  while (due(head) && due(head + 1)) {
+    slot(head++).state = State::free;
+    ++skipped;
+    released = true;
+  }
+
+  const Frame *f{nullptr};
+  if (due(head)) {
+    held = true;
+    f = &slot(head).frame;
+  }
+
+  lk.unlock();
+  if (released) cv.notify_all();
+  return f;
+}
+
+std::int64_t DecodeAhead::next_pts(bool &ready) {
+  std::lock_guard<std::mutex> lk{m};
+  ready = false;
+  auto n{next_index()};
+  if (seeking || (n >= tail)) return -1;
+
+  auto &s{slot(n)};
+  ready = (s.state == State::ready);
+  return s.packets.pts_ms;
+}
+
+void DecodeAhead::wait_next(std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lk{m};
+  cv.wait_until(lk, deadline, [this]() {
+    auto n{next_index()};
+    return error || woken ||
+           (!seeking && (((n < tail) && (slot(n).state == State::ready)) ||
+                         ((n >= tail) && at_end)));
+  });
+  woken = false;
+}
+
+void DecodeAhead::sleep_until(std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lk{m};
+  cv.wait_until(lk, deadline, [this]() { return error || woken; });
+  woken = false;
+}
+
+void DecodeAhead::wake() {
+  {
+    std::lock_guard<std::mutex> lk{m};
+    woken = true;
+  }
+  cv.notify_all();
+}
+
+bool DecodeAhead::ended() {
+  std::lock_guard<std::mutex> lk{m};
+  return !seeking && at_end && (next_index() >= tail);
+}
+
+void DecodeAhead::seek(std::int64_t ms) {
+  {
+    std::lock_guard<std::mutex> lk{m};
+    seeking = true;
+    seek_ms = ms;
+    woken = true;
+  }
+  cv.notify_all();
+}
+
+std::vector<memory::Component> DecodeAhead::memory() {
+  std::lock_guard<std::mutex> lk{m};
+  memory::Component frames{"frame pool (" + std::to_string(slots.size()) +
+                           " frames)"};
+  memory::Component packets{"packets"};
+  for (const auto &s : slots) {
+    frames.bytes += s.frame.states.size() * memory::state_bytes;
+    for (const auto &p : s.packets.packets) {
+      if (p) packets.bytes += static_cast<std::uint64_t>(std::max(0, p->size));
+    }
+  }
+  memory::Component dec{"decoders (" + std::to_string(decoders.size()) +
+                            " threads, estimated)",
+                        (decoders.size() + 1) * decoder_bytes(decoder)};
+  return {frames, packets, dec};
+}
+
+std::uint64_t DecodeAhead::frames_skipped() {
+  std::lock_guard<std::mutex> lk{m};
+  return skipped;
+}
+
+double Player::Transport::position(Clock::time_point t) const noexcept {
+  if (paused) return anchor_ms;
+  return anchor_ms +
+         (rate * std::chrono::duration<double, std::milli>{t - anchor}.count());
+}
+
+Player::Clock::time_point Player::Transport::time_of(
+    std::int64_t ms) const noexcept {
+  return anchor + std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double, std::milli>{
+                          (static_cast<double>(ms) - anchor_ms) / rate});
+}
+
+Player::Player(const std::string &path, std::ostream &out,
+               const Options &opts)
+    : Player{std::vector<std::string>{path}, out, opts} {}
+
+Player::Player(const std::vector<std::string> &paths, std::ostream &out,
+               const Options &opts)
+    : paths{paths}, opts{opts}, out{&out} {
+  if (paths.empty()) throw std::runtime_error{"no video to play"};
+  // A playlist holds the next video alongside the one playing.
+  if ((paths.size() > 1) || this->opts.repeat) this->opts.memory_limit /= 2;
+  if (this->opts.decode_cpus.empty())
+    this->opts.decode_cpus = realtime::cpus(pthread_self());
+  lateness.reserve(max_lateness_samples);
+  ahead = std::make_unique<DecodeAhead>(paths.front(), this->opts);
+  st.decode_pinned = ahead->decode_pinned();
+  start_preload();
+}
+
+void Player::start_preload() {
+  auto next{current + 1};
+  if ((next == paths.size()) && opts.repeat) next = 0;
+  if (next == paths.size()) return;
+
+  preload = std::async(std::launch::async, [this, path{paths[next]}]() {
+    to_decode_cpus(pthread_self(), opts);
+    auto start{Clock::now()};
+    auto a{std::make_unique<DecodeAhead>(path, opts)};
+    // Done once the first frame to be shown is decoded.
+    a->wait_next(start + std::chrono::seconds{10});
+    preload_ms =
+        std::chrono::duration<double, std::milli>{Clock::now() - start}.count();
+    return a;
+  });
+}
+
+void Player::hand_over(Clock::time_point at) {
+  auto wait_start{Clock::now()};
+  auto next{preload.get()};
+  Transition tn{};
+  tn.preload_ms = preload_ms;
+  tn.wait_ms =
+      std::chrono::duration<double, std::milli>{Clock::now() - wait_start}
+          .count();
+
+  st.skipped += ahead->frames_skipped();
+  st.decode_pinned = st.decode_pinned && next->decode_pinned();
+  {
+    std::lock_guard<std::mutex> lk{cm};
+    std::swap(ahead, next);
+    current = (current + 1) % paths.size();
+    // The next video starts as the last frame of this one ends.
+    tr.anchor = at;
+    tr.anchor_ms = 0;
+    tr.loop_from_ms = 0;
+    tr.loop_to_ms = -1;
+    awaiting.reset();
+  }
+  tn.path = paths[current];
+  st.transitions.push_back(tn);
+  handover = at;
+  start_preload();
+}
+
+void Player::write(const Frame &f, double position_ms) {
+  for (const auto &[u, data] : f.states) {
+    auto [it, added]{sent.try_emplace(u, data)};
+    if (!added && (it->second == data)) continue;
+    it->second = data;
+    io::write_chans(*out, u, data);
+  }
+  out->flush();
+  if (!*out) throw std::runtime_error{"writing universes"};
+
+  ++st.shown;
+  auto late{position_ms - f.pts_ms};
+  st.max_late_ms = std::max(st.max_late_ms, late);
+  if (lateness.size() < max_lateness_samples)
+    lateness.push_back(late);
+  else
+    lateness[lateness_next] = late;
+  lateness_next = (lateness_next + 1) % max_lateness_samples;
+  if (handover) {
+    st.transitions.back().late_ms =
+        std::chrono::duration<double, std::milli>{Clock::now() - *handover}
+            .count();
+    handover.reset();
+  }
+
+  std::lock_guard<std::mutex> lk{cm};
+  if (awaiting) {
+    auto ms{std::chrono::duration<double, std::milli>{Clock::now() - *awaiting}
+                .count()};
+    latencies.push_back(ms);
+    seek_latencies.push_back(ms);
+    awaiting.reset();
+  }
+}
+
+void Player::command(Clock::time_point t, bool output) {
+  issued = t;
+  issued_output = output;
+  ahead->wake();
+}
+
+void Player::relocate(std::int64_t ms, Clock::time_point t) {
+  ahead->seek(ms);
+  tr.anchor = t;
+  tr.anchor_ms = static_cast<double>(ms);
+}
+
+void Player::run(std::int64_t start_ms) {
+  auto allocations{memory::allocations()};
+  start_ms = std::max<std::int64_t>(0, start_ms);
+  {
+    std::lock_guard<std::mutex> lk{cm};
+    tr.anchor = Clock::now();
+    tr.anchor_ms = static_cast<double>(start_ms);
+    tr.paused = opts.paused;
+  }
+  if (start_ms > 0) ahead->seek(start_ms);
+
+  std::int64_t end_ms{start_ms};
+  std::int64_t stalled{-1};
+  while (true) {
+    auto now{Clock::now()};
+    Transport t;
+    {
+      std::lock_guard<std::mutex> lk{cm};
+      if (stop_requested) break;
+      if (issued) {
+        if (issued_output) {
+          awaiting = issued;
+        } else {
+          latencies.push_back(
+              std::chrono::duration<double, std::milli>{now - *issued}
+                  .count());
+        }
+        issued.reset();
+      }
+      if ((tr.loop_to_ms >= 0) && (tr.position(now) >= tr.loop_to_ms))
+        relocate(tr.loop_from_ms, now);
+      t = tr;
+    }
+
+    auto position{t.position(now)};
+    if (const auto *f{ahead->pick(position)}) {
+      write(*f, t.position(Clock::now()));
+      end_ms = f->pts_ms + f->duration_ms;
+    }
+
+    // Waits end early for the end of a loop region and for commands.
+    auto until = [&](std::int64_t ms) {
+      if (t.paused) return now + idle_wait;
+      if ((t.loop_to_ms >= 0) && (t.loop_to_ms < ms)) ms = t.loop_to_ms;
+      return t.time_of(ms);
+    };
+
+    bool ready;
+    auto next{ahead->next_pts(ready)};
+    if (ready) {
+      ahead->sleep_until(until(next));
+      continue;
+    }
+    if (!t.paused && (next >= 0) && (next != stalled) && (position >= next)) {
+      ++st.stalls;
+      stalled = next;
+    }
+
+    if ((next < 0) && ahead->ended()) {
+      if (!t.paused && (t.loop_to_ms < 0) && preload.valid()) {
+        // The first frame of the next video is due as the last frame of
+        // this one ends, and is waited for like any other frame.
+        hand_over(t.time_of(end_ms));
+        end_ms = 0;
+        stalled = -1;
+        continue;
+      }
+      {
+        std::lock_guard<std::mutex> lk{cm};
+        awaiting.reset();
+        // The last frame is shown for its duration.
+        if (!t.paused && (position >= end_ms)) {
+          if (tr.loop_to_ms >= 0) {
+            relocate(tr.loop_from_ms, now);
+            continue;
+          }
+          if (!opts.hold) break;
+        }
+      }
+      ahead->sleep_until((position >= end_ms) ? now + idle_wait
+                                              : until(end_ms));
+      continue;
+    }
+
+    ahead->wait_next(now + max_wait);
+  }
+
+  st.skipped += ahead->frames_skipped();
+  st.allocations += memory::allocations() - allocations;
+  auto samples{lateness};
+  st.lateness = bench::summarise(samples);
+}
+
+std::vector<memory::Component> Player::memory() {
+  auto components{ahead->memory()};
+  std::lock_guard<std::mutex> lk{cm};
+  components.push_back(
+      {"statistics", (lateness.capacity() + latencies.capacity() +
+                      seek_latencies.capacity()) *
+                         sizeof(double)});
+  components.push_back({"output states", sent.size() * memory::state_bytes});
+  return components;
+}
+
+void Player::play() {
+  auto now{Clock::now()};
+  std::lock_guard<std::mutex> lk{cm};
+  if (tr.paused) {
+    tr.anchor = now;
+    tr.paused = false;
+  }
+  command(now, false);
+}
+
+void Player::pause() {
+  auto now{Clock::now()};
+  std::lock_guard<std::mutex> lk{cm};
+  if (!tr.paused) {
+    tr.anchor_ms = tr.position(now);
+    tr.anchor = now;
+    tr.paused = true;
+  }
+  command(now, false);
+}
+
+void Player::seek(std::int64_t ms) {
+  auto now{Clock::now()};
+  std::lock_guard<std::mutex> lk{cm};
+  relocate(std::max<std::int64_t>(0, ms), now);
+  command(now, true);
+}
+
+void Player::set_rate(double rate) {
+  if (!(rate > 0) || !std::isfinite(rate))
+    throw std::runtime_error{"rate must be positive"};
+
+  auto now{Clock::now()};
+  std::lock_guard<std::mutex> lk{cm};
+  tr.anchor_ms = tr.position(now);
+  tr.anchor = now;
+  tr.rate = rate;
+  command(now, false);
+}
+
+void Player::loop(std::int64_t from_ms, std::int64_t to_ms) {
+  if ((to_ms >= 0) && ((from_ms < 0) || (to_ms <= from_ms)))
+    throw std::runtime_error{"empty loop region"};
+
+  auto now{Clock::now()};
+  std::lock_guard<std::mutex> lk{cm};
+  tr.loop_from_ms = (to_ms >= 0) ? from_ms : 0;
+  tr.loop_to_ms = (to_ms >= 0) ? to_ms : -1;
+  command(now, false);
+}
+
+void Player::stop() {
+  std::lock_guard<std::mutex> lk{cm};
+  stop_requested = true;
+  ahead->wake();
+}
+
+Status Player::status() {
+  auto now{Clock::now()};
+  std::lock_guard<std::mutex> lk{cm};
+  Status s{};
+  s.position_ms = tr.position(now);
+  s.rate = tr.rate;
+  s.paused = tr.paused;
+  s.loop_from_ms = tr.loop_from_ms;
+  s.loop_to_ms = tr.loop_to_ms;
+  return s;
+}
+
+bench::Latency Player::command_latency() {
+  std::vector<double> samples;
+  {
+    std::lock_guard<std::mutex> lk{cm};
+    samples = latencies;
+  }
+  return bench::summarise(samples);
+}
+
+bench::Latency Player::seek_latency() {
+  std::vector<double> samples;
+  {
+    std::lock_guard<std::mutex> lk{cm};
+    samples = seek_latencies;
+  }
+  return bench::summarise(samples);
+}
+}  // namespace player
+}  // namespace olavc
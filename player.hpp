@@ -0,0 +1,504 @@
+#ifndef PLAYER_HPP_INCLUDED
+#define PLAYER_HPP_INCLUDED
+
+#include <bench.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <decoder.hpp>
+#include <exception>
+#include <future>
+#include <io.hpp>
+#include <iostream>
+#include <memory>
+#include <memory.hpp>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace olavc {
+namespace player {
+/**
+ * Number of output delays kept for \c Stats::lateness .
+ */
+constexpr const std::size_t max_lateness_samples{1 << 16};
+
+/**
+ * Playback settings.
+ */
+struct Options {
+  /**
+   * Number of decoded frames held ahead of the output, at least \c 2 .
+   */
+  std::size_t pool_frames{32};
+  /**
+   * Number of frames decoded in parallel, \c 0 selects the hardware
+   * concurrency.
+   */
+  unsigned threads{0};
+  /**
+   * Number of decoder threads per stream and frame.
+   */
+  int decoder_threads{1};
+  /**
+   * Universes to play, empty for all.
+   */
+  std::set<std::uint32_t> universes;
+  /**
+   * Keep showing the last frame at the end of the video and wait for
+   * commands, instead of returning.
+   */
+  bool hold{false};
+  /**
+   * Start paused, for playback driven by commands.
+   */
+  bool paused{false};
+  /**
+   * Start again from the first video after the last one of a playlist.
+   */
+  bool repeat{false};
+  /**
+   * Allocate and touch every universe of every pooled frame before playing,
+   * so decoding never allocates or faults in frame memory.
+   */
+  bool prefault{false};
+  /**
+   * Memory the decoding of each video may use in bytes: its frame pool,
+   * packets and decoders, \c 0 for no limit. The pool and the number of
+   * threads are reduced to fit.
+   */
+  std::uint64_t memory_limit{0};
+  /**
+   * CPUs the reader and decoder threads run on, empty for those the player
+   * is created on.
+   *
+   * These threads run at normal priority even when started by an output
+   * thread running at real-time priority.
+   */
+  std::set<std::uint32_t> decode_cpus;
+};
+
+/**
+ * Decoded frame.
+ */
+struct Frame {
+  io::UniverseStates states;
+  std::int64_t pts_ms{};
+  std::int64_t duration_ms{};
+};
+
+/**
+ * Decodes a video ahead of its playback.
+ *
+ * A reader thread reads the packets of each frame in order into a bounded
+ * pool of frame slots, which decoder threads then decode in parallel. Every
+ * frame is a keyframe holding whole universes, so frames need not be decoded
+ * in order, and the output can skip frames it is too late for. The output
+ * only takes decoded frames by time and never waits for a decoder.
+ *
+ * Slot states and memory are reused, so nothing is allocated per frame once
+ * every slot has been used.
+ */
+class DecodeAhead {
+ private:
+  enum class State { free, read, decoding, ready };
+
+  struct Slot {
+    DMXVideoDecoder::FramePackets packets;
+    Frame frame;
+    State state{State::free};
+  };
+
+  DMXVideoDecoder::DMXVideoDecoder decoder;
+  std::vector<std::unique_ptr<DMXVideoDecoder::FrameDecoder>> decoders;
+  std::vector<Slot> slots;
+  std::mutex m;
+  std::condition_variable cv;
+  /**
+   * Sequence numbers of the next frame taken by the output, read by the
+   * reader and handed to a decoder thread. Frame \c n lives in slot
+   * \c n modulo the pool size.
+   */
+  std::uint64_t head{0};
+  std::uint64_t tail{0};
+  std::uint64_t next_decode{0};
+  std::size_t decoding{0};
+  bool held{false};
+  bool at_end{false};
+  bool seeking{false};
+  bool stopping{false};
+  bool woken{false};
+  std::int64_t seek_ms{0};
+  std::uint64_t skipped{0};
+  std::exception_ptr error;
+  std::vector<std::thread> threads;
+  bool pinned{true};
+
+  Slot &slot(std::uint64_t n) noexcept { return slots[n % slots.size()]; }
+  std::uint64_t next_index() const noexcept { return held ? head + 1 : head; }
+  void read_loop();
+  void decode_loop(DMXVideoDecoder::FrameDecoder &dec);
+  void fail();
+
+ public:
+  /**
+   * Opens a video and starts decoding from its beginning.
+   *
+   * \param path path of the video.
+   * \param opts playback settings.
+   * \throw std::runtime_error if the video cannot be decoded.
+   */
+  DecodeAhead(const std::string &path, const Options &opts = {});
+  DecodeAhead(DecodeAhead &d) = delete;
+  DecodeAhead(DecodeAhead &&d) = delete;
+  DecodeAhead &operator=(DecodeAhead &d) = delete;
+  DecodeAhead &operator=(DecodeAhead &&d) = delete;
+  ~DecodeAhead();
+
+  /**
+   * Takes the frame to show at a given time.
+   *
+   * Releases the frame taken before, and skips decoded frames that are
+   * already followed by another decoded frame due at \p position_ms .
+   *
+   * \param position_ms playback position in milliseconds.
+   * \return frame to show, valid until the next call to \c pick() ,
+   *         \c nullptr if no further frame is due and decoded.
+   * \throw std::runtime_error if reading or decoding failed.
+   */
+  const Frame *pick(double position_ms);
+
+  /**
+   * \param ready receives whether the frame is decoded.
+   * \return time of the frame after the one taken last, \c -1 if it was not
+   *         read yet.
+   */
+  std::int64_t next_pts(bool &ready);
+
+  /**
+   * Waits for the frame after the one taken last to be decoded.
+   *
+   * \param deadline time to give up waiting at.
+   */
+  void wait_next(std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * Waits for a deadline or a call to \c wake() , whichever is first.
+   *
+   * \param deadline time to give up waiting at.
+   */
+  void sleep_until(std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * Ends the current or next wait in \c wait_next() or \c sleep_until() .
+   */
+  void wake();
+
+  /**
+   * \return whether every frame of the video was taken.
+   */
+  bool ended();
+
+  /**
+   * Restarts decoding from another time.
+   *
+   * Frames decoded ahead are dropped, and waits are ended as by
+   * \c wake() .
+   *
+   * \param ms time to continue from.
+   */
+  void seek(std::int64_t ms);
+
+  /**
+   * \return number of decoded frames skipped.
+   */
+  std::uint64_t frames_skipped();
+
+  /**
+   * \return memory held by the frame pool, its packets and the decoders.
+   */
+  std::vector<memory::Component> memory();
+
+  /**
+   * \return whether the threads run on \c Options::decode_cpus , \c true
+   *         when no CPUs were chosen.
+   */
+  bool decode_pinned() const noexcept { return pinned; }
+
+  /**
+   * \return decoder reading the video, to be used for its properties only.
+   */
+  const DMXVideoDecoder::DMXVideoDecoder &video() const noexcept {
+    return decoder;
+  }
+};
+
+/**
+ * Handover from one video of a playlist to the next.
+ */
+struct Transition {
+  /**
+   * Path of the video handed over to.
+   */
+  std::string path;
+  /**
+   * Time taken to open the video and decode its first frames, in
+   * milliseconds.
+   */
+  double preload_ms{};
+  /**
+   * Time the output waited for the preload to finish, in milliseconds.
+   */
+  double wait_ms{};
+  /**
+   * Delay between the end of the last frame of the previous video and the
+   * first frame being written, in milliseconds.
+   */
+  double late_ms{};
+};
+
+/**
+ * Playback statistics.
+ */
+struct Stats {
+  /**
+   * Number of frames written.
+   */
+  std::uint64_t shown{};
+  /**
+   * Number of frames skipped as another frame was already due.
+   */
+  std::uint64_t skipped{};
+  /**
+   * Number of frames that were due before being decoded.
+   */
+  std::uint64_t stalls{};
+  /**
+   * Largest delay between a frame being due and being written in
+   * milliseconds.
+   */
+  double max_late_ms{};
+  /**
+   * Delay between frames being due and being written, over the last
+   * \c max_lateness_samples frames.
+   */
+  bench::Latency lateness;
+  /**
+   * Whether every decoding thread runs on \c Options::decode_cpus .
+   */
+  bool decode_pinned{true};
+  /**
+   * Number of C++ allocations made by the process while playing.
+   */
+  std::uint64_t allocations{};
+  /**
+   * Handovers between the videos of a playlist.
+   */
+  std::vector<Transition> transitions;
+};
+
+/**
+ * Transport state of a player.
+ */
+struct Status {
+  /**
+   * Playback position in milliseconds.
+   */
+  double position_ms{};
+  double rate{1};
+  bool paused{false};
+  /**
+   * Loop region, \c loop_to_ms is \c -1 when not looping.
+   */
+  std::int64_t loop_from_ms{0};
+  std::int64_t loop_to_ms{-1};
+};
+
+/**
+ * Plays a video in real time as OLA universe lines.
+ *
+ * Frames are written as lines formatted like showfile universe lines, one
+ * per universe that changed, when their presentation time is reached. This
+ * is the input format of the OLA streaming client.
+ *
+ * The transport can be controlled from other threads while \c run() plays.
+ * Commands end any wait of the output thread, so they take effect without
+ * waiting for the next frame.
+ */
+class Player {
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * Playback clock, running at \c rate from \c anchor_ms at \c anchor .
+   */
+  struct Transport {
+    Clock::time_point anchor;
+    double anchor_ms{};
+    double rate{1};
+    bool paused{false};
+    std::int64_t loop_from_ms{0};
+    std::int64_t loop_to_ms{-1};
+
+    double position(Clock::time_point t) const noexcept;
+    Clock::time_point time_of(std::int64_t ms) const noexcept;
+  };
+
+  std::vector<std::string> paths;
+  Options opts;
+  std::size_t current{0};
+  std::unique_ptr<DecodeAhead> ahead;
+  /**
+   * Next video of the playlist, opened and decoding in the background.
+   */
+  std::future<std::unique_ptr<DecodeAhead>> preload;
+  double preload_ms{};
+  /**
+   * End of the previous video, until the first frame of the next is written.
+   */
+  std::optional<Clock::time_point> handover;
+  std::ostream *out;
+  io::UniverseStates sent;
+  Stats st;
+  std::mutex cm;
+  Transport tr;
+  bool stop_requested{false};
+  /**
+   * Time the last command was issued at, if the output thread has not
+   * applied it yet, and whether it waits for a frame to be written.
+   */
+  std::optional<Clock::time_point> issued;
+  bool issued_output{false};
+  std::optional<Clock::time_point> awaiting;
+  std::vector<double> latencies;
+  std::vector<double> seek_latencies;
+  /**
+   * Output delays, overwritten in turn once full so the output thread never
+   * allocates.
+   */
+  std::vector<double> lateness;
+  std::size_t lateness_next{0};
+
+  void write(const Frame &f, double position_ms);
+  void command(Clock::time_point t, bool output);
+  void relocate(std::int64_t ms, Clock::time_point t);
+  void start_preload();
+  void hand_over(Clock::time_point at);
+
+ public:
+  /**
+   * \param path path of the video.
+   * \param out stream receiving universe lines.
+   * \param opts playback settings.
+   */
+  Player(const std::string &path, std::ostream &out, const Options &opts = {});
+
+  /**
+   * Plays a playlist.
+   *
+   * Each video is opened and starts decoding in the background while the
+   * one before it plays, and its first frame is shown as the last frame of
+   * the previous video ends.
+   *
+   * \param paths paths of the videos, in playing order.
+   * \param out stream receiving universe lines.
+   * \param opts playback settings.
+   * \throw std::runtime_error if \p paths is empty or the first video
+   *        cannot be decoded.
+   */
+  Player(const std::vector<std::string> &paths, std::ostream &out,
+         const Options &opts = {});
+  Player(Player &p) = delete;
+  Player &operator=(Player &p) = delete;
+
+  /**
+   * Plays the videos to their end, or until \c stop() is called if holding
+   * the last frame.
+   *
+   * Seeks, loop regions and the playback position are relative to the video
+   * being played.
+   *
+   * \param start_ms time to start playing at.
+   * \throw std::runtime_error if decoding or writing failed.
+   */
+  void run(std::int64_t start_ms = 0);
+
+  /**
+   * Resumes playback from the position it was paused at.
+   */
+  void play();
+
+  /**
+   * Stops the playback clock, keeping the frame shown.
+   */
+  void pause();
+
+  /**
+   * Continues playback at another time, showing the frame at that time
+   * even when paused.
+   *
+   * \param ms time to continue from.
+   */
+  void seek(std::int64_t ms);
+
+  /**
+   * Changes the playback speed.
+   *
+   * \param rate speed relative to real time.
+   * \throw std::runtime_error if \p rate is not positive.
+   */
+  void set_rate(double rate);
+
+  /**
+   * Repeats a region of the video, jumping back to its start when its end is
+   * reached or the video ends inside it.
+   *
+   * \param from_ms start of the region.
+   * \param to_ms end of the region, \c -1 to stop looping.
+   * \throw std::runtime_error if the region is empty.
+   */
+  void loop(std::int64_t from_ms, std::int64_t to_ms);
+
+  /**
+   * Makes \c run() return.
+   */
+  void stop();
+
+  /**
+   * \return transport state.
+   */
+  Status status();
+
+  /**
+   * Latency of commands, from being issued until their effect reached the
+   * output: a frame written for seeks, the output thread applying them for
+   * other commands.
+   *
+   * \return latency distribution.
+   */
+  bench::Latency command_latency();
+
+  /**
+   * \return latency distribution of seeks, as by \c command_latency() .
+   */
+  bench::Latency seek_latency();
+
+  /**
+   * \return memory held by the video being played and the statistics, not
+   *         to be called while \c run() plays.
+   */
+  std::vector<memory::Component> memory();
+
+  /**
+   * \return playback statistics.
+   */
+  const Stats &stats() const noexcept { return st; }
+};
+}  // namespace player
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,236 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <io.hpp>
+#include <prescan.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace olavc {
+namespace prescan {
+namespace {
+/**
+ * Read-only mapping of a whole file.
+ */
+class MappedFile {
+ private:
+  void *data{MAP_FAILED};
+  std::size_t size{};
+
+ public:
+  MappedFile(const std::string &path, bool read_ahead) {
+    auto fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd < 0) throw std::runtime_error{"could not open showfile"};
+
+    struct stat st {};
+    if (::fstat(fd, &st)) {
+      ::close(fd);
+      throw std::runtime_error{"reading showfile size"};
+    }
+
+    size = static_cast<std::size_t>(st.st_size);
+    if (size) data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (size && (data == MAP_FAILED))
+      throw std::runtime_error{"mapping showfile"};
+
+    // Scanned once from start to end.
+    if (size)
+      ::madvise(data, size,
+                MADV_SEQUENTIAL | (read_ahead ? MADV_WILLNEED : 0));
+  }
+  MappedFile(MappedFile &f) = delete;
+  MappedFile &operator=(MappedFile &f) = delete;
+  ~MappedFile() {
+    if (data != MAP_FAILED) ::munmap(data, size);
+  }
+
+  std::string_view view() const noexcept {
+    if (!size) return {};
+    return {static_cast<const char *>(data), size};
+  }
+};
+}  // namespace
+
+static bool is_space(char c) noexcept {
+  return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\v') ||
+         (c == '\f');
+}
+
+/**
+ * Byte mask with the high bit set in each byte of \p x equal to \p c .
+ */
+static std::uint64_t match_bytes(std::uint64_t x, unsigned char c) noexcept {
+  constexpr std::uint64_t low7{0x7f7f7f7f7f7f7f7f};
+  auto t{x ^ (c * 0x0101010101010101)};
+  return ~(((t & low7) + low7) | t | low7);
+}
+
+/**
+ * Checks a channel list the way \c io::ParseChans() would read it.
+ *
+ * Eight bytes are classified at a time with plain 64-bit arithmetic, which
+ * keeps the scan close to memory speed without depending on vector
+ * instruction sets or compiler flags.
+ *
+ * \return error message, \c nullptr if the list is well formed.
+ */
+static const char *check_chans(std::string_view s) noexcept {
+  constexpr std::uint64_t high{0x8080808080808080};
+  const auto *p{s.data()};
+  const auto n{s.size()};
+
+  std::uint64_t bad{};
+  std::uint64_t empty{};
+  std::size_t commas{};
+  // Whether the byte before the current word is a comma.
+  std::uint64_t carry{};
+  // Per-byte comma counts, summed before any byte can overflow.
+  std::uint64_t lanes{};
+  auto sum_lanes = [&commas, &lanes]() {
+    commas += (lanes * 0x0101010101010101) >> 56;
+    lanes = 0;
+  };
+  std::size_t i{};
+  for (unsigned words{}; (i + 8) <= n; i += 8) {
+    std::uint64_t x;
+    std::memcpy(&x, p + i, sizeof(x));
+    // Bytes below 0x80 do not carry into their neighbours here.
+    auto digit{(x + 0x5050505050505050) & ~(x + 0x4646464646464646)};
+    auto comma{match_bytes(x, ',')};
+    bad |= (x & high) | (~(digit | comma) & high);
+    // Little-endian: earlier bytes are less significant.
+    empty |= comma & ((comma << 8) | carry);
+    carry = comma >> 56;
+    lanes += comma >> 7;
+    if (++words == 255) {
+      sum_lanes();
+      words = 0;
+    }
+  }
+  sum_lanes();
+  for (; i < n; ++i) {
+    const auto c{static_cast<unsigned char>(p[i])};
+    const bool comma{c == ','};
+    bad |= (static_cast<unsigned char>(c - '0') > 9) && !comma;
+    empty |= comma && carry;
+    carry = comma ? 0x80 : 0;
+    commas += comma;
+  }
+
+  if (bad) return "channel undefined / has wrong format";
+  // A single trailing comma is accepted.
+  if (empty || (p[0] == ',')) return "channel undefined / has wrong format";
+  if ((commas + 1 - (p[n - 1] == ',')) > std::tuple_size_v<io::UniverseData>)
+    return "too many channels";
+  return nullptr;
+}
+
+/**
+ * Bytes scanned between charges to an I/O budget.
+ */
+static constexpr const std::size_t charge_bytes{1 << 20};
+
+Summary run(const std::string &path, std::size_t chunk_bytes,
+            budget::Limiter *limiter) {
+  MappedFile file{path, !limiter};
+  const auto data{file.view()};
+
+  Summary summary{};
+  summary.bytes = data.size();
+  summary.chunks.push_back({0, 0, 0});
+
+  auto fail = [&summary](const char *what) {
+    throw std::runtime_error{"line " + std::to_string(summary.lines) + ": " +
+                             what};
+  };
+
+  // io::read_frame() keeps only the last universe line before a duration.
+  bool pending{false};
+  std::uint32_t pending_universe{};
+  // Whether the next universe line starts a frame.
+  bool frame_start{false};
+  std::size_t pos{};
+  std::size_t charged{};
+  while (pos < data.size()) {
+    if (limiter && ((pos - charged) >= charge_bytes)) {
+      limiter->charge_read(pos - charged);
+      charged = pos;
+    }
+    const auto *nl{static_cast<const char *>(
+        std::memchr(data.data() + pos, '\n', data.size() - pos))};
+    const auto line_start{pos};
+    const auto line_end{nl ? static_cast<std::size_t>(nl - data.data())
+                           : data.size()};
+    auto line{data.substr(pos, line_end - pos)};
+    pos = line_end + 1;
+    ++summary.lines;
+
+    while (line.size() && is_space(line.front())) line.remove_prefix(1);
+    while (line.size() && is_space(line.back())) line.remove_suffix(1);
+    if (!line.size() || (line == io::show_header)) continue;
+
+    // Same split as io::read_frame().
+    auto space{line.find(' ')};
+    auto first{line.substr(0, space)};
+    std::uint32_t val;
+    if (std::from_chars(first.data(), first.data() + first.size(), val).ec !=
+        std::errc{})
+      fail("bad frame duration / universe number");
+
+    std::string_view chans{};
+    if (space != std::string_view::npos) {
+      chans = line.substr(line.find_first_not_of(' ', space));
+    }
+
+    if (chans.size()) {
+      if (const auto *err{check_chans(chans)}) fail(err);
+      if (frame_start &&
+          ((line_start - summary.chunks.back().offset) >= chunk_bytes))
+        summary.chunks.push_back(
+            {line_start, summary.frames, summary.duration_ms});
+      frame_start = false;
+      pending = true;
+      pending_universe = val;
+      continue;
+    }
+
+    if (!pending) fail("no frame before frame time");
+    summary.universes.insert(pending_universe);
+    pending = false;
+    if (!val) continue;
+
+    if (!summary.frames) summary.initial_universes = summary.universes.size();
+    ++summary.frames;
+    summary.duration_ms += val;
+    frame_start = true;
+  }
+
+  if (pending) {
+    summary.universes.insert(pending_universe);
+    if (!summary.frames) summary.initial_universes = summary.universes.size();
+    ++summary.frames;
+    summary.open_end = true;
+  }
+
+  return summary;
+}
+
+int check(const Summary &summary, int universes) {
+  if (universes <= 0) universes = static_cast<int>(summary.universes.size());
+  if (summary.universes.size() > static_cast<std::size_t>(universes))
+    throw std::runtime_error{"too many universes in showfile"};
+  if (summary.frames &&
+      (summary.initial_universes != static_cast<std::size_t>(universes)))
+    throw std::runtime_error{"universe state(s) undefined at encode"};
+
+  return universes;
+}
+}  // namespace prescan
+}  // namespace olavc
@@ -0,0 +1,114 @@
+#ifndef PRESCAN_HPP_INCLUDED
+#define PRESCAN_HPP_INCLUDED
+
+#include <budget.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace prescan {
+/**
+ * Default distance between chunk boundaries in bytes.
+ */
+static constexpr const std::size_t default_chunk_bytes{64 << 20};
+
+/**
+ * Start of a run of whole frames within a showfile.
+ */
+struct Chunk {
+  /**
+   * Byte offset of the first line of the chunk.
+   */
+  std::uint64_t offset;
+  /**
+   * Index of the first frame of the chunk.
+   */
+  std::size_t frame;
+  /**
+   * Time at which the first frame of the chunk is shown in milliseconds.
+   */
+  std::uint64_t time_ms;
+};
+
+/**
+ * Structure of a showfile as found by \c run() .
+ */
+struct Summary {
+  /**
+   * Size of the showfile in bytes.
+   */
+  std::uint64_t bytes{};
+  /**
+   * Number of lines in the showfile.
+   */
+  std::size_t lines{};
+  /**
+   * Number of frames a conversion writes, including a last frame without
+   * duration.
+   */
+  std::size_t frames{};
+  /**
+   * Sum of all frame durations in milliseconds, not counting the last frame
+   * if it has no duration.
+   */
+  std::uint64_t duration_ms{};
+  /**
+   * Whether the showfile ends with universe lines instead of a duration.
+   */
+  bool open_end{false};
+  /**
+   * Universes defined anywhere in the showfile.
+   */
+  std::set<std::uint32_t> universes;
+  /**
+   * Number of universes defined before the first frame is written.
+   */
+  std::size_t initial_universes{};
+  /**
+   * Frame boundaries splitting the showfile into runs of about equal size,
+   * starting with the beginning of the file.
+   *
+   * Universe states are carried over between frames, so a stage starting at
+   * a chunk other than the first needs the states current at its start.
+   */
+  std::vector<Chunk> chunks;
+};
+
+/**
+ * Checks the structure of a showfile without parsing channel values.
+ *
+ * The file is mapped into memory and scanned line by line. Lines are
+ * checked for the same structure \c io::read_frame() expects, and channel
+ * lists for characters other than digits and commas, empty values and
+ * more than 512 values. Channel values themselves are range-checked when
+ * the file is converted.
+ *
+ * \param path path of the showfile.
+ * \param chunk_bytes minimum distance between chunk boundaries in bytes.
+ * \param limiter I/O budget the scan is charged to, \c nullptr for none.
+ *                The file is then not read ahead in one go.
+ * \return structure of the showfile.
+ * \throw std::runtime_error naming the first malformed line.
+ */
+Summary run(const std::string &path,
+            std::size_t chunk_bytes = default_chunk_bytes,
+            budget::Limiter *limiter = nullptr);
+
+/**
+ * Checks that a showfile can be converted with a given universe count.
+ *
+ * \param summary structure of the showfile.
+ * \param universes number of universes the conversion expects, \c 0 to use
+ *                  all universes of the showfile.
+ * \return number of universes to convert.
+ * \throw std::runtime_error if the showfile holds more universes than
+ *        expected, or not all of them are defined by the first frame.
+ */
+int check(const Summary &summary, int universes);
+}  // namespace prescan
+}  // namespace olavc
+
+#endif
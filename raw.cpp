@@ -0,0 +1,193 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <raw.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace olavc {
+namespace raw {
+/**
+ * Per-frame header of YUV4MPEG2 streams.
+ *
+ * Never modified, so it can be spliced by reference like the frame buffers.
+ */
+static constexpr const char frame_header[]{"FRAME\n"};
+/**
+ * Pipe capacity requested for spliced output.
+ *
+ * Unprivileged processes may be limited to a smaller size, in which case the
+ * default capacity is kept.
+ */
+static constexpr const int target_pipe_bytes{1 << 20};
+/**
+ * Interval between checks of the pipe while waiting for it to drain, and
+ * number of checks without progress after which the reader is given up on.
+ */
+static constexpr const int drain_poll_ms{10};
+static constexpr const int drain_idle_polls{500};
+
+RawVideoWriter::RawVideoWriter(int universes, const std::string &path,
+                               Format format, unsigned fps)
+    : fd{-1},
+      owns_fd{path != "-"},
+      splice{false},
+      format{format},
+      fps{fps} {
+  if (universes <= 0) throw std::runtime_error{"non-positive universe count"};
+
+  fd = owns_fd ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0644)
+               : STDOUT_FILENO;
+  if (fd < 0) throw std::runtime_error{"opening raw output"};
+
+  const auto page{static_cast<std::size_t>(sysconf(_SC_PAGESIZE))};
+  frame_bytes = static_cast<std::size_t>(io::frame_width) * universes;
+  slot_bytes = ((frame_bytes + page - 1) / page) * page;
+
+  struct stat st {};
+  std::size_t pipe_bytes{};
+  if (!fstat(fd, &st) && S_ISFIFO(st.st_mode)) {
+    fcntl(fd, F_SETPIPE_SZ, target_pipe_bytes);
+    auto sz{fcntl(fd, F_GETPIPE_SZ)};
+    if (sz > 0) {
+      splice = true;
+      pipe_bytes = sz;
+    }
+  }
+
+  // Each spliced page of a frame and each header takes up a pipe buffer, so
+  // after this many frames a buffer can no longer be referenced by the pipe.
+  slots = 1;
+  if (splice) {
+    auto pipe_bufs{pipe_bytes / page};
+    auto bufs_per_frame{(slot_bytes / page) +
+                        ((format == Format::y4m) ? 1 : 0)};
+    slots = ((pipe_bufs + bufs_per_frame - 1) / bufs_per_frame) + 2;
+  }
+
+  ring.reset(static_cast<std::uint8_t *>(
+      std::aligned_alloc(page, slot_bytes * slots)));
+  if (!ring) {
+    if (owns_fd) ::close(fd);
+    throw std::runtime_error{"allocating frame buffers"};
+  }
+
+  if (format == Format::y4m) {
+    auto header{"YUV4MPEG2 W" + std::to_string(io::frame_width) + " H" +
+                std::to_string(universes) + " F" +
+                std::to_string(fps ? fps : 1000) + ":1 Ip A1:1 Cmono\n"};
+    // Header is a temporary, so it must be copied.
+    iovec iov{header.data(), header.size()};
+    write_all(&iov, 1, false);
+  }
+}
+
+RawVideoWriter::~RawVideoWriter() {
+  try {
+    close();
+  } catch (const std::exception &) {
+  }
+}
+
+void RawVideoWriter::ensure_not_closed() {
+  if (closed) throw std::logic_error{"closed"};
+}
+
+void RawVideoWriter::write_all(iovec *iov, int iovcnt, bool by_reference) {
+  while (iovcnt) {
+    ssize_t ret;
+    if (splice && by_reference) {
+      ret = vmsplice(fd, iov, iovcnt, 0);
+      if ((ret < 0) && (errno == EINVAL)) {
+        // Not every pipe-like file supports splicing.
+        splice = false;
+        continue;
+      }
+    } else {
+      ret = writev(fd, iov, iovcnt);
+    }
+
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error{"writing raw output"};
+    }
+
+    auto done{static_cast<std::size_t>(ret)};
+    while (iovcnt && (done >= iov->iov_len)) {
+      done -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+      iov->iov_len -= done;
+    }
+  }
+}
+
+void RawVideoWriter::emit(const std::uint8_t *frame, std::uint64_t repeat) {
+  for (std::uint64_t i{}; i < repeat; ++i) {
+    iovec iov[2];
+    int iovcnt{};
+    if (format == Format::y4m)
+      iov[iovcnt++] = {const_cast<char *>(frame_header),
+                       sizeof(frame_header) - 1};
+    iov[iovcnt++] = {const_cast<std::uint8_t *>(frame), frame_bytes};
+    write_all(iov, iovcnt, true);
+  }
+}
+
+void RawVideoWriter::write_universe(const io::UniverseStates &sts,
+                                    std::uint64_t duration) {
+  ensure_not_closed();
+
+  std::uint64_t repeat{1};
+  time_ms += duration;
+  if (fps) {
+    // Output frame k is shown at k / fps seconds; emit every frame due
+    // before the end of this one.
+    auto due{((time_ms * fps) + 999) / 1000};
+    repeat = due - out_frames;
+    out_frames = due;
+  }
+  // Slots are only safe to reuse after enough frames were emitted, so frames
+  // that are never emitted must not take one.
+  if (!repeat) return;
+
+  auto *slot{ring.get() + (next_slot * slot_bytes)};
+  next_slot = (next_slot + 1) % slots;
+  io::write_lines(slot, io::frame_width, sts);
+
+  emit(slot, repeat);
+}
+
+void RawVideoWriter::close() {
+  if (closed) return;
+
+  closed = true;
+
+  if (splice) {
+    // The pipe references the ring until the reader drains it. Readers that
+    // stop draining are given up on.
+    int queued;
+    int last{-1};
+    int idle_polls{0};
+    while (!ioctl(fd, FIONREAD, &queued) && (queued > 0) &&
+           (idle_polls < drain_idle_polls)) {
+      idle_polls = (queued == last) ? idle_polls + 1 : 0;
+      last = queued;
+      pollfd p{fd, 0, 0};
+      poll(&p, 1, drain_poll_ms);
+      if (p.revents & (POLLERR | POLLHUP)) break;
+    }
+  }
+
+  if (owns_fd && ::close(fd)) throw std::runtime_error{"closing raw output"};
+}
+}  // namespace raw
+}  // namespace olavc
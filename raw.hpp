@@ -0,0 +1,90 @@
+#ifndef RAW_HPP_INCLUDED
+#define RAW_HPP_INCLUDED
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <io.hpp>
+#include <memory>
+#include <sink.hpp>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace raw {
+/**
+ * Layout of the uncompressed output stream.
+ */
+enum class Format {
+  /**
+   * YUV4MPEG2 stream with the \c mono colour space.
+   */
+  y4m,
+  /**
+   * Bare GRAY8 frames written back to back.
+   */
+  gray8,
+};
+
+struct FreeDeleter {
+  void operator()(void *p) const noexcept { std::free(p); }
+};
+
+/**
+ * Writes assembled frames without encoding them.
+ *
+ * Frames are assembled into a ring of page-aligned buffers. If the output is
+ * a pipe, the buffers are handed to the kernel with \c vmsplice() instead of
+ * being copied. The ring is sized so that a buffer is only reused once
+ * the pipe can no longer hold references to it. Other outputs fall back to
+ * \c writev() .
+ */
+class RawVideoWriter : public FrameSink {
+ private:
+  int fd;
+  bool owns_fd;
+  bool splice;
+  Format format;
+  unsigned fps;
+  std::size_t frame_bytes;
+  std::size_t slot_bytes;
+  std::size_t slots;
+  std::unique_ptr<std::uint8_t, FreeDeleter> ring;
+  std::size_t next_slot{0};
+  std::uint64_t time_ms{0};
+  std::uint64_t out_frames{0};
+  bool closed{false};
+
+  void ensure_not_closed();
+  void emit(const std::uint8_t *frame, std::uint64_t repeat);
+  void write_all(iovec *iov, int iovcnt, bool by_reference);
+
+ public:
+  /**
+   * Opens a raw output.
+   *
+   * \param universes number of universes (frame height).
+   * \param path path of the output file or FIFO, \c - for standard output.
+   * \param format stream layout.
+   * \param fps constant output frame rate, frames are repeated or dropped to
+   *            follow the frame durations. \c 0 writes every frame exactly
+   *            once, discarding timing.
+   */
+  RawVideoWriter(int universes, const std::string &path, Format format,
+                 unsigned fps = 0);
+  RawVideoWriter(RawVideoWriter &w) = delete;
+  RawVideoWriter(RawVideoWriter &&w) = delete;
+  RawVideoWriter &operator=(RawVideoWriter &w) = delete;
+  RawVideoWriter &operator=(RawVideoWriter &&w) = delete;
+  ~RawVideoWriter() override;
+
+  void write_universe(const io::UniverseStates &sts,
+                      std::uint64_t duration) override;
+  void close() override;
+};
+}  // namespace raw
+}  // namespace olavc
+
+#endif
@@ -0,0 +1,179 @@
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <realtime.hpp>
+#include <streambuf>
+#include <string_view>
+
+namespace olavc {
+namespace realtime {
+namespace {
+/**
+ * Stream buffer discarding everything written to it.
+ */
+class Discard : public std::streambuf {
+ protected:
+  int overflow(int c) override { return traits_type::not_eof(c); }
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    return n;
+  }
+};
+
+std::string format_cpus(const std::set<std::uint32_t> &cpus) {
+  if (cpus.empty()) return "-";
+  std::string s;
+  for (auto c : cpus) s += (s.size() ? "+" : "") + std::to_string(c);
+  return s;
+}
+}  // namespace
+
+int lock_memory() noexcept {
+  return mlockall(MCL_CURRENT | MCL_FUTURE) ? errno : 0;
+}
+
+void unlock_memory() noexcept { munlockall(); }
+
+int pin(std::thread::native_handle_type t,
+        const std::set<std::uint32_t> &cpus) noexcept {
+  if (cpus.empty()) return 0;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto c : cpus) {
+    if (c >= CPU_SETSIZE) return EINVAL;
+    CPU_SET(c, &set);
+  }
+  return pthread_setaffinity_np(t, sizeof(set), &set);
+}
+
+std::set<std::uint32_t> cpus(std::thread::native_handle_type t) {
+  std::set<std::uint32_t> s;
+  cpu_set_t set;
+  if (pthread_getaffinity_np(t, sizeof(set), &set)) return s;
+  for (std::uint32_t c{0}; c < CPU_SETSIZE; ++c) {
+    if (CPU_ISSET(c, &set)) s.insert(c);
+  }
+  return s;
+}
+
+int set_priority(std::thread::native_handle_type t, int priority) noexcept {
+  sched_param sp{};
+  sp.sched_priority = priority;
+  return pthread_setschedparam(t, priority ? SCHED_FIFO : SCHED_OTHER, &sp);
+}
+
+std::uint64_t huge_pages_kb() {
+  std::ifstream smaps{"/proc/self/smaps_rollup"};
+  constexpr const std::string_view key{"AnonHugePages:"};
+  for (std::string line; std::getline(smaps, line);) {
+    if (line.compare(0, key.size(), key)) continue;
+    try {
+      return std::stoull(line.substr(key.size()));
+    } catch (const std::exception &) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+std::vector<Mode> standard_modes(std::set<std::uint32_t> output_cpus,
+                                 int priority) {
+  auto n{std::thread::hardware_concurrency()};
+  if (output_cpus.empty() && (n > 1)) output_cpus.insert(n - 1);
+  std::set<std::uint32_t> decode_cpus;
+  for (std::uint32_t c{0}; c < n; ++c) {
+    if (!output_cpus.count(c)) decode_cpus.insert(c);
+  }
+
+  std::vector<Mode> modes(4);
+  modes[0].name = "default";
+  modes[1].name = "locked";
+  modes[1].lock_memory = true;
+  modes[2] = modes[1];
+  modes[2].name = "pinned";
+  modes[2].output_cpus = output_cpus;
+  modes[2].decode_cpus = decode_cpus;
+  modes[3] = modes[2];
+  modes[3].name = "fifo";
+  modes[3].priority = priority;
+  return modes;
+}
+
+std::vector<ModeResult> compare(const std::string &path,
+                                const player::Options &opts,
+                                const std::vector<Mode> &modes,
+                                std::int64_t duration_ms) {
+  std::vector<ModeResult> results;
+  for (const auto &mode : modes) {
+    ModeResult r{};
+    r.mode = mode;
+    if (mode.lock_memory && lock_memory()) r.applied = false;
+
+    auto popts{opts};
+    popts.prefault = mode.lock_memory;
+    popts.decode_cpus = mode.decode_cpus;
+    popts.hold = false;
+    popts.paused = false;
+    popts.repeat = false;
+
+    Discard buf;
+    std::ostream null{&buf};
+    try {
+      player::Player p{path, null, popts};
+      if (!p.stats().decode_pinned) r.applied = false;
+
+      std::promise<void> done;
+      auto finished{done.get_future()};
+      std::thread out{[&]() {
+        if (pin(pthread_self(), mode.output_cpus) ||
+            set_priority(pthread_self(), mode.priority))
+          r.applied = false;
+        try {
+          p.run();
+          done.set_value();
+        } catch (...) {
+          done.set_exception(std::current_exception());
+        }
+      }};
+      finished.wait_for(std::chrono::milliseconds{duration_ms});
+      p.stop();
+      out.join();
+      finished.get();
+
+      const auto &st{p.stats()};
+      r.shown = st.shown;
+      r.skipped = st.skipped;
+      r.stalls = st.stalls;
+      r.lateness = st.lateness;
+    } catch (...) {
+      if (mode.lock_memory) unlock_memory();
+      throw;
+    }
+    if (mode.lock_memory) unlock_memory();
+    results.push_back(r);
+  }
+  return results;
+}
+
+void write_report(std::ostream &s, const std::vector<ModeResult> &results) {
+  s << "mode\tapplied\tlock_memory\toutput_cpus\tdecode_cpus\tpriority"
+       "\tshown\tskipped\tstalls\tlate_p50_ms\tlate_p90_ms\tlate_p99_ms"
+       "\tlate_max_ms\n";
+  for (const auto &r : results) {
+    s << r.mode.name << '\t' << (r.applied ? "yes" : "no") << '\t'
+      << (r.mode.lock_memory ? "yes" : "no") << '\t'
+      << format_cpus(r.mode.output_cpus) << '\t'
+      << format_cpus(r.mode.decode_cpus) << '\t' << r.mode.priority << '\t'
+      << r.shown << '\t' << r.skipped << '\t' << r.stalls;
+    bench::write_latency(s, r.lateness);
+    s << '\n';
+  }
+}
+}  // namespace realtime
+}  // namespace olavc
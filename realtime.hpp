@@ -0,0 +1,134 @@
+#ifndef REALTIME_HPP_INCLUDED
+#define REALTIME_HPP_INCLUDED
+
+#include <bench.hpp>
+#include <cstdint>
+#include <iostream>
+#include <player.hpp>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace olavc {
+namespace realtime {
+/**
+ * Locks all memory of the process into RAM, including memory mapped later,
+ * so it is never paged out and faulted back in.
+ *
+ * \return \c 0 , or the error number if memory could not be locked.
+ */
+int lock_memory() noexcept;
+
+/**
+ * Undoes \c lock_memory() .
+ */
+void unlock_memory() noexcept;
+
+/**
+ * Restricts a thread to some CPUs.
+ *
+ * \param t thread to restrict.
+ * \param cpus CPUs to run on, empty to leave the thread as it is.
+ * \return \c 0 , or the error number if the thread could not be restricted.
+ */
+int pin(std::thread::native_handle_type t,
+        const std::set<std::uint32_t> &cpus) noexcept;
+
+/**
+ * \param t thread.
+ * \return CPUs \p t may run on, empty if unknown.
+ */
+std::set<std::uint32_t> cpus(std::thread::native_handle_type t);
+
+/**
+ * Runs a thread at a \c SCHED_FIFO real-time priority, preempting all
+ * threads of normal priority.
+ *
+ * \param t thread to schedule.
+ * \param priority priority from \c 1 to \c 99 , \c 0 for normal scheduling.
+ * \return \c 0 , or the error number if the priority could not be set.
+ */
+int set_priority(std::thread::native_handle_type t, int priority) noexcept;
+
+/**
+ * \return anonymous memory of the process on transparent hugepages in
+ *         kilobytes, \c 0 if unknown.
+ */
+std::uint64_t huge_pages_kb();
+
+/**
+ * Real-time settings of a playback.
+ */
+struct Mode {
+  std::string name;
+  /**
+   * Lock memory and prefault the frame pool.
+   */
+  bool lock_memory{false};
+  /**
+   * CPUs of the output thread, and of the reader and decoder threads.
+   */
+  std::set<std::uint32_t> output_cpus;
+  std::set<std::uint32_t> decode_cpus;
+  /**
+   * \c SCHED_FIFO priority of the output thread, \c 0 for none.
+   */
+  int priority{0};
+};
+
+/**
+ * Output timing of a playback in one mode.
+ */
+struct ModeResult {
+  Mode mode;
+  /**
+   * Whether all of the mode's settings could be applied.
+   */
+  bool applied{true};
+  std::uint64_t shown{};
+  std::uint64_t skipped{};
+  std::uint64_t stalls{};
+  /**
+   * Delay between frames being due and being written.
+   */
+  bench::Latency lateness;
+};
+
+/**
+ * \param output_cpus CPUs of the output thread, empty to pick the last CPU.
+ * \param priority \c SCHED_FIFO priority of the output thread.
+ * \return modes adding memory locking, CPU pinning and real-time priority
+ *         in turn, starting from none. Decoding runs on the CPUs left over
+ *         by the output thread.
+ */
+std::vector<Mode> standard_modes(std::set<std::uint32_t> output_cpus,
+                                 int priority);
+
+/**
+ * Plays the start of a video once per mode, discarding the output, to
+ * compare output timing between modes.
+ *
+ * \param path path of the video.
+ * \param opts playback settings shared by all modes.
+ * \param modes modes to play in.
+ * \param duration_ms time to play in each mode.
+ * \return output timing of each mode.
+ * \throw std::runtime_error if the video cannot be played.
+ */
+std::vector<ModeResult> compare(const std::string &path,
+                                const player::Options &opts,
+                                const std::vector<Mode> &modes,
+                                std::int64_t duration_ms);
+
+/**
+ * Writes a tab-separated report with a line per mode.
+ *
+ * \param s stream to write to.
+ * \param results output timing to report.
+ */
+void write_report(std::ostream &s, const std::vector<ModeResult> &results);
+}  // namespace realtime
+}  // namespace olavc
+
+#endif
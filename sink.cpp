@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <atomic>
+#include <sink.hpp>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace olavc {
+ResampleSink::ResampleSink(std::unique_ptr<FrameSink> inner, unsigned fps)
+    : inner{std::move(inner)}, fps{fps} {
+  if (!fps) throw std::runtime_error{"zero resampling frame rate"};
+}
+
+void ResampleSink::write_universe(const io::UniverseStates &sts,
+                                  std::uint64_t duration) {
+  auto end{time_ms + duration};
+  for (; frame_start(next_frame) < end; ++next_frame) {
+    inner->write_universe(
+        sts, frame_start(next_frame + 1) - frame_start(next_frame));
+  }
+  time_ms = end;
+}
+
+void ResampleSink::close() { inner->close(); }
+
+FilterSink::FilterSink(std::unique_ptr<FrameSink> inner,
+                       std::set<std::uint32_t> universes)
+    : inner{std::move(inner)}, universes{std::move(universes)} {}
+
+void FilterSink::write_universe(const io::UniverseStates &sts,
+                                std::uint64_t duration) {
+  for (auto u : universes) {
+    auto it{sts.find(u)};
+    if (it == sts.end())
+      throw std::runtime_error{"filtered universe " + std::to_string(u) +
+                               " not in showfile"};
+    subset[u] = it->second;
+  }
+
+  inner->write_universe(subset, duration);
+}
+
+void FilterSink::write_changed(const io::UniverseStates &sts,
+                               const std::vector<std::uint32_t> &changed,
+                               std::uint64_t duration) {
+  if (subset.empty()) {
+    write_universe(sts, duration);
+    return;
+  }
+
+  for (auto u : changed) {
+    auto it{subset.find(u)};
+    if (it != subset.end()) it->second = sts.at(u);
+  }
+
+  inner->write_changed(subset, changed, duration);
+}
+
+void FilterSink::close() { inner->close(); }
+
+std::shared_ptr<const io::UniverseStates> SnapshotPool::snapshot(
+    const io::UniverseStates &sts) {
+  for (auto &s : snaps) {
+    if (s.use_count() == 1) {
+      // Pairs with the release by the last sink dropping the snapshot.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      *s = sts;
+      return s;
+    }
+  }
+
+  snaps.emplace_back(std::make_shared<io::UniverseStates>(sts));
+  return snaps.back();
+}
+
+ThreadedSink::ThreadedSink(std::unique_ptr<FrameSink> inner, std::size_t depth)
+    : inner{std::move(inner)}, depth{std::max<std::size_t>(1, depth)} {
+  worker = std::thread{[this]() { run(); }};
+}
+
+ThreadedSink::~ThreadedSink() {
+  try {
+    close();
+  } catch (const std::exception &) {
+  }
+}
+
+void ThreadedSink::run() {
+  while (true) {
+    Item item;
+    {
+      std::unique_lock<std::mutex> lk{m};
+      cv.wait(lk, [this]() { return closing || !queue.empty(); });
+      if (queue.empty()) return;
+      item = std::move(queue.front());
+      queue.pop_front();
+    }
+    cv.notify_all();
+
+    try {
+      inner->write_universe(*item.states, item.duration);
+    } catch (...) {
+      std::lock_guard<std::mutex> lk{m};
+      error = std::current_exception();
+      queue.clear();
+      closing = true;
+      cv.notify_all();
+      return;
+    }
+  }
+}
+
+void ThreadedSink::rethrow() {
+  if (error) std::rethrow_exception(error);
+}
+
+void ThreadedSink::write_shared(std::shared_ptr<const io::UniverseStates> sts,
+                                std::uint64_t duration) {
+  std::unique_lock<std::mutex> lk{m};
+  if (closed) throw std::logic_error{"closed"};
+  cv.wait(lk, [this]() { return error || (queue.size() < depth); });
+  rethrow();
+  queue.push_back({std::move(sts), duration});
+  lk.unlock();
+  cv.notify_all();
+}
+
+void ThreadedSink::write_universe(const io::UniverseStates &sts,
+                                  std::uint64_t duration) {
+  write_shared(std::make_shared<const io::UniverseStates>(sts), duration);
+}
+
+void ThreadedSink::close() {
+  {
+    std::lock_guard<std::mutex> lk{m};
+    if (closed) return;
+    closed = true;
+    closing = true;
+  }
+  cv.notify_all();
+  worker.join();
+
+  rethrow();
+  inner->close();
+}
+}  // namespace olavc
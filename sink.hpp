@@ -0,0 +1,189 @@
+#ifndef SINK_HPP_INCLUDED
+#define SINK_HPP_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <io.hpp>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace olavc {
+/**
+ * Destination for assembled frames.
+ */
+class FrameSink {
+ public:
+  virtual ~FrameSink() = default;
+
+  /**
+   * Writes a frame holding the state of all universes.
+   *
+   * \param sts universe states.
+   * \param duration duration of the frame in milliseconds.
+   */
+  virtual void write_universe(const io::UniverseStates &sts,
+                              std::uint64_t duration) = 0;
+  /**
+   * Writes a frame of which only some universes changed since the previous
+   * frame written.
+   *
+   * Sinks keeping the previous frame around can update just the changed
+   * universes. The default implementation writes the whole frame.
+   *
+   * \param sts universe states.
+   * \param changed universes changed since the previous frame, in ascending
+   *                order. Ignored for the first frame.
+   * \param duration duration of the frame in milliseconds.
+   */
+  virtual void write_changed(
+      const io::UniverseStates &sts,
+      [[maybe_unused]] const std::vector<std::uint32_t> &changed,
+      std::uint64_t duration) {
+    write_universe(sts, duration);
+  }
+  /**
+   * Flushes and closes the sink. Further writes are invalid.
+   */
+  virtual void close() = 0;
+};
+
+/**
+ * Samples frames at a constant rate before passing them on.
+ *
+ * Output frame \c k holds the universe states current at \c k / \c fps
+ * seconds. Used to derive low-rate previews from a full-rate stream.
+ */
+class ResampleSink : public FrameSink {
+ private:
+  std::unique_ptr<FrameSink> inner;
+  unsigned fps;
+  std::uint64_t time_ms{0};
+  std::uint64_t next_frame{0};
+
+  std::uint64_t frame_start(std::uint64_t k) const noexcept {
+    return (k * 1000) / fps;
+  }
+
+ public:
+  /**
+   * \param inner sink receiving the sampled frames.
+   * \param fps output frame rate, must be non-zero.
+   */
+  ResampleSink(std::unique_ptr<FrameSink> inner, unsigned fps);
+
+  void write_universe(const io::UniverseStates &sts,
+                      std::uint64_t duration) override;
+  void close() override;
+};
+
+/**
+ * Passes on a fixed subset of universes.
+ */
+class FilterSink : public FrameSink {
+ private:
+  std::unique_ptr<FrameSink> inner;
+  std::set<std::uint32_t> universes;
+  io::UniverseStates subset;
+
+ public:
+  /**
+   * \param inner sink receiving the filtered frames.
+   * \param universes universes to keep. All of them must be present in
+   *                  every frame written.
+   */
+  FilterSink(std::unique_ptr<FrameSink> inner,
+             std::set<std::uint32_t> universes);
+
+  void write_universe(const io::UniverseStates &sts,
+                      std::uint64_t duration) override;
+  void write_changed(const io::UniverseStates &sts,
+                     const std::vector<std::uint32_t> &changed,
+                     std::uint64_t duration) override;
+  void close() override;
+};
+
+/**
+ * Recycles universe state snapshots handed to \c ThreadedSink s.
+ *
+ * A snapshot is reused once no sink references it anymore, so the map nodes
+ * are allocated once per stream instead of once per frame.
+ */
+class SnapshotPool {
+ private:
+  std::vector<std::shared_ptr<io::UniverseStates>> snaps;
+
+ public:
+  /**
+   * \param sts universe states to copy.
+   * \return immutable copy of \p sts .
+   */
+  std::shared_ptr<const io::UniverseStates> snapshot(
+      const io::UniverseStates &sts);
+
+  /**
+   * \return number of snapshots allocated.
+   */
+  std::size_t size() const noexcept { return snaps.size(); }
+};
+
+/**
+ * Runs another sink on a dedicated thread.
+ *
+ * Frames are passed through a bounded queue, so a slow sink applies
+ * backpressure instead of buffering without bound. Errors raised by the
+ * wrapped sink are rethrown by the next call to \c write_shared() ,
+ * \c write_universe() or \c close() .
+ */
+class ThreadedSink : public FrameSink {
+ private:
+  struct Item {
+    std::shared_ptr<const io::UniverseStates> states;
+    std::uint64_t duration;
+  };
+
+  std::unique_ptr<FrameSink> inner;
+  std::size_t depth;
+  std::mutex m;
+  std::condition_variable cv;
+  std::deque<Item> queue;
+  bool closing{false};
+  bool closed{false};
+  std::exception_ptr error;
+  std::thread worker;
+
+  void run();
+  void rethrow();
+
+ public:
+  /**
+   * \param inner sink to run.
+   * \param depth maximum number of queued frames.
+   */
+  ThreadedSink(std::unique_ptr<FrameSink> inner, std::size_t depth = 8);
+  ThreadedSink(ThreadedSink &s) = delete;
+  ThreadedSink(ThreadedSink &&s) = delete;
+  ThreadedSink &operator=(ThreadedSink &s) = delete;
+  ThreadedSink &operator=(ThreadedSink &&s) = delete;
+  ~ThreadedSink() override;
+
+  /**
+   * Queues a frame without copying it.
+   *
+   * \param sts universe states, must not be modified afterwards.
+   * \param duration duration of the frame in milliseconds.
+   */
+  void write_shared(std::shared_ptr<const io::UniverseStates> sts,
+                    std::uint64_t duration);
+  void write_universe(const io::UniverseStates &sts,
+                      std::uint64_t duration) override;
+  void close() override;
+};
+}  // namespace olavc
+
+#endif
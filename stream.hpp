@@ -0,0 +1,722 @@
+#ifndef STREAM_HPP_INCLUDED
+#define STREAM_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <io.hpp>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace olavc {
+namespace stream {
+/**
+ * Borrowed view of an assembled frame.
+ *
+ * Everything referenced by a view belongs to the stage that produced it and
+ * stays valid until that stage is advanced again.
+ */
+struct FrameView {
+  /**
+   * Universe states, possibly holding more universes than selected.
+   */
+  const io::UniverseStates *states{};
+  /**
+   * Universes making up the frame, \c nullptr for all of \c states .
+   */
+  const std::set<std::uint32_t> *selection{};
+  /**
+   * Universes changed since the previous frame of the same stream, in
+   * ascending order, \c nullptr if any may have changed.
+   *
+   * May list universes that are not selected.
+   */
+  const std::vector<std::uint32_t> *changed{};
+  /**
+   * Time at which the frame is shown in milliseconds.
+   */
+  std::uint64_t time_ms{};
+  /**
+   * Duration of the frame in milliseconds.
+   */
+  std::uint64_t duration_ms{};
+
+  /**
+   * \return whether universe \p u is part of the frame.
+   */
+  bool selected(std::uint32_t u) const {
+    return !selection || selection->count(u);
+  }
+
+  /**
+   * \return number of universes making up the frame.
+   */
+  std::size_t size() const {
+    return selection ? selection->size() : states->size();
+  }
+
+  /**
+   * Calls \p fn with the number and data of each universe of the frame, in
+   * ascending universe order.
+   *
+   * \throw std::runtime_error if a selected universe has no state.
+   */
+  template <typename Fn>
+  void for_each(Fn &&fn) const {
+    if (!selection) {
+      for (const auto &st : *states) fn(st.first, st.second);
+      return;
+    }
+
+    for (auto u : *selection) {
+      auto it{states->find(u)};
+      if (it == states->end())
+        throw std::runtime_error{"selected universe " + std::to_string(u) +
+                                 " not in stream"};
+      fn(u, it->second);
+    }
+  }
+
+  /**
+   * Copies the universes of the frame.
+   *
+   * Existing map nodes of \p out are reused where possible.
+   *
+   * \param out receives the universe states.
+   */
+  void copy_to(io::UniverseStates &out) const {
+    if (!selection) {
+      out = *states;
+      return;
+    }
+
+    if (out.size() != selection->size()) out.clear();
+    for_each([&out](auto u, const auto &data) { out[u] = data; });
+  }
+};
+
+/**
+ * Base of pull-based stream stages.
+ *
+ * A stage provides \c bool \c next() , which advances to the next element
+ * and returns \c false at the end of the stream, and \c frame() , which
+ * returns the current element. This base makes stages usable in range-based
+ * \c for loops. Stages are single-pass.
+ *
+ * \tparam Derived stage type.
+ */
+template <typename Derived>
+class Stage {
+ public:
+  class iterator {
+   private:
+    Derived *s{};
+
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(Derived *s) : s{s} {}
+
+    decltype(auto) operator*() const { return s->frame(); }
+    iterator &operator++() {
+      if (!s->next()) s = nullptr;
+      return *this;
+    }
+    bool operator==(const iterator &o) const noexcept { return s == o.s; }
+    bool operator!=(const iterator &o) const noexcept { return s != o.s; }
+  };
+
+  /**
+   * Advances to the first element.
+   */
+  iterator begin() {
+    auto *d{static_cast<Derived *>(this)};
+    return iterator{d->next() ? d : nullptr};
+  }
+  iterator end() { return {}; }
+};
+
+/**
+ * Assembles frames from an OLA showfile.
+ *
+ * Follows the rules of the converter: a frame is written at each non-zero
+ * duration, and a last frame without duration gets a fixed one.
+ */
+class ShowSource : public Stage<ShowSource> {
+ private:
+  std::istream *in;
+  std::size_t universes;
+  std::uint64_t last_duration;
+  io::LineCache cache;
+  bool use_cache;
+  io::OLAFrame rec;
+  io::UniverseStates states;
+  std::vector<std::uint32_t> changed;
+  std::uint64_t time_ms{0};
+  std::size_t lines{0};
+  bool first{true};
+  bool done{false};
+  FrameView view;
+
+ public:
+  /**
+   * \param in showfile to read.
+   * \param universes number of universes in every frame, \c 0 to not check.
+   * \param last_duration duration of the last frame if the showfile does not
+   *                      give one.
+   * \param line_cache whether to keep the last line of each universe, so
+   *                   repeated lines are not parsed again.
+   */
+  explicit ShowSource(std::istream &in, int universes = 0,
+                      std::uint64_t last_duration = 1, bool line_cache = true)
+      : in{&in},
+        universes{static_cast<std::size_t>(std::max(0, universes))},
+        last_duration{last_duration},
+        use_cache{line_cache} {}
+
+  /**
+   * \throw std::runtime_error on malformed input or, when checking the
+   *        universe count, too many or undefined universes.
+   */
+  bool next() {
+    if (done) return false;
+    changed.clear();
+
+    while (io::read_frame(*in, rec, use_cache ? &cache : nullptr) ||
+           (rec.duration_ms == -1)) {
+      ++lines;
+      // Repeated lines leave the universe state as it is.
+      if (!rec.unchanged) {
+        states[rec.universe] = rec.data;
+        changed.push_back(rec.universe);
+      }
+      if (universes && (states.size() > universes))
+        throw std::runtime_error{"too many universes in showfile"};
+
+      if (!rec.duration_ms) continue;
+
+      if (rec.duration_ms == -1) {
+        rec.duration_ms = last_duration;
+        done = true;
+      }
+
+      if (universes && (states.size() != universes))
+        throw std::runtime_error{"universe state(s) undefined at encode"};
+
+      std::sort(changed.begin(), changed.end());
+      changed.erase(std::unique(changed.begin(), changed.end()),
+                    changed.end());
+      view = {&states, nullptr, first ? nullptr : &changed, time_ms,
+              static_cast<std::uint64_t>(rec.duration_ms)};
+      time_ms += rec.duration_ms;
+      first = false;
+      return true;
+    }
+
+    if (!in->eof()) throw std::runtime_error{"reading showfile"};
+    done = true;
+    return false;
+  }
+
+  const FrameView &frame() const noexcept { return view; }
+
+  /**
+   * \return number of universe lines read so far.
+   */
+  std::size_t records() const noexcept { return lines; }
+};
+
+/**
+ * Restricts frames to a subset of universes without copying them.
+ */
+template <typename Src>
+class Filter : public Stage<Filter<Src>> {
+ private:
+  Src src;
+  std::set<std::uint32_t> universes;
+  bool first{true};
+  FrameView view;
+
+ public:
+  Filter(Src src, std::set<std::uint32_t> universes)
+      : src{std::move(src)}, universes{std::move(universes)} {}
+
+  bool next() {
+    if (!src.next()) return false;
+
+    view = src.frame();
+    if (first && view.selection) {
+      // Keep only universes selected by every stage.
+      std::set<std::uint32_t> both;
+      std::set_intersection(universes.begin(), universes.end(),
+                            view.selection->begin(), view.selection->end(),
+                            std::inserter(both, both.end()));
+      universes = std::move(both);
+    }
+    view.selection = &universes;
+    first = false;
+    return true;
+  }
+
+  const FrameView &frame() const noexcept { return view; }
+};
+
+/**
+ * Passes on the part of a stream between two times.
+ *
+ * Frames are clipped to the window and their times rebased to its start.
+ * The source is not read past the end of the window.
+ */
+template <typename Src>
+class Window : public Stage<Window<Src>> {
+ private:
+  Src src;
+  std::uint64_t from;
+  std::uint64_t to;
+  bool first{true};
+  FrameView view;
+
+ public:
+  /**
+   * \param src stream to take frames from.
+   * \param from start of the window in milliseconds.
+   * \param to end of the window in milliseconds, \c 0 for the end of the
+   *           stream.
+   */
+  Window(Src src, std::uint64_t from, std::uint64_t to = 0)
+      : src{std::move(src)},
+        from{from},
+        to{to ? to : std::numeric_limits<std::uint64_t>::max()} {}
+
+  bool next() {
+    while (src.next()) {
+      const auto &f{src.frame()};
+      const auto end{f.time_ms + f.duration_ms};
+      if (end <= from) continue;
+      if (f.time_ms >= to) return false;
+
+      const auto start{std::max(f.time_ms, from)};
+      view = f;
+      view.time_ms = start - from;
+      view.duration_ms = std::min(end, to) - start;
+      // Changes skipped before the window are not tracked.
+      if (first) view.changed = nullptr;
+      first = false;
+      return true;
+    }
+    return false;
+  }
+
+  const FrameView &frame() const noexcept { return view; }
+};
+
+/**
+ * Samples a stream at a constant frame rate.
+ *
+ * Output frame \c k holds the universe states current at \c k / \c fps
+ * seconds, as \c ResampleSink does.
+ */
+template <typename Src>
+class Resample : public Stage<Resample<Src>> {
+ private:
+  Src src;
+  unsigned fps;
+  std::uint64_t k{0};
+  std::uint64_t src_end{0};
+  bool have{false};
+  bool all_changed{true};
+  std::vector<std::uint32_t> changed;
+  std::vector<std::uint32_t> merged;
+  FrameView view;
+
+  std::uint64_t frame_start(std::uint64_t n) const noexcept {
+    return (n * 1000) / fps;
+  }
+
+  void add_changes(const FrameView &f) {
+    if (all_changed) return;
+    if (!f.changed) {
+      all_changed = true;
+      return;
+    }
+
+    merged.clear();
+    std::set_union(changed.begin(), changed.end(), f.changed->begin(),
+                   f.changed->end(), std::back_inserter(merged));
+    changed.swap(merged);
+  }
+
+ public:
+  /**
+   * \param src stream to sample.
+   * \param fps output frame rate, must be non-zero.
+   */
+  Resample(Src src, unsigned fps) : src{std::move(src)}, fps{fps} {
+    if (!fps) throw std::runtime_error{"zero resampling frame rate"};
+  }
+
+  bool next() {
+    if (k) {
+      changed.clear();
+      all_changed = false;
+    }
+
+    const auto t{frame_start(k)};
+    while (!have || (src_end <= t)) {
+      if (!src.next()) return false;
+      const auto &f{src.frame()};
+      src_end = f.time_ms + f.duration_ms;
+      have = true;
+      add_changes(f);
+    }
+
+    view = src.frame();
+    view.time_ms = t;
+    view.duration_ms = frame_start(k + 1) - t;
+    view.changed = all_changed ? nullptr : &changed;
+    ++k;
+    return true;
+  }
+
+  const FrameView &frame() const noexcept { return view; }
+};
+
+/**
+ * Combines two streams holding different universes into one.
+ *
+ * A frame is written whenever either stream changes. A stream that ends
+ * first keeps its last states until the other one ends. The combined
+ * states are updated in place from the changes of each stream.
+ */
+template <typename A, typename B>
+class Merge : public Stage<Merge<A, B>> {
+ private:
+  /**
+   * One of the merged streams.
+   */
+  template <typename Src>
+  struct Input {
+    Src src;
+    bool live{true};
+    std::uint64_t end{0};
+    std::set<std::uint32_t> owned;
+  };
+
+  Input<A> a;
+  Input<B> b;
+  bool started{false};
+  std::uint64_t time_ms{0};
+  io::UniverseStates states;
+  std::vector<std::uint32_t> changed;
+  FrameView view;
+
+  template <typename Src>
+  void advance(Input<Src> &in) {
+    if (!in.src.next()) {
+      in.live = false;
+      return;
+    }
+
+    const auto &f{in.src.frame()};
+    in.end = f.time_ms + f.duration_ms;
+    auto apply = [&](std::uint32_t u, const io::UniverseData &data) {
+      auto [it, inserted]{states.try_emplace(u, data)};
+      if (inserted) {
+        in.owned.insert(u);
+      } else if (!in.owned.count(u)) {
+        throw std::runtime_error{"universe " + std::to_string(u) +
+                                 " in both merged streams"};
+      } else {
+        it->second = data;
+      }
+      changed.push_back(u);
+    };
+
+    if (!f.changed) {
+      f.for_each(apply);
+      return;
+    }
+    for (auto u : *f.changed) {
+      if (!f.selected(u)) continue;
+      auto it{f.states->find(u)};
+      if (it != f.states->end()) apply(u, it->second);
+    }
+  }
+
+ public:
+  Merge(A a, B b) : a{std::move(a)}, b{std::move(b)} {}
+
+  bool next() {
+    changed.clear();
+    if (!started) {
+      advance(a);
+      advance(b);
+      started = true;
+    } else {
+      // Advance whichever streams ended with the previous frame.
+      const auto t{time_ms};
+      if (a.live && (a.end <= t)) advance(a);
+      if (b.live && (b.end <= t)) advance(b);
+    }
+    if (!a.live && !b.live) return false;
+
+    auto end{std::numeric_limits<std::uint64_t>::max()};
+    if (a.live) end = std::min(end, a.end);
+    if (b.live) end = std::min(end, b.end);
+
+    std::sort(changed.begin(), changed.end());
+    view = {&states, nullptr, &changed, time_ms, end - time_ms};
+    time_ms = end;
+    return true;
+  }
+
+  const FrameView &frame() const noexcept { return view; }
+};
+
+/**
+ * Combines any number of streams holding different universes into one.
+ *
+ * Works like \c Merge over a list of streams chosen at run time. The
+ * streams are kept in a heap ordered by the end of their current frames, so
+ * each frame only advances the streams whose frames ended there, and no
+ * stream is read ahead of the others. A stream that ends first keeps its
+ * last states until all of them ended.
+ */
+template <typename Src>
+class MergeAll : public Stage<MergeAll<Src>> {
+ private:
+  using Entry = std::pair<std::uint64_t, std::size_t>;
+
+  std::vector<Src> srcs;
+  std::vector<Entry> heap;
+  std::map<std::uint32_t, std::size_t> owner;
+  bool started{false};
+  std::uint64_t time_ms{0};
+  io::UniverseStates states;
+  std::vector<std::uint32_t> changed;
+  FrameView view;
+
+  void advance(std::size_t i) {
+    auto &src{srcs[i]};
+    if (!src.next()) return;
+
+    const auto &f{src.frame()};
+    auto apply = [&](std::uint32_t u, const io::UniverseData &data) {
+      auto [it, inserted]{owner.try_emplace(u, i)};
+      if (it->second != i) {
+        throw std::runtime_error{"universe " + std::to_string(u) +
+                                 " in merged streams " +
+                                 std::to_string(it->second) + " and " +
+                                 std::to_string(i)};
+      }
+      states[u] = data;
+      changed.push_back(u);
+    };
+
+    if (!f.changed) {
+      f.for_each(apply);
+    } else {
+      for (auto u : *f.changed) {
+        if (!f.selected(u)) continue;
+        auto it{f.states->find(u)};
+        if (it != f.states->end()) apply(u, it->second);
+      }
+    }
+
+    heap.emplace_back(f.time_ms + f.duration_ms, i);
+    std::push_heap(heap.begin(), heap.end(), std::greater<Entry>{});
+  }
+
+ public:
+  // Parentheses keep a vector of stages from becoming an initializer list.
+  explicit MergeAll(std::vector<Src> srcs) : srcs(std::move(srcs)) {
+    heap.reserve(this->srcs.size());
+  }
+
+  bool next() {
+    changed.clear();
+    if (!started) {
+      for (std::size_t i{}; i < srcs.size(); ++i) advance(i);
+      started = true;
+    } else {
+      // Advance whichever streams ended with the previous frame.
+      while (heap.size() && (heap.front().first <= time_ms)) {
+        auto i{heap.front().second};
+        std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>{});
+        heap.pop_back();
+        advance(i);
+      }
+    }
+    if (heap.empty()) return false;
+
+    const auto end{std::max(heap.front().first, time_ms)};
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    view = {&states, nullptr, &changed, time_ms, end - time_ms};
+    time_ms = end;
+    return true;
+  }
+
+  const FrameView &frame() const noexcept { return view; }
+};
+
+/**
+ * Stage of a type chosen at run time.
+ *
+ * Takes over any stage producing \c FrameView frames, at the cost of a
+ * virtual call per frame.
+ */
+class AnySource : public Stage<AnySource> {
+ private:
+  struct Concept {
+    virtual ~Concept() = default;
+    virtual bool next() = 0;
+    virtual const FrameView &frame() const noexcept = 0;
+  };
+
+  template <typename Src>
+  struct Model final : Concept {
+    Src src;
+
+    explicit Model(Src src) : src{std::move(src)} {}
+    bool next() override { return src.next(); }
+    const FrameView &frame() const noexcept override { return src.frame(); }
+  };
+
+  std::unique_ptr<Concept> src;
+
+ public:
+  AnySource() = default;
+  template <typename Src, typename = std::enable_if_t<
+                              !std::is_same_v<std::decay_t<Src>, AnySource>>>
+  AnySource(Src src)
+      : src{std::make_unique<Model<Src>>(std::move(src))} {}
+
+  bool next() { return src->next(); }
+  const FrameView &frame() const noexcept { return src->frame(); }
+};
+
+/**
+ * Frame copied out of a stream.
+ */
+struct Frame {
+  io::UniverseStates states;
+  std::uint64_t time_ms{};
+  std::uint64_t duration_ms{};
+};
+
+/**
+ * Run of consecutive frames handed out by \c Batch .
+ */
+struct FrameBatch {
+  const Frame *first{};
+  const Frame *last{};
+
+  const Frame *begin() const noexcept { return first; }
+  const Frame *end() const noexcept { return last; }
+  std::size_t size() const noexcept { return last - first; }
+};
+
+/**
+ * Groups consecutive frames, e.g. for stages working on several frames at
+ * once.
+ *
+ * Unlike the other stages, frames have to be copied since the source only
+ * holds one of them at a time. The copies are recycled between batches.
+ */
+template <typename Src>
+class Batch : public Stage<Batch<Src>> {
+ private:
+  Src src;
+  std::vector<Frame> frames;
+  FrameBatch current;
+
+ public:
+  /**
+   * \param src stream to group.
+   * \param size maximum number of frames per batch, must be non-zero.
+   */
+  Batch(Src src, std::size_t size) : src{std::move(src)}, frames(size) {
+    if (!size) throw std::runtime_error{"zero batch size"};
+  }
+
+  bool next() {
+    std::size_t n{};
+    for (; (n < frames.size()) && src.next(); ++n) {
+      const auto &f{src.frame()};
+      f.copy_to(frames[n].states);
+      frames[n].time_ms = f.time_ms;
+      frames[n].duration_ms = f.duration_ms;
+    }
+
+    current = {frames.data(), frames.data() + n};
+    return n > 0;
+  }
+
+  const FrameBatch &frame() const noexcept { return current; }
+};
+
+/**
+ * \return stage restricting \p src to \p universes .
+ */
+template <typename Src>
+Filter<Src> filter(Src src, std::set<std::uint32_t> universes) {
+  return {std::move(src), std::move(universes)};
+}
+
+/**
+ * \return stage passing on the part of \p src between \p from and \p to
+ *         milliseconds, see \c Window .
+ */
+template <typename Src>
+Window<Src> window(Src src, std::uint64_t from, std::uint64_t to = 0) {
+  return {std::move(src), from, to};
+}
+
+/**
+ * \return stage sampling \p src at \p fps frames per second.
+ */
+template <typename Src>
+Resample<Src> resample(Src src, unsigned fps) {
+  return {std::move(src), fps};
+}
+
+/**
+ * \return stage combining \p a and \p b .
+ */
+template <typename A, typename B>
+Merge<A, B> merge(A a, B b) {
+  return {std::move(a), std::move(b)};
+}
+
+/**
+ * \return stage combining all of \p srcs .
+ */
+template <typename Src>
+MergeAll<Src> merge_all(std::vector<Src> srcs) {
+  return MergeAll<Src>{std::move(srcs)};
+}
+
+/**
+ * \return stage grouping frames of \p src into batches of \p size .
+ */
+template <typename Src>
+Batch<Src> batch(Src src, std::size_t size) {
+  return {std::move(src), size};
+}
+}  // namespace stream
+}  // namespace olavc
+
+#endif
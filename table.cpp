@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <table.hpp>
+#include <thread_pool.hpp>
+#include <utility>
+#include <vector>
+
+#ifdef OLAVC_ARROW
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include <parquet/arrow/writer.h>
+#endif
+
+namespace olavc {
+namespace table {
+static constexpr const std::size_t chans{std::tuple_size_v<io::UniverseData>};
+
+Form parse_form(const std::string &name) {
+  if (name == "wide") return Form::wide;
+  if (name == "long") return Form::long_form;
+  throw std::runtime_error{"unknown table form " + name};
+}
+
+struct Chunk {
+  std::vector<std::uint64_t> time;
+  std::vector<std::uint64_t> duration;
+  std::vector<std::uint32_t> universe;
+  std::vector<std::uint8_t> channels;
+  /**
+   * Universe states before the first frame of the chunk, used to find the
+   * changes of the long form.
+   */
+  io::UniverseStates before;
+
+  std::size_t rows() const noexcept { return universe.size(); }
+};
+
+#ifdef OLAVC_ARROW
+bool available() noexcept { return true; }
+
+static void check(const arrow::Status &st) {
+  if (!st.ok()) throw std::runtime_error{"writing table: " + st.ToString()};
+}
+
+template <typename T>
+static T unwrap(arrow::Result<T> r) {
+  check(r.status());
+  return std::move(r).ValueUnsafe();
+}
+
+template <typename ArrayT, typename T>
+static std::shared_ptr<arrow::Array> column(std::vector<T> v) {
+  const auto n{static_cast<std::int64_t>(v.size())};
+  return std::make_shared<ArrayT>(n, arrow::Buffer::FromVector(std::move(v)));
+}
+
+static std::shared_ptr<arrow::Schema> schema(Form form) {
+  if (form == Form::wide) {
+    return arrow::schema(
+        {arrow::field("time_ms", arrow::uint64(), false),
+         arrow::field("duration_ms", arrow::uint64(), false),
+         arrow::field("universe", arrow::uint32(), false),
+         arrow::field("channels",
+                      arrow::fixed_size_list(arrow::uint8(), chans), false)});
+  }
+  return arrow::schema({arrow::field("time_ms", arrow::uint64(), false),
+                        arrow::field("universe", arrow::uint32(), false),
+                        arrow::field("channel", arrow::uint16(), false),
+                        arrow::field("value", arrow::uint8(), false)});
+}
+
+struct TableWriter::Output {
+  std::shared_ptr<arrow::Schema> schema;
+  std::shared_ptr<arrow::io::FileOutputStream> file;
+  std::shared_ptr<arrow::ipc::RecordBatchWriter> ipc;
+  std::unique_ptr<parquet::arrow::FileWriter> parquet;
+  ThreadPool pool;
+  std::size_t depth;
+  std::deque<std::future<std::shared_ptr<arrow::RecordBatch>>> inflight;
+
+  explicit Output(unsigned threads) : pool{threads}, depth{2 * pool.size()} {}
+
+  void write_front() {
+    auto batch{inflight.front().get()};
+    inflight.pop_front();
+    if (ipc) {
+      check(ipc->WriteRecordBatch(*batch));
+    } else {
+      auto t{unwrap(arrow::Table::FromRecordBatches({batch}))};
+      check(parquet->WriteTable(*t, batch->num_rows()));
+    }
+  }
+};
+
+/**
+ * Builds the record batch of a chunk, taking over its buffers.
+ */
+static std::shared_ptr<arrow::RecordBatch> build(
+    const std::shared_ptr<arrow::Schema> &sch, Form form, Chunk *c) {
+  const auto rows{static_cast<std::int64_t>(c->rows())};
+  if (form == Form::wide) {
+    auto values{column<arrow::UInt8Array>(std::move(c->channels))};
+    return arrow::RecordBatch::Make(
+        sch, rows,
+        {column<arrow::UInt64Array>(std::move(c->time)),
+         column<arrow::UInt64Array>(std::move(c->duration)),
+         column<arrow::UInt32Array>(std::move(c->universe)),
+         unwrap(arrow::FixedSizeListArray::FromArrays(values, chans))});
+  }
+
+  std::vector<std::uint64_t> time;
+  std::vector<std::uint32_t> universe;
+  std::vector<std::uint16_t> channel;
+  std::vector<std::uint8_t> value;
+  for (std::size_t r{}; r < c->rows(); ++r) {
+    const auto *row{c->channels.data() + (r * chans)};
+    auto [it, added]{c->before.try_emplace(c->universe[r])};
+    auto &prev{it->second};
+    for (std::size_t ch{}; ch < chans; ++ch) {
+      if (!added && (row[ch] == prev[ch])) continue;
+      time.push_back(c->time[r]);
+      universe.push_back(c->universe[r]);
+      channel.push_back(static_cast<std::uint16_t>(ch));
+      value.push_back(row[ch]);
+    }
+    std::copy(row, row + chans, prev.begin());
+  }
+
+  const auto n{static_cast<std::int64_t>(time.size())};
+  return arrow::RecordBatch::Make(
+      sch, n,
+      {column<arrow::UInt64Array>(std::move(time)),
+       column<arrow::UInt32Array>(std::move(universe)),
+       column<arrow::UInt16Array>(std::move(channel)),
+       column<arrow::UInt8Array>(std::move(value))});
+}
+
+TableWriter::TableWriter(const std::string &path, Container container,
+                         Form form, unsigned threads, std::size_t batch_rows)
+    : out{std::make_unique<Output>(threads)},
+      chunk{std::make_unique<Chunk>()},
+      form{form},
+      batch_rows{std::max<std::size_t>(batch_rows, 1)} {
+  out->schema = schema(form);
+  out->file = unwrap(arrow::io::FileOutputStream::Open(path));
+  if (container == Container::ipc) {
+    out->ipc = unwrap(arrow::ipc::MakeFileWriter(out->file, out->schema));
+  } else {
+    // Columns are encoded in parallel within each row group. The stored
+    // schema keeps the channel lists fixed-size when read back.
+    auto props{parquet::ArrowWriterProperties::Builder()
+                   .set_use_threads(true)
+                   ->store_schema()
+                   ->build()};
+    out->parquet = unwrap(parquet::arrow::FileWriter::Open(
+        *out->schema, arrow::default_memory_pool(), out->file,
+        parquet::default_writer_properties(), props));
+  }
+}
+
+void TableWriter::dispatch(const io::UniverseStates &sts) {
+  auto next{std::make_unique<Chunk>()};
+  if (form == Form::long_form) next->before = sts;
+  std::shared_ptr<Chunk> c{std::move(chunk)};
+  chunk = std::move(next);
+
+  out->inflight.emplace_back(
+      out->pool.submit([sch = out->schema, form = form, c]() {
+        return build(sch, form, c.get());
+      }));
+  while (out->inflight.size() > out->depth) out->write_front();
+}
+
+void TableWriter::close() {
+  if (closed) return;
+
+  closed = true;
+  std::exception_ptr error;
+  try {
+    if (chunk->rows()) dispatch({});
+    while (out->inflight.size()) out->write_front();
+    check(out->ipc ? out->ipc->Close() : out->parquet->Close());
+  } catch (...) {
+    error = std::current_exception();
+  }
+  // Batches still queued after an error are dropped.
+  for (auto &f : out->inflight) f.wait();
+  out->inflight.clear();
+  auto st{out->file->Close()};
+  if (error) std::rethrow_exception(error);
+  check(st);
+}
+#else
+bool available() noexcept { return false; }
+
+struct TableWriter::Output {};
+
+TableWriter::TableWriter([[maybe_unused]] const std::string &path,
+                         [[maybe_unused]] Container container, Form form,
+                         [[maybe_unused]] unsigned threads,
+                         std::size_t batch_rows)
+    : form{form}, batch_rows{batch_rows} {
+  throw std::runtime_error{"built without Arrow support"};
+}
+
+void TableWriter::dispatch([[maybe_unused]] const io::UniverseStates &sts) {}
+
+void TableWriter::close() { closed = true; }
+#endif
+
+TableWriter::~TableWriter() {
+  try {
+    close();
+  } catch (const std::exception &) {
+  }
+}
+
+void TableWriter::ensure_not_closed() {
+  if (closed) throw std::logic_error{"closed"};
+}
+
+void TableWriter::write_universe(const io::UniverseStates &sts,
+                                 std::uint64_t duration) {
+  ensure_not_closed();
+
+  auto &c{*chunk};
+  c.channels.resize((c.rows() + sts.size()) * chans);
+  auto *row{c.channels.data() + (c.rows() * chans)};
+  for (const auto &st : sts) {
+    c.time.push_back(time_ms);
+    c.duration.push_back(duration);
+    c.universe.push_back(st.first);
+    row = std::copy(st.second.begin(), st.second.end(), row);
+  }
+  time_ms += duration;
+
+  if (c.rows() >= batch_rows) dispatch(sts);
+}
+}  // namespace table
+}  // namespace olavc
@@ -0,0 +1,118 @@
+#ifndef TABLE_HPP_INCLUDED
+#define TABLE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <io.hpp>
+#include <memory>
+#include <sink.hpp>
+#include <string>
+
+namespace olavc {
+namespace table {
+/**
+ * Default number of rows per record batch or row group.
+ */
+static constexpr const std::size_t default_batch_rows{1 << 16};
+
+/**
+ * File format of an exported table.
+ */
+enum class Container {
+  /**
+   * Arrow IPC file (Feather v2).
+   */
+  ipc,
+  /**
+   * Parquet file, one row group per record batch.
+   */
+  parquet,
+};
+
+/**
+ * Shape of an exported table.
+ */
+enum class Form {
+  /**
+   * One row per universe and frame: \c time_ms , \c duration_ms ,
+   * \c universe and \c channels , a list of 512 values.
+   */
+  wide,
+  /**
+   * One row per channel change: \c time_ms , \c universe , \c channel and
+   * \c value . The first frame lists every channel of every universe.
+   */
+  long_form,
+};
+
+/**
+ * Parses a table form name.
+ *
+ * \param name \c wide or \c long .
+ * \return table form.
+ * \throw std::runtime_error if the name is unknown.
+ */
+Form parse_form(const std::string &name);
+
+/**
+ * \return whether table export was built in.
+ */
+bool available() noexcept;
+
+/**
+ * Frames waiting to become a record batch.
+ */
+struct Chunk;
+
+/**
+ * Exports frames as an Arrow table.
+ *
+ * Frames are copied into chunks of rows that are turned into record
+ * batches on a thread pool, which for the long form includes finding the
+ * changed channels. Batches are written in order as they complete, with a
+ * bounded number of chunks in flight, so memory use does not grow with the
+ * length of the show.
+ */
+class TableWriter : public FrameSink {
+ private:
+  struct Output;
+
+  std::unique_ptr<Output> out;
+  std::unique_ptr<Chunk> chunk;
+  Form form;
+  std::size_t batch_rows;
+  std::uint64_t time_ms{0};
+  bool closed{false};
+
+  void ensure_not_closed();
+  void dispatch(const io::UniverseStates &sts);
+
+ public:
+  /**
+   * Creates a table.
+   *
+   * \param path path of the output file.
+   * \param container file format.
+   * \param form table shape.
+   * \param threads number of threads building record batches, \c 0 selects
+   *                the hardware concurrency.
+   * \param batch_rows number of universe rows per record batch.
+   * \throw std::runtime_error if table export was not built in.
+   */
+  TableWriter(const std::string &path, Container container, Form form,
+              unsigned threads = 1,
+              std::size_t batch_rows = default_batch_rows);
+  TableWriter(TableWriter &w) = delete;
+  TableWriter(TableWriter &&w) = delete;
+  TableWriter &operator=(TableWriter &w) = delete;
+  TableWriter &operator=(TableWriter &&w) = delete;
+  ~TableWriter() override;
+
+  void write_universe(const io::UniverseStates &sts,
+                      std::uint64_t duration) override;
+  void close() override;
+};
+}  // namespace table
+}  // namespace olavc
+
+#endif
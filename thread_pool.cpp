@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <thread_pool.hpp>
+
+namespace olavc {
+namespace {
+/**
+ * Pool and deque index of the worker running on this thread, if any.
+ */
+thread_local const ThreadPool *current_pool{nullptr};
+thread_local std::size_t current_index{0};
+}  // namespace
+
+ThreadPool::ThreadPool(unsigned threads) {
+  if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned i{}; i < threads; ++i)
+    queues.emplace_back(std::make_unique<WorkQueue>());
+  for (unsigned i{}; i < threads; ++i)
+    workers.emplace_back([this, i]() { run(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lk{idle_m};
+    stopping = true;
+  }
+  idle_cv.notify_all();
+
+  for (auto &w : workers) w.join();
+}
+
+void ThreadPool::push(Task t) {
+  auto target{(current_pool == this)
+                  ? current_index
+                  : (next_queue.fetch_add(1) % queues.size())};
+  {
+    // Counted before the task becomes visible so a worker that steals it
+    // straight away never takes the counter below zero. Taken under idle_m
+    // so the increment cannot slip between a worker's predicate check and its
+    // wait.
+    std::lock_guard<std::mutex> lk{idle_m};
+    ++queued;
+  }
+  {
+    std::lock_guard<std::mutex> lk{queues[target]->m};
+    queues[target]->tasks.emplace_back(std::move(t));
+  }
+  idle_cv.notify_one();
+}
+
+bool ThreadPool::pop(std::size_t self, Task &t) {
+  {
+    auto &own{*queues[self]};
+    std::lock_guard<std::mutex> lk{own.m};
+    if (!own.tasks.empty()) {
+      t = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  for (std::size_t i{1}; i < queues.size(); ++i) {
+    auto &victim{*queues[(self + i) % queues.size()]};
+    std::lock_guard<std::mutex> lk{victim.m};
+    if (!victim.tasks.empty()) {
+      t = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::run(std::size_t self) {
+  current_pool = this;
+  current_index = self;
+
+  while (true) {
+    Task t;
+    if (pop(self, t)) {
+      --queued;
+      ++running;
+      t();
+      --running;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lk{idle_m};
+    idle_cv.wait(lk, [this]() { return stopping || queued.load(); });
+    if (stopping && !queued.load()) return;
+  }
+}
+}  // namespace olavc
@@ -0,0 +1,96 @@
+#ifndef THREAD_POOL_HPP_INCLUDED
+#define THREAD_POOL_HPP_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace olavc {
+/**
+ * Fixed-size work-stealing thread pool.
+ *
+ * Every worker owns a task deque. Tasks submitted from outside the pool are
+ * distributed round-robin across the deques, tasks submitted from a worker
+ * go to that worker's own deque. Workers pop from the back of their own deque
+ * and steal from the front of the others' when they run dry, so long-running
+ * tasks queued behind each other on one worker do not leave the rest idle.
+ */
+class ThreadPool {
+ private:
+  using Task = std::function<void()>;
+
+  struct WorkQueue {
+    std::mutex m;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> workers;
+  std::mutex idle_m;
+  std::condition_variable idle_cv;
+  std::atomic<std::size_t> queued{0};
+  std::atomic<std::size_t> running{0};
+  std::atomic<std::size_t> next_queue{0};
+  bool stopping{false};
+
+  void push(Task t);
+  bool pop(std::size_t self, Task &t);
+  void run(std::size_t self);
+
+ public:
+  /**
+   * Starts the pool.
+   *
+   * \param threads number of workers, \c 0 selects the hardware concurrency.
+   */
+  explicit ThreadPool(unsigned threads = 0);
+  ThreadPool(ThreadPool &p) = delete;
+  ThreadPool(ThreadPool &&p) = delete;
+  ThreadPool &operator=(ThreadPool &p) = delete;
+  ThreadPool &operator=(ThreadPool &&p) = delete;
+  /**
+   * Runs all queued tasks to completion, then joins the workers.
+   */
+  ~ThreadPool();
+
+  /**
+   * Queues a task.
+   *
+   * \param fn callable taking no arguments.
+   * \return future for the result of \p fn, carrying any exception thrown.
+   */
+  template <typename Fn>
+  auto submit(Fn &&fn) -> std::future<std::invoke_result_t<std::decay_t<Fn>>> {
+    using R = std::invoke_result_t<std::decay_t<Fn>>;
+    // std::function requires copyable targets, packaged_task is move-only.
+    auto task{std::make_shared<std::packaged_task<R()>>(std::forward<Fn>(fn))};
+    auto fut{task->get_future()};
+    push([task]() { (*task)(); });
+    return fut;
+  }
+
+  /**
+   * \return number of workers.
+   */
+  std::size_t size() const noexcept { return workers.size(); }
+  /**
+   * \return number of tasks queued but not yet started.
+   */
+  std::size_t pending() const noexcept { return queued.load(); }
+  /**
+   * \return number of tasks currently executing.
+   */
+  std::size_t active() const noexcept { return running.load(); }
+};
+}  // namespace olavc
+
+#endif
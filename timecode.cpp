@@ -0,0 +1,432 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <control.hpp>
+#include <cstring>
+#include <io.hpp>
+#include <stdexcept>
+#include <timecode.hpp>
+
+namespace olavc {
+namespace timecode {
+namespace {
+/**
+ * Gap between timecodes counted as a dropout, in frames.
+ */
+constexpr const double dropout_frames{4};
+
+int parse_field(std::string_view s) {
+  int v{};
+  auto rslt{std::from_chars(s.data(), s.data() + s.size(), v)};
+  if ((rslt.ec != std::errc{}) || (rslt.ptr != (s.data() + s.size())) ||
+      !s.size())
+    throw std::runtime_error{"bad timecode"};
+  return v;
+}
+
+double since_ms(std::chrono::steady_clock::time_point from,
+                std::chrono::steady_clock::time_point to) {
+  return std::chrono::duration<double, std::milli>{to - from}.count();
+}
+
+/**
+ * Keeps a sample in a ring of the last \c max_timecode_samples samples.
+ */
+void keep(std::vector<double> &ring, std::size_t &next, double v) {
+  if (ring.size() < max_timecode_samples)
+    ring.push_back(v);
+  else
+    ring[next] = v;
+  next = (next + 1) % max_timecode_samples;
+}
+}  // namespace
+
+double frame_ms(Rate r) noexcept {
+  switch (r) {
+    case Rate::fps24:
+      return 1000.0 / 24;
+    case Rate::fps2997_drop:
+      return 1001.0 / 30;
+    case Rate::fps30:
+      return 1000.0 / 30;
+    case Rate::fps25:
+    default:
+      return 40;
+  }
+}
+
+double to_ms(int h, int m, int s, int f, Rate r) noexcept {
+  if (r == Rate::fps2997_drop) {
+    // Frame numbers 0 and 1 are skipped every minute except every tenth.
+    auto minutes{(60 * h) + m};
+    auto frames{(((3600 * h) + (60 * m) + s) * 30) + f -
+                (2 * (minutes - (minutes / 10)))};
+    return frames * frame_ms(r);
+  }
+  return ((((60.0 * h) + m) * 60) + s) * 1000 + (f * frame_ms(r));
+}
+
+Rate parse_rate(std::string_view s) {
+  if (s == "24") return Rate::fps24;
+  if (s == "25") return Rate::fps25;
+  if (s == "29.97") return Rate::fps2997_drop;
+  if (s == "30") return Rate::fps30;
+  throw std::runtime_error{"bad frame rate"};
+}
+
+double parse_text(std::string_view s, Rate r) {
+  s = io::trim(s);
+  if (s.find(':') == std::string_view::npos) return parse_field(s);
+
+  int fields[4]{};
+  for (int i{0}; i < 4; ++i) {
+    auto end{std::min(s.size(), s.find_first_of(":;"))};
+    if ((i < 3) == (end == s.size())) throw std::runtime_error{"bad timecode"};
+    fields[i] = parse_field(s.substr(0, end));
+    s.remove_prefix(std::min(s.size(), end + 1));
+  }
+  return to_ms(fields[0], fields[1], fields[2], fields[3], r);
+}
+
+std::optional<double> MTCParser::feed(std::uint8_t b) {
+  // Real-time messages may appear anywhere, even inside other messages.
+  if (b >= 0xf8) return {};
+
+  if (in_sysex) {
+    if (b == 0xf7) {
+      in_sysex = false;
+      // F0 7F <device> 01 01 hr mn sc fr F7
+      if ((sysex.size() != 8) || (sysex[0] != 0x7f) || (sysex[2] != 0x01) ||
+          (sysex[3] != 0x01))
+        return {};
+      seen = 0;
+      next_piece = 0;
+      auto r{static_cast<Rate>((sysex[4] >> 5) & 0x3)};
+      return to_ms(sysex[4] & 0x1f, sysex[5], sysex[6], sysex[7], r);
+    }
+    if (b & 0x80) {
+      in_sysex = false;
+    } else {
+      if (sysex.size() < 16) sysex.push_back(b);
+      return {};
+    }
+  }
+
+  if (b & 0x80) {
+    in_sysex = (b == 0xf0);
+    quarter_frame = (b == 0xf1);
+    sysex.clear();
+    return {};
+  }
+  if (!quarter_frame) return {};
+  quarter_frame = false;
+
+  // Pieces arrive in order while the time code runs forward.
+  auto piece{b >> 4};
+  if (piece != next_piece) {
+    seen = 0;
+    next_piece = 0;
+    if (piece) return {};
+  }
+  pieces[piece] = b & 0xf;
+  seen |= 1u << piece;
+  next_piece = (piece + 1) % 8;
+  if ((piece != 7) || (seen != 0xff)) return {};
+
+  seen = 0;
+  auto r{static_cast<Rate>((pieces[7] >> 1) & 0x3)};
+  auto f{(pieces[0] | (pieces[1] << 4)) & 0x1f};
+  auto s{(pieces[2] | (pieces[3] << 4)) & 0x3f};
+  auto m{(pieces[4] | (pieces[5] << 4)) & 0x3f};
+  auto h{(pieces[6] | (pieces[7] << 4)) & 0x1f};
+  // The time is that of the first piece, sent seven quarter frames ago.
+  return to_ms(h, m, s, f, r) + (1.75 * frame_ms(r));
+}
+
+LTCDecoder::LTCDecoder(unsigned sample_rate, Rate r)
+    : rate{r}, period{sample_rate * frame_ms(r) / (80 * 1000)} {}
+
+std::optional<double> LTCDecoder::bit(bool one) {
+  data = (data >> 1) | (static_cast<std::uint64_t>(sync & 1) << 63);
+  sync = static_cast<std::uint16_t>((sync >> 1) | (one ? 0x8000 : 0));
+  // Bits 64 to 79 of a frame, sent after the 64 data bits.
+  if ((++bits < 80) || (sync != 0xbffc)) return {};
+
+  auto bcd = [this](unsigned units, unsigned tens, unsigned tens_bits) {
+    return static_cast<int>(((data >> units) & 0xf) +
+                            (10 * ((data >> tens) & ((1u << tens_bits) - 1))));
+  };
+  auto f{bcd(0, 8, 2)};
+  auto s{bcd(16, 24, 3)};
+  auto m{bcd(32, 40, 3)};
+  auto h{bcd(48, 56, 2)};
+  if ((f >= 30) || (s >= 60) || (m >= 60) || (h >= 24)) return {};
+  return to_ms(h, m, s, f, rate) + frame_ms(rate);
+}
+
+std::optional<double> LTCDecoder::feed(std::int16_t sample) {
+  auto x{static_cast<double>(sample)};
+  level = std::max(std::abs(x), level * 0.9995);
+  auto threshold{std::max(64.0, level / 4)};
+  ++since;
+
+  auto s{(x > threshold) ? 1 : ((x < -threshold) ? -1 : sign)};
+  if (s == sign) return {};
+  auto first{!sign};
+  sign = s;
+  if (first) return {};
+
+  auto n{static_cast<double>(since)};
+  since = 0;
+  // Zeroes last a bit period, ones are two half-period transitions.
+  auto ratio{n / period};
+  if ((ratio > 0.75) && (ratio < 1.5)) {
+    half = false;
+    period += (n - period) / 8;
+    return bit(false);
+  }
+  if ((ratio >= 0.25) && (ratio <= 0.75)) {
+    if (!half) {
+      half = true;
+      return {};
+    }
+    half = false;
+    period += ((2 * n) - period) / 8;
+    return bit(true);
+  }
+  half = false;
+  bits = 0;
+  return {};
+}
+
+Chaser::Chaser(const Options &opts, player::Player &p)
+    : p{&p}, opts{opts}, fd{-1}, wake_fd{-1} {
+  jitter.reserve(max_timecode_samples);
+  error.reserve(max_timecode_samples);
+
+  bool bound{false};
+  try {
+    if (opts.kind == SourceKind::socket) {
+      sockaddr_un addr{};
+      addr.sun_family = AF_UNIX;
+      if (opts.path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error{"socket path too long"};
+      std::memcpy(addr.sun_path, opts.path.c_str(), opts.path.size() + 1);
+
+      control::remove_stale_socket(opts.path);
+      fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+      if (fd < 0) throw std::runtime_error{"creating socket"};
+      if (bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)))
+        throw std::runtime_error{"binding socket " + opts.path};
+      bound = true;
+    } else {
+      // FIFOs are also opened for writing so that they do not end while no
+      // writer has them open.
+      struct stat pb;
+      auto fifo{!::stat(opts.path.c_str(), &pb) && S_ISFIFO(pb.st_mode)};
+      fd = (opts.path == "-")
+               ? fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0)
+               : open(opts.path.c_str(),
+                      (fifo ? O_RDWR : O_RDONLY) | O_CLOEXEC | O_NONBLOCK);
+      if (fd < 0) throw std::runtime_error{"could not open " + opts.path};
+
+      struct stat sb;
+      if (fstat(fd, &sb)) throw std::runtime_error{"stat " + opts.path};
+      if (opts.kind == SourceKind::ltc) {
+        if (!opts.sample_rate) throw std::runtime_error{"bad sample rate"};
+        ltc.emplace(opts.sample_rate, opts.rate);
+        paced = S_ISREG(sb.st_mode);
+      } else {
+        mtc.emplace();
+      }
+    }
+
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd < 0) throw std::runtime_error{"creating eventfd"};
+
+    start = Clock::now();
+    t = std::thread{[this]() { serve(); }};
+  } catch (...) {
+    if (fd >= 0) ::close(fd);
+    if (bound) ::unlink(opts.path.c_str());
+    if (wake_fd >= 0) ::close(wake_fd);
+    throw;
+  }
+}
+
+Chaser::~Chaser() {
+  std::uint64_t one{1};
+  // An eventfd counter only fails to increase at its maximum.
+  [[maybe_unused]] auto ret{write(wake_fd, &one, sizeof(one))};
+  t.join();
+  ::close(wake_fd);
+  ::close(fd);
+  if (opts.kind == SourceKind::socket) ::unlink(opts.path.c_str());
+}
+
+void Chaser::timecode(double ms, Clock::time_point at) {
+  auto now{Clock::now()};
+  // Timecode runs in real time, so it has advanced since it arrived.
+  auto tc_now{ms + since_ms(at, now)};
+  auto position{p->status().position_ms};
+  auto moving{last && (ms != last->first) &&
+              (since_ms(last->second, at) < opts.freewheel_ms)};
+
+  std::lock_guard<std::mutex> lk{m};
+  ++st.timecodes;
+  if (last && running) {
+    auto dt{since_ms(last->second, at)};
+    auto deviation{std::abs(dt - (ms - last->first))};
+    auto limit{dropout_frames * frame_ms(opts.rate)};
+    // Gaps and jumps of the timecode are not counted as jitter.
+    if (dt > limit)
+      ++st.dropouts;
+    else if (deviation <= limit)
+      keep(jitter, jitter_next, deviation);
+  }
+  last.emplace(ms, at);
+
+  auto relocate = [&](double to) {
+    p->seek(std::llround(std::max(0.0, to)));
+    ++st.relocations;
+  };
+
+  if (!running) {
+    if (moving) {
+      relocate(tc_now);
+      p->play();
+      running = true;
+    } else if (std::abs(position - ms) > opts.max_drift_ms) {
+      // A locate while the timecode is stopped.
+      relocate(ms);
+    }
+    return;
+  }
+
+  if (!moving) {
+    p->pause();
+    running = false;
+    ++st.stops;
+    return;
+  }
+
+  auto err{position - tc_now};
+  keep(error, error_next, std::abs(err));
+  if (std::abs(err) > opts.max_drift_ms) relocate(tc_now);
+}
+
+bool Chaser::read_source() {
+  char buf[8192];
+  auto want{sizeof(buf)};
+  if (paced) {
+    // Ten milliseconds of samples at a time.
+    want = std::min<std::size_t>(want, (opts.sample_rate / 100) * 2);
+  }
+
+  auto len{(opts.kind == SourceKind::socket) ? recv(fd, buf, want, 0)
+                                             : read(fd, buf, want)};
+  auto now{Clock::now()};
+  if (len < 0) return (errno == EAGAIN) || (errno == EINTR);
+  if (!len) return opts.kind == SourceKind::socket;
+
+  if (opts.kind == SourceKind::socket) {
+    try {
+      timecode(parse_text({buf, static_cast<std::size_t>(len)}, opts.rate),
+               now);
+    } catch (const std::runtime_error &) {
+      // Malformed datagrams are dropped.
+    }
+  } else if (mtc) {
+    for (ssize_t i{0}; i < len; ++i) {
+      if (auto ms{mtc->feed(static_cast<std::uint8_t>(buf[i]))})
+        timecode(*ms, now);
+    }
+  } else {
+    partial.append(buf, len);
+    auto n{partial.size() / 2};
+    for (std::size_t i{0}; i < n; ++i) {
+      auto lo{static_cast<std::uint8_t>(partial[2 * i])};
+      auto hi{static_cast<std::uint8_t>(partial[(2 * i) + 1])};
+      auto ms{ltc->feed(static_cast<std::int16_t>(lo | (hi << 8)))};
+      if (!ms) continue;
+
+      // Time the sample was or would have been captured at.
+      auto offset_ms{
+          paced ? ((samples + i + 1) * 1000.0 / opts.sample_rate)
+                : -((n - i - 1) * 1000.0 / opts.sample_rate)};
+      auto at{(paced ? start : now) +
+              std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double, std::milli>{offset_ms})};
+      timecode(*ms, at);
+    }
+    samples += n;
+    partial.erase(0, 2 * n);
+  }
+  return true;
+}
+
+void Chaser::serve() {
+  pollfd fds[]{{wake_fd, POLLIN, 0}, {fd, POLLIN, 0}};
+  auto open{true};
+
+  while (true) {
+    auto now{Clock::now()};
+    auto timeout{-1};
+    auto wait_until = [&](Clock::time_point t) {
+      auto ms{std::chrono::ceil<std::chrono::milliseconds>(t - now).count()};
+      auto w{static_cast<int>(std::max<decltype(ms)>(0, ms))};
+      timeout = (timeout < 0) ? w : std::min(timeout, w);
+    };
+    if (running && last)
+      wait_until(last->second + std::chrono::milliseconds{opts.freewheel_ms});
+    auto due{false};
+    if (paced && open) {
+      auto next{start + std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>{
+                                static_cast<double>(samples) /
+                                opts.sample_rate})};
+      due = (next <= now);
+      wait_until(next);
+    }
+
+    // Files are always readable, so they are only polled for their timing.
+    auto ret{poll(fds, (open && !paced) ? 2 : 1, timeout)};
+    if ((ret < 0) && (errno != EINTR)) break;
+    if ((ret > 0) && (fds[0].revents & POLLIN)) break;
+
+    if (open && (due || ((ret > 0) && !paced && fds[1].revents)))
+      open = read_source();
+
+    now = Clock::now();
+    if (running && last &&
+        (since_ms(last->second, now) >= opts.freewheel_ms)) {
+      // The timecode stopped, or dropped out for too long.
+      p->pause();
+      running = false;
+      std::lock_guard<std::mutex> lk{m};
+      ++st.dropouts;
+      ++st.stops;
+    }
+  }
+}
+
+Stats Chaser::stats() {
+  std::lock_guard<std::mutex> lk{m};
+  auto s{st};
+  auto j{jitter};
+  auto e{error};
+  s.jitter = bench::summarise(j);
+  s.error = bench::summarise(e);
+  return s;
+}
+}  // namespace timecode
+}  // namespace olavc
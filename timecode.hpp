@@ -0,0 +1,269 @@
+#ifndef TIMECODE_HPP_INCLUDED
+#define TIMECODE_HPP_INCLUDED
+
+#include <bench.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <player.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace olavc {
+namespace timecode {
+/**
+ * Number of timecodes kept for \c Stats::jitter and \c Stats::error .
+ */
+constexpr const std::size_t max_timecode_samples{1 << 16};
+
+/**
+ * SMPTE frame rates.
+ */
+enum class Rate { fps24, fps25, fps2997_drop, fps30 };
+
+/**
+ * \param r frame rate.
+ * \return duration of a frame in milliseconds.
+ */
+double frame_ms(Rate r) noexcept;
+
+/**
+ * Converts a timecode into a time.
+ *
+ * \param h hours.
+ * \param m minutes.
+ * \param s seconds.
+ * \param f frames.
+ * \param r frame rate, drop-frame timecodes skip frame numbers.
+ * \return time in milliseconds.
+ */
+double to_ms(int h, int m, int s, int f, Rate r) noexcept;
+
+/**
+ * Parses a frame rate, one of \c 24 , \c 25 , \c 29.97 (drop-frame) and
+ * \c 30 .
+ *
+ * \throw std::runtime_error if \p s is not a frame rate.
+ */
+Rate parse_rate(std::string_view s);
+
+/**
+ * Parses a text timecode, \c HH:MM:SS:FF or milliseconds.
+ *
+ * \param s timecode.
+ * \param r frame rate of \c HH:MM:SS:FF timecodes.
+ * \return time in milliseconds.
+ * \throw std::runtime_error if \p s is not a timecode.
+ */
+double parse_text(std::string_view s, Rate r);
+
+/**
+ * Decodes MIDI time code from a MIDI byte stream.
+ *
+ * Quarter-frame messages give the time once every eight of them, and
+ * full-frame system exclusive messages give it at once. Other messages are
+ * skipped.
+ */
+class MTCParser {
+ private:
+  std::uint8_t pieces[8]{};
+  unsigned seen{0};
+  int next_piece{0};
+  std::vector<std::uint8_t> sysex;
+  bool in_sysex{false};
+  bool quarter_frame{false};
+
+ public:
+  /**
+   * \param b next byte of the stream.
+   * \return time in milliseconds if \p b completed a timecode.
+   */
+  std::optional<double> feed(std::uint8_t b);
+};
+
+/**
+ * Decodes linear time code from audio samples.
+ *
+ * The biphase-mark signal is sliced at zero crossings with hysteresis, and
+ * the bit period is tracked so varying speeds are followed.
+ */
+class LTCDecoder {
+ private:
+  Rate rate;
+  double period;
+  double level{0};
+  int sign{0};
+  std::uint64_t since{0};
+  bool half{false};
+  std::uint64_t data{0};
+  std::uint16_t sync{0};
+  /**
+   * Number of bits decoded since the signal was last lost.
+   */
+  std::uint64_t bits{0};
+
+  std::optional<double> bit(bool one);
+
+ public:
+  /**
+   * \param sample_rate samples per second.
+   * \param r frame rate of the signal.
+   */
+  LTCDecoder(unsigned sample_rate, Rate r);
+
+  /**
+   * \param sample next sample.
+   * \return time in milliseconds if \p sample completed a frame, which is
+   *         the time at the end of that frame.
+   */
+  std::optional<double> feed(std::int16_t sample);
+};
+
+/**
+ * Sources of timecode.
+ */
+enum class SourceKind {
+  /**
+   * MIDI time code read from a raw MIDI device, file or pipe.
+   */
+  mtc,
+  /**
+   * Linear time code in signed 16-bit little-endian mono samples, read from
+   * a file or pipe. Files are read in real time.
+   */
+  ltc,
+  /**
+   * Text timecodes, one per datagram on a Unix datagram socket.
+   */
+  socket
+};
+
+/**
+ * Chase settings.
+ */
+struct Options {
+  SourceKind kind{SourceKind::mtc};
+  /**
+   * Path of the source, \c - for standard input.
+   */
+  std::string path;
+  /**
+   * Frame rate of LTC and text timecodes.
+   */
+  Rate rate{Rate::fps25};
+  unsigned sample_rate{48000};
+  /**
+   * Largest difference between the playback position and the timecode
+   * before the player is relocated, in milliseconds.
+   */
+  double max_drift_ms{20};
+  /**
+   * Time playback continues without timecode before being paused, in
+   * milliseconds.
+   */
+  unsigned freewheel_ms{1000};
+};
+
+/**
+ * Chase statistics.
+ */
+struct Stats {
+  /**
+   * Number of timecodes received.
+   */
+  std::uint64_t timecodes{};
+  /**
+   * Number of times the player was moved to the timecode.
+   */
+  std::uint64_t relocations{};
+  /**
+   * Number of gaps in the timecode that were free-wheeled through, and of
+   * those that outlasted \c Options::freewheel_ms and paused playback.
+   */
+  std::uint64_t dropouts{};
+  std::uint64_t stops{};
+  /**
+   * Difference between the arrival intervals of consecutive timecodes and
+   * the time between them, over the last \c max_timecode_samples
+   * timecodes.
+   */
+  bench::Latency jitter;
+  /**
+   * Difference between the playback position and each of the last
+   * \c max_timecode_samples timecodes.
+   */
+  bench::Latency error;
+};
+
+/**
+ * Keeps a player at the position of an external timecode.
+ *
+ * The player is relocated whenever it drifts further than
+ * \c Options::max_drift_ms from the timecode, and is otherwise left to run
+ * on its own clock, so dropouts are free-wheeled through. Playback is
+ * paused once the timecode stops moving.
+ */
+class Chaser {
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  player::Player *p;
+  Options opts;
+  int fd;
+  int wake_fd;
+  std::optional<MTCParser> mtc;
+  std::optional<LTCDecoder> ltc;
+  /**
+   * Whether samples are read at their rate rather than as they arrive, and
+   * the number read since \c start .
+   */
+  bool paced{false};
+  Clock::time_point start;
+  std::uint64_t samples{0};
+  std::string partial;
+  std::mutex m;
+  std::vector<double> jitter;
+  std::size_t jitter_next{0};
+  std::vector<double> error;
+  std::size_t error_next{0};
+  Stats st;
+  bool running{false};
+  std::optional<std::pair<double, Clock::time_point>> last;
+  std::thread t;
+
+  void serve();
+  void timecode(double ms, Clock::time_point at);
+  bool read_source();
+
+ public:
+  /**
+   * Opens a timecode source and starts chasing it.
+   *
+   * \param opts chase settings.
+   * \param p player to move, must outlive the chaser.
+   * \throw std::runtime_error if the source cannot be opened.
+   */
+  Chaser(const Options &opts, player::Player &p);
+  Chaser(Chaser &c) = delete;
+  Chaser(Chaser &&c) = delete;
+  Chaser &operator=(Chaser &c) = delete;
+  Chaser &operator=(Chaser &&c) = delete;
+  /**
+   * Stops chasing and closes the source.
+   */
+  ~Chaser();
+
+  /**
+   * \return chase statistics.
+   */
+  Stats stats();
+};
+}  // namespace timecode
+}  // namespace olavc
+
+#endif
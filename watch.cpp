@@ -0,0 +1,252 @@
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread_pool.hpp>
+#include <watch.hpp>
+
+namespace olavc {
+namespace watch {
+namespace {
+namespace fs = std::filesystem;
+
+/**
+ * Closes a file descriptor on scope exit.
+ */
+struct FdGuard {
+  int fd;
+
+  explicit FdGuard(int fd) : fd{fd} {}
+  FdGuard(FdGuard &g) = delete;
+  FdGuard &operator=(FdGuard &g) = delete;
+  ~FdGuard() {
+    if (fd >= 0) ::close(fd);
+  }
+};
+
+/**
+ * Counters exported by the daemon.
+ */
+struct Counters {
+  std::atomic<std::uint64_t> completed{0};
+  std::atomic<std::uint64_t> failed{0};
+  std::atomic<std::uint64_t> frames{0};
+  std::atomic<std::uint64_t> bytes_in{0};
+};
+
+/**
+ * Counter values at the previous export, for throughput over the interval.
+ */
+struct Snapshot {
+  std::chrono::steady_clock::time_point time;
+  std::uint64_t frames;
+  std::uint64_t bytes_in;
+};
+
+bool wanted(const fs::path &p, const Options &opts) {
+  auto name{p.filename().string()};
+  if (!name.size() || (name.front() == '.')) return false;
+  if (name.size() < opts.suffix.size()) return false;
+  return std::equal(opts.suffix.rbegin(), opts.suffix.rend(), name.rbegin());
+}
+
+fs::path output_for(const fs::path &in, const Options &opts) {
+  auto out{in};
+  out.replace_extension(output_extension(opts.defaults.format));
+  if (opts.output_dir.size()) out = fs::path{opts.output_dir} / out.filename();
+  return out;
+}
+
+void write_stats(const Options &opts, const Counters &c, std::size_t pending,
+                 std::size_t active, Snapshot &last) {
+  auto now{std::chrono::steady_clock::now()};
+  Snapshot cur{now, c.frames.load(), c.bytes_in.load()};
+  auto dt{std::chrono::duration<double>{now - last.time}.count()};
+  auto rate = [dt](std::uint64_t a, std::uint64_t b) {
+    return (dt > 0) ? ((a - b) / dt) : 0.0;
+  };
+
+  if (opts.stats_path.size()) {
+    auto tmp{opts.stats_path + ".tmp"};
+    {
+      std::ofstream s{tmp};
+      if (!s) throw std::runtime_error{"could not open stats file"};
+      s << "olavc_queue_depth " << pending << '\n'
+        << "olavc_active_conversions " << active << '\n'
+        << "olavc_conversions_completed_total " << c.completed << '\n'
+        << "olavc_conversions_failed_total " << c.failed << '\n'
+        << "olavc_frames_converted_total " << cur.frames << '\n'
+        << "olavc_input_bytes_converted_total " << cur.bytes_in << '\n'
+        << "olavc_frames_per_second " << rate(cur.frames, last.frames) << '\n'
+        << "olavc_input_bytes_per_second "
+        << rate(cur.bytes_in, last.bytes_in) << '\n';
+      if (!s) throw std::runtime_error{"writing stats file"};
+    }
+    fs::rename(tmp, opts.stats_path);
+  }
+
+  last = cur;
+}
+
+/**
+ * Schedules conversions until a stop signal arrives.
+ *
+ * Returns once all queued conversions have finished.
+ */
+void serve(const Options &opts, int ifd, int sfd,
+           const std::map<int, fs::path> &watches, Counters &counters,
+           Snapshot &last, std::ostream &log) {
+  std::mutex log_m;
+  std::mutex in_flight_m;
+  std::set<fs::path> in_flight;
+  ThreadPool pool{opts.cores};
+
+  auto convert_one = [&](const fs::path &in, const fs::path &out) {
+    auto job{opts.defaults};
+    job.input = in.string();
+    job.output = out.string() + ".part";
+    job.progress = 0;
+    auto outstanding{std::max<std::size_t>(1, pool.pending() + pool.active())};
+    job.threads = std::max<int>(
+        1, opts.cores / std::min<std::size_t>(opts.cores, outstanding));
+
+    std::string error;
+    try {
+      auto result{convert(job)};
+      fs::rename(job.output, out);
+      counters.frames += result.frames;
+      std::error_code ec;
+      auto size{fs::file_size(in, ec)};
+      if (!ec) counters.bytes_in += size;
+      ++counters.completed;
+    } catch (const std::exception &e) {
+      error = e.what();
+      std::error_code ec;
+      fs::remove(job.output, ec);
+      ++counters.failed;
+    }
+
+    {
+      std::lock_guard<std::mutex> lk{in_flight_m};
+      in_flight.erase(in);
+    }
+    std::lock_guard<std::mutex> lk{log_m};
+    if (error.size())
+      log << "FAILED " << in.string() << ": " << error << '\n';
+    else
+      log << "done " << in.string() << " -> " << out.string() << '\n';
+  };
+
+  auto schedule = [&](const fs::path &in) {
+    if (!wanted(in, opts)) return;
+    {
+      // A writer may close the same file more than once.
+      std::lock_guard<std::mutex> lk{in_flight_m};
+      if (!in_flight.insert(in).second) return;
+    }
+    // Queued conversions still run while the pool is destroyed, which is
+    // after convert_one, so each task holds its own copy. Everything that
+    // convert_one refers to outlives the pool.
+    pool.submit([convert_one, in, out{output_for(in, opts)}]() {
+      convert_one(in, out);
+    });
+  };
+
+  for (const auto &d : opts.dirs) {
+    for (const auto &e : fs::directory_iterator{d}) {
+      if (e.is_regular_file() && !fs::exists(output_for(e.path(), opts)))
+        schedule(e.path());
+    }
+  }
+
+  alignas(inotify_event) char buf[4096];
+  pollfd fds[]{{ifd, POLLIN, 0}, {sfd, POLLIN, 0}};
+  auto interval{std::chrono::seconds{std::max(1u, opts.stats_interval_s)}};
+  auto next_stats{std::chrono::steady_clock::now() + interval};
+  while (true) {
+    auto wait{std::chrono::duration_cast<std::chrono::milliseconds>(
+        next_stats - std::chrono::steady_clock::now())};
+    auto ret{poll(fds, 2, std::max<long>(0, wait.count()))};
+    if ((ret < 0) && (errno != EINTR)) throw std::runtime_error{"polling"};
+
+    if ((ret > 0) && (fds[1].revents & POLLIN)) break;
+
+    if ((ret > 0) && (fds[0].revents & POLLIN)) {
+      ssize_t len;
+      while ((len = read(ifd, buf, sizeof(buf))) > 0) {
+        for (char *p{buf}; p < (buf + len);) {
+          const auto *ev{reinterpret_cast<const inotify_event *>(p)};
+          p += sizeof(inotify_event) + ev->len;
+
+          if (ev->mask & IN_Q_OVERFLOW) {
+            std::lock_guard<std::mutex> lk{log_m};
+            log << "inotify queue overflow, events lost" << '\n';
+          }
+          if (!ev->len || (ev->mask & IN_ISDIR)) continue;
+
+          auto dir{watches.find(ev->wd)};
+          if (dir != watches.end()) schedule(dir->second / ev->name);
+        }
+      }
+    }
+
+    if (std::chrono::steady_clock::now() >= next_stats) {
+      write_stats(opts, counters, pool.pending(), pool.active(), last);
+      next_stats += interval;
+    }
+  }
+
+  std::lock_guard<std::mutex> lk{log_m};
+  log << "stopping, finishing " << (pool.pending() + pool.active())
+      << " queued conversion(s)" << '\n';
+}
+}  // namespace
+
+std::size_t run(const Options &opts, std::ostream &log) {
+  if (opts.dirs.empty()) throw std::runtime_error{"no directory to watch"};
+
+  // Blocked before any worker starts so that the signals are only ever
+  // consumed through the signalfd.
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if (pthread_sigmask(SIG_BLOCK, &mask, nullptr))
+    throw std::runtime_error{"blocking signals"};
+
+  FdGuard sfd{signalfd(-1, &mask, SFD_CLOEXEC)};
+  if (sfd.fd < 0) throw std::runtime_error{"creating signalfd"};
+
+  FdGuard ifd{inotify_init1(IN_CLOEXEC | IN_NONBLOCK)};
+  if (ifd.fd < 0) throw std::runtime_error{"creating inotify instance"};
+
+  std::map<int, fs::path> watches;
+  for (const auto &d : opts.dirs) {
+    auto wd{inotify_add_watch(ifd.fd, d.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR)};
+    if (wd < 0) throw std::runtime_error{"watching directory " + d};
+    watches.emplace(wd, d);
+  }
+
+  Counters counters{};
+  Snapshot last{std::chrono::steady_clock::now(), 0, 0};
+  serve(opts, ifd.fd, sfd.fd, watches, counters, last, log);
+  write_stats(opts, counters, 0, 0, last);
+
+  return counters.failed.load();
+}
+}  // namespace watch
+}  // namespace olavc
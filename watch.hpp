@@ -0,0 +1,68 @@
+#ifndef WATCH_HPP_INCLUDED
+#define WATCH_HPP_INCLUDED
+
+#include <convert.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace olavc {
+namespace watch {
+/**
+ * Parameters for the watch-folder daemon.
+ */
+struct Options {
+  /**
+   * Directories to watch for finished showfiles.
+   */
+  std::vector<std::string> dirs;
+  /**
+   * Directory receiving outputs, empty to write them next to the inputs.
+   */
+  std::string output_dir;
+  /**
+   * Suffix a file name must have to be converted.
+   */
+  std::string suffix{".show"};
+  /**
+   * Path of the counter file, empty to disable it.
+   *
+   * The file is rewritten atomically in the Prometheus text exposition
+   * format, so it can be picked up by a node exporter textfile collector.
+   */
+  std::string stats_path;
+  /**
+   * Interval between counter updates in seconds.
+   */
+  unsigned stats_interval_s{10};
+  /**
+   * Core budget shared by all conversions.
+   */
+  unsigned cores{1};
+  /**
+   * Options applied to every conversion.
+   */
+  ConvertOptions defaults;
+};
+
+/**
+ * Watches directories and converts showfiles as they are completed.
+ *
+ * A file is considered complete once it is closed after writing or renamed
+ * into a watched directory. Files already present at startup are converted if
+ * their output does not exist yet. Outputs are written under a temporary name
+ * and renamed into place when the conversion succeeds.
+ *
+ * Runs until \c SIGINT or \c SIGTERM is received, then finishes conversions
+ * already queued.
+ *
+ * \param opts daemon parameters.
+ * \param log stream receiving a line per finished conversion.
+ * \return number of failed conversions.
+ * \throw std::runtime_error if the watches cannot be set up.
+ */
+std::size_t run(const Options &opts, std::ostream &log = std::cerr);
+}  // namespace watch
+}  // namespace olavc
+
+#endif